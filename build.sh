@@ -17,6 +17,11 @@
 set -euo pipefail
 
 # Build erdemOS init as a simple Linux userspace program and create initramfs
+#
+# Usage: ./build.sh [--release]
+#   --release  Link-time optimized build with dead section removal and a
+#              profile-guided ersh, trained on bench/workload.ersh. Prints
+#              size and latency deltas against the plain build.
 
 ROOT_DIR=$(cd "$(dirname "$0")" && pwd)
 cd "$ROOT_DIR"
@@ -26,7 +31,18 @@ CC=${CC:-gcc}
 SRC_DIR=src
 OUTPUT_DIR=output
 INITRAMFS_DIR="$OUTPUT_DIR/initramfs"
-CFLAGS="-Wall -Wextra -O2 -static"
+CFLAGS="-Wall -Wextra -O2 -static -pthread"
+RELEASE_CFLAGS="$CFLAGS -flto -ffunction-sections -fdata-sections"
+RELEASE_LDFLAGS="-Wl,--gc-sections"
+BUILD_MODE=plain
+
+# Release build directories and PGO training settings
+PGO_DIR="$OUTPUT_DIR/pgo"
+PLAIN_DIR="$OUTPUT_DIR/plain"
+PGO_WORKLOAD=bench/workload.ersh
+PGO_LOOPS=${PGO_LOOPS:-20}
+HOST_CC=${HOST_CC:-$CC}
+PTYRUN="$OUTPUT_DIR/ptyrun"
 
 # Outputs
 OUTPUT_INIT="$OUTPUT_DIR/init"
@@ -40,13 +56,76 @@ info() { echo "[$(date +%H:%M:%S)] $*"; }
 die() { echo "Error: $*" >&2; exit 1; }
 require_cmd() { command -v "$1" >/dev/null 2>&1 || die "Required command not found: $1"; }
 
+# Parse options
+for arg in "$@"; do
+    case "$arg" in
+        --release) BUILD_MODE=release ;;
+        *) die "Unknown option: $arg (usage: ./build.sh [--release])" ;;
+    esac
+done
+
 # Dependency checks
 for cmd in "$CC" cpio gzip; do
     require_cmd "$cmd"
 done
 
+# Compile one program: compile <name> <output> [extra flags...]
+# Release objects are compiled separately so the .gcda profile path is stable
+# between the -fprofile-generate and -fprofile-use passes.
+compile() {
+    local name=$1 out=$2
+    shift 2
+    if [ "$BUILD_MODE" = release ]; then
+        local obj="$PGO_DIR/$name.o"
+        "$CC" $RELEASE_CFLAGS "$@" -c "$SRC_DIR/$name.c" -o "$obj"
+        "$CC" $RELEASE_CFLAGS "$@" $RELEASE_LDFLAGS "$obj" -o "$out"
+    else
+        "$CC" $CFLAGS "$@" "$SRC_DIR/$name.c" -o "$out"
+    fi
+}
+
+# Run the ersh workload under ptyrun and print elapsed milliseconds.
+# ersh reads one line per read(), so the input must go through a pty line
+# discipline rather than a pipe.
+run_workload() {
+    local ersh
+    ersh=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+    local work
+    work=$(mktemp -d)
+    mkdir -p "$work/fixture"
+    for d in 0 1 2 3 4 5 6 7; do
+        mkdir -p "$work/fixture/dir$d"
+        for f in 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15; do
+            : > "$work/fixture/dir$d/file$f"
+        done
+    done
+    local start end
+    start=$(date +%s%N)
+    (cd "$work" && "$ROOT_DIR/$PTYRUN" -q -l "$PGO_LOOPS" "$ROOT_DIR/$PGO_WORKLOAD" -- "$ersh")
+    end=$(date +%s%N)
+    rm -rf "$work"
+    echo $(( (end - start) / 1000000 ))
+}
+
+# Best of three workload runs in milliseconds
+best_workload_ms() {
+    local best="" ms
+    for _ in 1 2 3; do
+        ms=$(run_workload "$1")
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$best"
+}
+
 # Create output directory
 mkdir -p "$OUTPUT_DIR"
+if [ "$BUILD_MODE" = release ]; then
+    rm -rf "$PGO_DIR"
+    mkdir -p "$PGO_DIR"
+    "$HOST_CC" -Wall -Wextra -O2 test/ptyrun.c -o "$PTYRUN"
+fi
 
 # Generate version.h from VERSION file
 info "[1/5] Generating version.h from VERSION file"
@@ -82,17 +161,24 @@ cat > include/version.h << EOF
 #endif // VERSION_H
 EOF
 
-info "[2/6] Compiling init userspace program (static)"
-"$CC" $CFLAGS "$SRC_DIR/init.c" -o "$OUTPUT_INIT"
+info "[2/6] Compiling init userspace program (static, $BUILD_MODE)"
+compile init "$OUTPUT_INIT"
 
-info "[3/6] Compiling ersh shell (static)"
-"$CC" $CFLAGS "$SRC_DIR/ersh.c" -o "$OUTPUT_ERSH"
+info "[3/6] Compiling ersh shell (static, $BUILD_MODE)"
+if [ "$BUILD_MODE" = release ]; then
+    info "  Training ersh profile with $PGO_WORKLOAD x $PGO_LOOPS"
+    compile ersh "$OUTPUT_ERSH" -fprofile-generate -fprofile-update=single
+    run_workload "$OUTPUT_ERSH" > /dev/null
+    compile ersh "$OUTPUT_ERSH" -fprofile-use -fprofile-partial-training
+else
+    compile ersh "$OUTPUT_ERSH"
+fi
 
-info "[4/6] Compiling poweroff utility (static)"
-"$CC" $CFLAGS "$SRC_DIR/poweroff.c" -o "$OUTPUT_POWEROFF"
+info "[4/6] Compiling poweroff utility (static, $BUILD_MODE)"
+compile poweroff "$OUTPUT_POWEROFF"
 
-info "[5/6] Compiling loadkeys utility (static)"
-"$CC" $CFLAGS "$SRC_DIR/loadkeys.c" -o "$OUTPUT_LOADKEYS"
+info "[5/6] Compiling loadkeys utility (static, $BUILD_MODE)"
+compile loadkeys "$OUTPUT_LOADKEYS"
 
 info "[6/6] Creating initramfs with all binaries"
 
@@ -118,6 +204,27 @@ cd "$ROOT_DIR"
 # Clean up temporary initramfs directory
 rm -rf "$INITRAMFS_DIR"
 
+# Compare release binaries with the plain -O2 -static build
+if [ "$BUILD_MODE" = release ]; then
+    info "Building plain binaries for comparison"
+    mkdir -p "$PLAIN_DIR"
+    for name in init ersh poweroff loadkeys; do
+        "$CC" $CFLAGS "$SRC_DIR/$name.c" -o "$PLAIN_DIR/$name"
+    done
+
+    info "Size (bytes):      plain    release      delta"
+    for name in init ersh poweroff loadkeys; do
+        plain=$(stat -c %s "$PLAIN_DIR/$name")
+        release=$(stat -c %s "$OUTPUT_DIR/$name")
+        info "$(printf '  %-10s %10d %10d %+10d' "$name" "$plain" "$release" $((release - plain)))"
+    done
+
+    plain_ms=$(best_workload_ms "$PLAIN_DIR/ersh")
+    release_ms=$(best_workload_ms "$OUTPUT_ERSH")
+    info "Workload (ms):     plain    release      delta"
+    info "$(printf '  %-10s %10d %10d %+10d' ersh "$plain_ms" "$release_ms" $((release_ms - plain_ms)))"
+fi
+
 # Final info
 info "Build complete:"
 info "  Init binary:     $OUTPUT_INIT"
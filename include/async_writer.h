@@ -0,0 +1,215 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ERDEMOS_ASYNC_WRITER_H
+#define ERDEMOS_ASYNC_WRITER_H
+
+// Asynchronous console writer for output.h
+//
+// When started, flushed output is copied into a lock-free single-producer,
+// single-consumer ring and written to fd 1 by a dedicated thread, so a slow
+// serial console does not stall the shell. The producer is the main thread
+// (out_flush), the consumer is the writer thread. Each side only advances
+// its own counter; a futex puts the writer to sleep when the ring is empty
+// and the shell when it is full.
+//
+// A full ring makes the shell wait for the console (back-pressure). With
+// the drop policy and stdout not a terminal, output that does not fit is
+// discarded and counted instead; on a terminal nothing is ever dropped.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "output.h"
+
+#define ASYNC_RING_SIZE (64 * 1024)     // Power of two
+
+#define ASYNC_BLOCK 0
+#define ASYNC_DROP  1
+
+struct async_writer {
+    _Atomic uint32_t head;          // Bytes produced, written by the main thread
+    _Atomic uint32_t tail;          // Bytes consumed, written by the writer thread
+    _Atomic uint32_t stop;
+    _Atomic uint32_t writer_seq;    // Bumped to wake the writer thread
+    _Atomic uint32_t shell_seq;     // Bumped to wake the main thread
+    _Atomic int writer_waiting;
+    _Atomic int shell_waiting;
+    int running;
+    int policy;
+    int interactive;
+    uint64_t dropped;
+    pthread_t thread;
+    char ring[ASYNC_RING_SIZE];
+};
+
+static struct async_writer async_out;
+
+static inline void async_futex_wait(_Atomic uint32_t *word, uint32_t value) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+// Wake a side that announced it is going to sleep. Bumping the sequence
+// word makes a futex wait that has not started yet return at once.
+//
+// The caller has just published head or tail with a release store. A
+// release store may still be reordered with the later load of the waiting
+// flag, on x86 too, and then both sides can miss each other: the fence
+// pairs with the one in async_announce().
+static inline void async_wake(_Atomic uint32_t *seq, _Atomic int *waiting) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(waiting)) {
+        atomic_fetch_add(seq, 1);
+        syscall(SYS_futex, seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+// Set a waiting flag before re-checking the condition to sleep on
+static inline void async_announce(_Atomic int *waiting) {
+    atomic_store(waiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+static void *async_writer_main(void *arg) {
+    (void)arg;
+    struct async_writer *w = &async_out;
+    uint32_t tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+    while (1) {
+        uint32_t head = atomic_load_explicit(&w->head, memory_order_acquire);
+        if (head == tail) {
+            if (atomic_load(&w->stop)) {
+                return NULL;
+            }
+            // Announce, re-check, then sleep
+            uint32_t seq = atomic_load(&w->writer_seq);
+            async_announce(&w->writer_waiting);
+            if (atomic_load(&w->head) == tail && !atomic_load(&w->stop)) {
+                async_futex_wait(&w->writer_seq, seq);
+            }
+            atomic_store(&w->writer_waiting, 0);
+            continue;
+        }
+        // Write the contiguous part up to the end of the ring
+        uint32_t offset = tail & (ASYNC_RING_SIZE - 1);
+        uint32_t len = head - tail;
+        if (len > ASYNC_RING_SIZE - offset) {
+            len = ASYNC_RING_SIZE - offset;
+        }
+        ssize_t n = write(1, w->ring + offset, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // Output that cannot be written at all is discarded
+        tail += (n > 0) ? (uint32_t)n : len;
+        atomic_store_explicit(&w->tail, tail, memory_order_release);
+        async_wake(&w->shell_seq, &w->shell_waiting);
+    }
+}
+
+// Sleep in the main thread until the writer moves the tail past value
+static inline void async_wait_tail(uint32_t value) {
+    struct async_writer *w = &async_out;
+    uint32_t seq = atomic_load(&w->shell_seq);
+    async_announce(&w->shell_waiting);
+    if (atomic_load(&w->tail) == value) {
+        async_futex_wait(&w->shell_seq, seq);
+    }
+    atomic_store(&w->shell_waiting, 0);
+}
+
+// output.h sink: copy into the ring, waiting for space or dropping
+static void async_writer_push(const char *data, size_t len) {
+    struct async_writer *w = &async_out;
+    uint32_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+    while (len > 0) {
+        uint32_t tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+        uint32_t space = ASYNC_RING_SIZE - (head - tail);
+        if (space == 0) {
+            if (w->policy == ASYNC_DROP && !w->interactive) {
+                w->dropped += len;
+                return;
+            }
+            async_wait_tail(tail);
+            continue;
+        }
+        uint32_t offset = head & (ASYNC_RING_SIZE - 1);
+        uint32_t chunk = space;
+        if (chunk > ASYNC_RING_SIZE - offset) {
+            chunk = ASYNC_RING_SIZE - offset;
+        }
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(w->ring + offset, data, chunk);
+        head += chunk;
+        data += chunk;
+        len -= chunk;
+        atomic_store_explicit(&w->head, head, memory_order_release);
+        async_wake(&w->writer_seq, &w->writer_waiting);
+    }
+}
+
+// Wait until the writer thread has written everything pushed so far
+static inline void async_writer_drain(void) {
+    struct async_writer *w = &async_out;
+    if (!w->running) {
+        return;
+    }
+    uint32_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+    uint32_t tail;
+    while ((tail = atomic_load_explicit(&w->tail, memory_order_acquire)) != head) {
+        async_wait_tail(tail);
+    }
+}
+
+static inline int async_writer_start(int policy) {
+    struct async_writer *w = &async_out;
+    w->policy = policy;
+    w->interactive = isatty(1);
+    if (w->running) {
+        return 0;
+    }
+    out_flush();
+    atomic_store(&w->stop, 0);
+    if (pthread_create(&w->thread, NULL, async_writer_main, NULL) != 0) {
+        return -1;
+    }
+    w->running = 1;
+    out_sink = async_writer_push;
+    return 0;
+}
+
+static inline void async_writer_stop(void) {
+    struct async_writer *w = &async_out;
+    if (!w->running) {
+        return;
+    }
+    out_flush();
+    async_writer_drain();
+    out_sink = out_write_all;
+    atomic_store(&w->stop, 1);
+    async_wake(&w->writer_seq, &w->writer_waiting);
+    pthread_join(w->thread, NULL);
+    w->running = 0;
+}
+
+// A forked child has no writer thread: write directly again
+static inline void async_writer_after_fork(void) {
+    async_out.running = 0;
+    out_sink = out_write_all;
+}
+
+#endif // ERDEMOS_ASYNC_WRITER_H
@@ -0,0 +1,584 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ERDEMOS_FSTAB_H
+#define ERDEMOS_FSTAB_H
+
+// Mounting file systems, one at a time or from /etc/fstab
+//
+// mount_fs() uses the file system context API: fsopen() and fsconfig()
+// build the superblock, fsmount() turns it into a detached mount and
+// move_mount() attaches it. Kernels without it (before 5.2) get mount(2).
+// Only <linux/mount.h> is used, through syscall(), because glibc's
+// <sys/mount.h> cannot be included together with it.
+//
+// fstab_mount_all() mounts every entry of an fstab in its own child
+// process (mounts belong to the namespace, not the process, and init
+// stays free of threads). An entry waits only for the entry it is nested
+// in, the one whose mount point is the longest prefix of its own, so
+// independent disks are mounted at the same time and /mnt/a/b still comes
+// after /mnt/a. Children are waited for with pidfds and poll().
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/mount.h>
+
+#ifndef MNT_DETACH
+#define MNT_DETACH 2
+#endif
+
+#define FSTAB_PENDING 0
+#define FSTAB_RUNNING 1
+#define FSTAB_DONE    2
+
+// Mount options that are flags of the mount rather than of the file system
+static const struct {
+    const char *name;
+    unsigned attr;              // MOUNT_ATTR_* for fsmount()
+    unsigned long flag;         // MS_* for mount(2)
+} mount_flag_options[] = {
+    { "ro", MOUNT_ATTR_RDONLY, MS_RDONLY },
+    { "nosuid", MOUNT_ATTR_NOSUID, MS_NOSUID },
+    { "nodev", MOUNT_ATTR_NODEV, MS_NODEV },
+    { "noexec", MOUNT_ATTR_NOEXEC, MS_NOEXEC },
+    { "noatime", MOUNT_ATTR_NOATIME, MS_NOATIME },
+    { "relatime", MOUNT_ATTR_RELATIME, MS_RELATIME },
+    { "strictatime", MOUNT_ATTR_STRICTATIME, MS_STRICTATIME },
+    { "nodiratime", MOUNT_ATTR_NODIRATIME, MS_NODIRATIME },
+};
+
+// Options that only select defaults or matter to fstab processing
+static inline int mount_option_ignored(const char *option) {
+    return strcmp(option, "defaults") == 0 || strcmp(option, "rw") == 0 ||
+           strcmp(option, "auto") == 0 || strcmp(option, "noauto") == 0 ||
+           strcmp(option, "nofail") == 0 || strcmp(option, "bind") == 0;
+}
+
+static inline int mount_has_option(const char *options, const char *name) {
+    size_t len = strlen(name);
+    for (const char *p = options; p != NULL && *p != '\0'; ) {
+        if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+        p = strchr(p, ',');
+        p = (p != NULL) ? p + 1 : NULL;
+    }
+    return 0;
+}
+
+// mount(2), with the file system options joined back into its data string
+static inline int mount_fs_legacy(const char *source, const char *target, const char *type,
+                                  unsigned long flags, const char *data) {
+    return (int)syscall(SYS_mount, source, target, type, flags, (*data != '\0') ? data : NULL);
+}
+
+// Mount source of the given type on target; options is a mount(8) style
+// list like "ro,noatime,size=64m" and may be NULL. Returns 0, or -1 with
+// errno set.
+static inline int mount_fs(const char *source, const char *target, const char *type,
+                           const char *options) {
+    char *list = strdup((options != NULL) ? options : "");
+    char *data = malloc(strlen((options != NULL) ? options : "") + 1);
+    if (list == NULL || data == NULL) {
+        free(list);
+        free(data);
+        errno = ENOMEM;
+        return -1;
+    }
+    int bind = mount_has_option(list, "bind");
+
+    // Split into mount flags and file system options
+    unsigned attr = 0;
+    unsigned long flags = bind ? MS_BIND : 0;
+    size_t data_len = 0;
+    data[0] = '\0';
+    for (char *option = list; option != NULL && *option != '\0'; ) {
+        char *next = strchr(option, ',');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        size_t i;
+        for (i = 0; i < sizeof(mount_flag_options) / sizeof(mount_flag_options[0]); i++) {
+            if (strcmp(option, mount_flag_options[i].name) == 0) {
+                attr |= mount_flag_options[i].attr;
+                flags |= mount_flag_options[i].flag;
+                break;
+            }
+        }
+        if (i == sizeof(mount_flag_options) / sizeof(mount_flag_options[0]) &&
+            !mount_option_ignored(option)) {
+            size_t len = strlen(option);
+            if (data_len > 0) {
+                data[data_len++] = ',';
+            }
+            memcpy(data + data_len, option, len + 1);
+            data_len += len;
+        }
+        option = next;
+    }
+
+    int result = -1;
+    int fs_fd = -1;
+    int mount_fd = -1;
+    if (bind) {
+        // A bind mount is a clone of an existing tree
+        mount_fd = (int)syscall(SYS_open_tree, AT_FDCWD, source, OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC);
+        if (mount_fd < 0 && errno == ENOSYS) {
+            result = mount_fs_legacy(source, target, NULL, flags, "");
+            goto out;
+        }
+        if (mount_fd >= 0 && attr != 0) {
+            struct mount_attr set = { .attr_set = attr };
+            syscall(SYS_mount_setattr, mount_fd, "", AT_EMPTY_PATH, &set, sizeof(set));
+        }
+    } else {
+        fs_fd = (int)syscall(SYS_fsopen, type, FSOPEN_CLOEXEC);
+        if (fs_fd < 0) {
+            if (errno == ENOSYS) {
+                result = mount_fs_legacy(source, target, type, flags, data);
+            }
+            goto out;
+        }
+        if (source != NULL && *source != '\0' &&
+            syscall(SYS_fsconfig, fs_fd, FSCONFIG_SET_STRING, "source", source, 0) != 0) {
+            goto out;
+        }
+        // "ro" also makes the superblock read-only
+        if ((attr & MOUNT_ATTR_RDONLY) &&
+            syscall(SYS_fsconfig, fs_fd, FSCONFIG_SET_FLAG, "ro", NULL, 0) != 0) {
+            goto out;
+        }
+        for (char *option = data; *option != '\0'; ) {
+            char *next = strchr(option, ',');
+            if (next != NULL) {
+                *next++ = '\0';
+            } else {
+                next = option + strlen(option);
+            }
+            char *value = strchr(option, '=');
+            if (value != NULL) {
+                *value++ = '\0';
+            }
+            long r = (value != NULL)
+                ? syscall(SYS_fsconfig, fs_fd, FSCONFIG_SET_STRING, option, value, 0)
+                : syscall(SYS_fsconfig, fs_fd, FSCONFIG_SET_FLAG, option, NULL, 0);
+            if (r != 0) {
+                goto out;
+            }
+            option = next;
+        }
+        if (syscall(SYS_fsconfig, fs_fd, FSCONFIG_CMD_CREATE, NULL, NULL, 0) != 0) {
+            goto out;
+        }
+        mount_fd = (int)syscall(SYS_fsmount, fs_fd, FSMOUNT_CLOEXEC, attr);
+    }
+    if (mount_fd >= 0) {
+        result = (int)syscall(SYS_move_mount, mount_fd, "", AT_FDCWD, target,
+                              MOVE_MOUNT_F_EMPTY_PATH);
+    }
+
+out:;
+    int saved = errno;
+    if (mount_fd >= 0) {
+        close(mount_fd);
+    }
+    if (fs_fd >= 0) {
+        close(fs_fd);
+    }
+    free(list);
+    free(data);
+    errno = saved;
+    return result;
+}
+
+struct fstab_entry {
+    char *source;
+    char *target;
+    char *type;
+    char *options;
+    int parent;                 // Entry this one is nested in, or -1
+    int state;                  // FSTAB_*
+    int error;                  // errno of a failed mount, 0 if it worked
+    int skipped;                // Already mounted, or its parent failed
+    long us;                    // Time from start to completion of the mount
+    pid_t pid;
+    int pidfd;                  // -1 where pidfd_open() is not available
+    struct timespec start;
+};
+
+struct fstab {
+    char *text;
+    struct fstab_entry *entries;
+    size_t count;
+};
+
+// Decode the \ooo escapes of an fstab or mountinfo field in place (\040
+// is a space); returns field
+static inline char *mount_unescape(char *field) {
+    char *out = field;
+    for (char *in = field; *in != '\0'; in++) {
+        if (in[0] == '\\' && in[1] >= '0' && in[1] <= '3' && in[2] >= '0' && in[2] <= '7' &&
+            in[3] >= '0' && in[3] <= '7') {
+            *out++ = (char)((in[1] - '0') << 6 | (in[2] - '0') << 3 | (in[3] - '0'));
+            in += 3;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+    return field;
+}
+
+// Cut the next blank-separated field and decode it; NULL at the end of
+// the line
+static inline char *fstab_field(char **cursor) {
+    char *p = *cursor;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p == '\0') {
+        *cursor = p;
+        return NULL;
+    }
+    char *start = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t') {
+        p++;
+    }
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return mount_unescape(start);
+}
+
+// Whether something is mounted on path. /proc/self/mountinfo lists every
+// mount point, bind mounts of a directory on its own file system too;
+// before /proc is mounted, path counts when it is on another device than
+// its parent directory or is its own parent (the root).
+static inline int mount_point_busy(const char *path) {
+    char *real = realpath(path, NULL);
+    if (real == NULL) {
+        return 0;
+    }
+    int busy = -1;
+    int fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        // proc files have no size: read until the end, growing the buffer
+        size_t cap = 16384;
+        size_t len = 0;
+        char *text = malloc(cap);
+        while (text != NULL) {
+            ssize_t n = read(fd, text + len, cap - 1 - len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                if (n < 0) {
+                    free(text);
+                    text = NULL;
+                }
+                break;
+            }
+            len += n;
+            if (len == cap - 1) {
+                char *grown = realloc(text, cap * 2);
+                if (grown == NULL) {
+                    free(text);
+                }
+                text = grown;
+                cap *= 2;
+            }
+        }
+        close(fd);
+        if (text != NULL) {
+            text[len] = '\0';
+            busy = 0;
+            // id parent major:minor root target ...
+            char *line = text;
+            while (!busy && *line != '\0') {
+                char *next = strchr(line, '\n');
+                if (next != NULL) {
+                    *next++ = '\0';
+                } else {
+                    next = line + strlen(line);
+                }
+                char *cursor = line;
+                char *target = NULL;
+                for (int i = 0; i < 5; i++) {
+                    target = fstab_field(&cursor);
+                }
+                busy = target != NULL && strcmp(target, real) == 0;
+                line = next;
+            }
+            free(text);
+        }
+    }
+    if (busy < 0) {
+        size_t len = strlen(real);
+        char *parent = malloc(len + 4);
+        struct stat st;
+        struct stat up;
+        busy = 0;
+        if (parent != NULL) {
+            memcpy(parent, real, len);
+            memcpy(parent + len, "/..", 4);
+            busy = stat(real, &st) == 0 && stat(parent, &up) == 0 &&
+                   (st.st_dev != up.st_dev || st.st_ino == up.st_ino);
+            free(parent);
+        }
+    }
+    free(real);
+    return busy;
+}
+
+// Whether mount point a contains mount point b
+static inline int fstab_nested(const char *a, const char *b) {
+    size_t len = strlen(a);
+    if (strcmp(a, "/") == 0) {
+        return strcmp(b, "/") != 0;
+    }
+    return strncmp(a, b, len) == 0 && b[len] == '/';
+}
+
+static inline void fstab_free(struct fstab *table) {
+    free(table->text);
+    free(table->entries);
+    table->text = NULL;
+    table->entries = NULL;
+    table->count = 0;
+}
+
+// Read and split an fstab; swap and noauto entries are left out
+static inline int fstab_load(struct fstab *table, const char *path) {
+    memset(table, 0, sizeof(*table));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (table->text = malloc(st.st_size + 1)) == NULL) {
+        close(fd);
+        return -1;
+    }
+    size_t len = 0;
+    while (len < (size_t)st.st_size) {
+        ssize_t n = read(fd, table->text + len, st.st_size - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    close(fd);
+    table->text[len] = '\0';
+
+    size_t lines = 1;
+    for (size_t i = 0; i < len; i++) {
+        lines += (table->text[i] == '\n');
+    }
+    table->entries = calloc(lines, sizeof(*table->entries));
+    if (table->entries == NULL) {
+        fstab_free(table);
+        return -1;
+    }
+
+    // source target type options [dump [pass]]
+    char *line = table->text;
+    while (*line != '\0') {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        } else {
+            next = line + strlen(line);
+        }
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        struct fstab_entry *entry = &table->entries[table->count];
+        char *cursor = line;
+        entry->source = fstab_field(&cursor);
+        entry->target = fstab_field(&cursor);
+        entry->type = fstab_field(&cursor);
+        entry->options = fstab_field(&cursor);
+        if (entry->options == NULL) {
+            entry->options = "defaults";
+        }
+        if (entry->type != NULL && entry->target[0] == '/' && strcmp(entry->type, "swap") != 0 &&
+            !mount_has_option(entry->options, "noauto")) {
+            table->count++;
+        }
+        line = next;
+    }
+
+    // Each entry waits for the innermost earlier entry that contains it,
+    // or for an earlier mount on the same point
+    for (size_t i = 0; i < table->count; i++) {
+        struct fstab_entry *entry = &table->entries[i];
+        entry->parent = -1;
+        entry->pidfd = -1;
+        size_t best = 0;
+        for (size_t j = 0; j < table->count; j++) {
+            const char *other = table->entries[j].target;
+            size_t other_len = strlen(other);
+            if (j != i && (fstab_nested(other, entry->target) ||
+                           (j < i && strcmp(other, entry->target) == 0)) &&
+                (entry->parent < 0 || other_len >= best)) {
+                entry->parent = (int)j;
+                best = other_len;
+            }
+        }
+    }
+    return 0;
+}
+
+// Record the end of a mount with its errno, 0 if it worked
+static inline void fstab_done(struct fstab_entry *entry, int error) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    entry->us = (end.tv_sec - entry->start.tv_sec) * 1000000L +
+                (end.tv_nsec - entry->start.tv_nsec) / 1000;
+    entry->error = error;
+    entry->state = FSTAB_DONE;
+    if (entry->pidfd >= 0) {
+        close(entry->pidfd);
+        entry->pidfd = -1;
+    }
+}
+
+// Start the mount of one entry in a child process
+static inline void fstab_start(struct fstab_entry *entry) {
+    clock_gettime(CLOCK_MONOTONIC, &entry->start);
+    entry->state = FSTAB_RUNNING;
+    entry->pid = fork();
+    if (entry->pid == 0) {
+        int error = (mount_fs(entry->source, entry->target, entry->type, entry->options) == 0) ? 0 : errno;
+        _exit((error > 0 && error < 256) ? error : (error != 0) ? EIO : 0);
+    }
+    if (entry->pid < 0) {
+        // No process to spare: mount from here
+        fstab_done(entry, (mount_fs(entry->source, entry->target, entry->type, entry->options) == 0) ? 0 : errno);
+        return;
+    }
+    entry->pidfd = (int)syscall(SYS_pidfd_open, entry->pid, 0);
+}
+
+// Collect the result of a child that has exited or is about to; a child
+// that cannot be waited for counts as a failed mount
+static inline void fstab_finish(struct fstab_entry *entry) {
+    int status = 0;
+    pid_t waited;
+    while ((waited = waitpid(entry->pid, &status, 0)) < 0 && errno == EINTR) {
+    }
+    if (waited < 0) {
+        fstab_done(entry, errno);
+    } else {
+        fstab_done(entry, (WIFEXITED(status)) ? WEXITSTATUS(status) : EIO);
+    }
+}
+
+// Mount every entry of the fstab at path that is not mounted yet, then
+// call report (if not NULL) for each entry in file order. Returns the
+// number of entries that failed, or -1 if the file cannot be read.
+static inline int fstab_mount_all(const char *path, void (*report)(const struct fstab_entry *entry)) {
+    struct fstab table;
+    if (fstab_load(&table, path) != 0) {
+        return -1;
+    }
+    struct pollfd *fds = calloc(table.count + 1, sizeof(*fds));
+    size_t *owners = calloc(table.count + 1, sizeof(*owners));
+    if (fds == NULL || owners == NULL) {
+        free(fds);
+        free(owners);
+        fstab_free(&table);
+        return -1;
+    }
+
+    size_t done = 0;
+    while (done < table.count) {
+        // Start every entry whose parent is mounted
+        for (size_t i = 0; i < table.count; i++) {
+            struct fstab_entry *entry = &table.entries[i];
+            const struct fstab_entry *parent = (entry->parent >= 0) ? &table.entries[entry->parent] : NULL;
+            if (entry->state != FSTAB_PENDING || (parent != NULL && parent->state != FSTAB_DONE)) {
+                continue;
+            }
+            if (parent != NULL && parent->error != 0) {
+                entry->error = parent->error;
+                entry->skipped = 1;
+                entry->state = FSTAB_DONE;
+            } else if (mount_point_busy(entry->target)) {
+                entry->skipped = 1;
+                entry->state = FSTAB_DONE;
+            } else {
+                fstab_start(entry);
+            }
+            // Its own children may be ready now: scan again from the start
+            i = (size_t)-1;
+        }
+
+        // Wait for any running child, or for the first one without a pidfd
+        size_t count = 0;
+        size_t blocking = table.count;
+        for (size_t i = 0; i < table.count; i++) {
+            if (table.entries[i].state != FSTAB_RUNNING) {
+                continue;
+            }
+            if (table.entries[i].pidfd < 0) {
+                blocking = (blocking < table.count) ? blocking : i;
+                continue;
+            }
+            fds[count].fd = table.entries[i].pidfd;
+            fds[count].events = POLLIN;
+            owners[count++] = i;
+        }
+        if (blocking < table.count) {
+            fstab_finish(&table.entries[blocking]);
+        } else if (count > 0 && poll(fds, count, -1) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                if (fds[i].revents != 0) {
+                    fstab_finish(&table.entries[owners[i]]);
+                }
+            }
+        }
+        done = 0;
+        for (size_t i = 0; i < table.count; i++) {
+            done += (table.entries[i].state == FSTAB_DONE);
+        }
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < table.count; i++) {
+        failed += (table.entries[i].error != 0);
+        if (report != NULL) {
+            report(&table.entries[i]);
+        }
+    }
+    free(fds);
+    free(owners);
+    fstab_free(&table);
+    return failed;
+}
+
+#endif // ERDEMOS_FSTAB_H
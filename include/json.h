@@ -0,0 +1,217 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ERDEMOS_JSON_H
+#define ERDEMOS_JSON_H
+
+// Streaming JSON writer for machine-readable builtin output
+//
+// Values are formatted and escaped straight into the output.h buffer as
+// they are produced; there is no document tree and nothing is allocated.
+// The writer only tracks, per nesting level, whether a comma is due.
+
+#include <stdint.h>
+#include "output.h"
+
+#define JSON_MAX_DEPTH 16
+
+struct json_writer {
+    int depth;
+    uint32_t need_comma;    // Bit n set: level n already has a value
+    int after_key;          // A key was written, the value follows
+};
+
+// Separate a new value from the previous one at the same level
+static inline void json_value_prefix(struct json_writer *w) {
+    if (w->after_key) {
+        w->after_key = 0;
+        return;
+    }
+    if (w->need_comma & (1u << w->depth)) {
+        out_raw(",", 1);
+    }
+    w->need_comma |= 1u << w->depth;
+}
+
+static inline void json_open(struct json_writer *w, char c) {
+    json_value_prefix(w);
+    out_raw(&c, 1);
+    if (w->depth < JSON_MAX_DEPTH - 1) {
+        w->depth++;
+    }
+    w->need_comma &= ~(1u << w->depth);
+}
+
+static inline void json_close(struct json_writer *w, char c) {
+    if (w->depth > 0) {
+        w->depth--;
+    }
+    out_raw(&c, 1);
+}
+
+static inline void json_begin_object(struct json_writer *w) { json_open(w, '{'); }
+static inline void json_end_object(struct json_writer *w) { json_close(w, '}'); }
+static inline void json_begin_array(struct json_writer *w) { json_open(w, '['); }
+static inline void json_end_array(struct json_writer *w) { json_close(w, ']'); }
+
+// Length of the valid UTF-8 sequence at p, which starts with a byte of
+// 0x80 or more, or 0 if it is not one (overlong forms, surrogates and code
+// points above U+10FFFF included)
+static inline int json_utf8_length(const unsigned char *p) {
+    unsigned char lo = 0x80, hi = 0xbf;
+    int len;
+    if (p[0] >= 0xc2 && p[0] <= 0xdf) {
+        len = 2;
+    } else if (p[0] >= 0xe0 && p[0] <= 0xef) {
+        len = 3;
+        lo = (p[0] == 0xe0) ? 0xa0 : 0x80;
+        hi = (p[0] == 0xed) ? 0x9f : 0xbf;
+    } else if (p[0] >= 0xf0 && p[0] <= 0xf4) {
+        len = 4;
+        lo = (p[0] == 0xf0) ? 0x90 : 0x80;
+        hi = (p[0] == 0xf4) ? 0x8f : 0xbf;
+    } else {
+        return 0;
+    }
+    if (p[1] < lo || p[1] > hi) {
+        return 0;
+    }
+    for (int i = 2; i < len; i++) {
+        if (p[i] < 0x80 || p[i] > 0xbf) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+// Write a quoted, escaped string. Runs of plain bytes are copied in one go.
+// Names on Linux need not be UTF-8, so a byte that does not start a valid
+// sequence is written as U+FFFD to keep the output valid JSON.
+static inline void json_quote(const char *str) {
+    static const char hex[] = "0123456789abcdef";
+    out_raw("\"", 1);
+    const char *run = str;
+    for (const char *p = str; *p != '\0'; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x80) {
+            int len = json_utf8_length((const unsigned char *)p);
+            if (len > 0) {
+                p += len - 1;
+                continue;
+            }
+            out_raw(run, p - run);
+            out_raw("\\ufffd", 6);
+            run = p + 1;
+            continue;
+        }
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out_raw(run, p - run);
+        char esc[6] = { '\\', (char)c, 0, 0, 0, 0 };
+        size_t len = 2;
+        if (c == '\n') {
+            esc[1] = 'n';
+        } else if (c == '\t') {
+            esc[1] = 't';
+        } else if (c == '\r') {
+            esc[1] = 'r';
+        } else if (c < 0x20) {
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 15];
+            len = 6;
+        }
+        out_raw(esc, len);
+        run = p + 1;
+    }
+    out_raw(run, strlen(run));
+    out_raw("\"", 1);
+}
+
+static inline void json_key(struct json_writer *w, const char *key) {
+    json_value_prefix(w);
+    json_quote(key);
+    out_raw(":", 1);
+    w->after_key = 1;
+}
+
+static inline void json_string(struct json_writer *w, const char *value) {
+    json_value_prefix(w);
+    json_quote(value);
+}
+
+// Format an unsigned number in place in the output buffer
+static inline void json_put_uint(uint64_t value) {
+    char *buf = out_reserve(20);
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    for (int i = 0; i < n; i++) {
+        buf[i] = digits[n - 1 - i];
+    }
+    out_commit(n);
+}
+
+static inline void json_uint(struct json_writer *w, uint64_t value) {
+    json_value_prefix(w);
+    json_put_uint(value);
+}
+
+static inline void json_int(struct json_writer *w, int64_t value) {
+    json_value_prefix(w);
+    if (value < 0) {
+        out_raw("-", 1);
+        json_put_uint(-(uint64_t)value);
+    } else {
+        json_put_uint(value);
+    }
+}
+
+static inline void json_bool(struct json_writer *w, int value) {
+    json_value_prefix(w);
+    if (value) {
+        out_raw("true", 4);
+    } else {
+        out_raw("false", 5);
+    }
+}
+
+static inline void json_null(struct json_writer *w) {
+    json_value_prefix(w);
+    out_raw("null", 4);
+}
+
+// Key/value shorthands for flat records
+static inline void json_field_string(struct json_writer *w, const char *key, const char *value) {
+    json_key(w, key);
+    json_string(w, value);
+}
+
+static inline void json_field_uint(struct json_writer *w, const char *key, uint64_t value) {
+    json_key(w, key);
+    json_uint(w, value);
+}
+
+static inline void json_field_int(struct json_writer *w, const char *key, int64_t value) {
+    json_key(w, key);
+    json_int(w, value);
+}
+
+#endif // ERDEMOS_JSON_H
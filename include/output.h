@@ -0,0 +1,173 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ERDEMOS_OUTPUT_H
+#define ERDEMOS_OUTPUT_H
+
+// Buffered, tty-aware styled output on standard output
+//
+// Text is written with the colors.h escape sequences inline, as before.
+// Whether stdout is a terminal (and NO_COLOR is unset) is checked once; if
+// not, every escape sequence is dropped. On a terminal, an SGR sequence is
+// only emitted when it differs from the style already in effect, so e.g.
+// ls no longer repeats ERDEMOS_PRIMARY_COLOR for every name.
+//
+// Output is buffered: call out_flush() before reading input, forking or
+// exiting without exit(). Flushed output goes to out_sink, which writes
+// to fd 1 unless the async writer (async_writer.h) is running.
+// out_forget_style() must follow anything else that may have written to
+// the terminal, like a child process.
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define OUT_BUFFER_SIZE 4096
+#define OUT_STYLE_MAX 32
+
+struct out_stream {
+    int color;                    // -1 until checked, then 0 or 1
+    int escape;                   // Bytes of the escape being parsed, 0 if none
+    char seq[OUT_STYLE_MAX];      // Escape sequence being parsed
+    char style[OUT_STYLE_MAX];    // SGR sequence currently in effect
+    size_t style_len;
+    size_t len;
+    char buf[OUT_BUFFER_SIZE];
+};
+
+static struct out_stream out_stdout = { .color = -1 };
+
+// Write a whole buffer to fd 1, retrying on short writes and EINTR
+static inline void out_write_all(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(1, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// Where flushed output goes; async_writer.h can replace it
+static void (*out_sink)(const char *data, size_t len) = out_write_all;
+
+static inline void out_flush(void) {
+    if (out_stdout.len > 0) {
+        out_sink(out_stdout.buf, out_stdout.len);
+        out_stdout.len = 0;
+    }
+}
+
+// Decide once whether escapes are wanted on stdout
+static inline int out_color_enabled(void) {
+    if (out_stdout.color < 0) {
+        const char *no_color = getenv("NO_COLOR");
+        out_stdout.color = isatty(1) && (no_color == NULL || no_color[0] == '\0');
+    }
+    return out_stdout.color;
+}
+
+// Forget the style in effect so the next escape is always emitted
+static inline void out_forget_style(void) {
+    out_stdout.style_len = 0;
+}
+
+// Append bytes unchanged
+static inline void out_raw(const char *data, size_t len) {
+    if (len >= OUT_BUFFER_SIZE) {
+        out_flush();
+        out_sink(data, len);
+        return;
+    }
+    if (out_stdout.len + len > OUT_BUFFER_SIZE) {
+        out_flush();
+    }
+    memcpy(out_stdout.buf + out_stdout.len, data, len);
+    out_stdout.len += len;
+}
+
+// Reserve n bytes (n <= OUT_BUFFER_SIZE) in the buffer for formatting in
+// place; out_commit() then accounts for the bytes actually used
+static inline char *out_reserve(size_t n) {
+    if (out_stdout.len + n > OUT_BUFFER_SIZE) {
+        out_flush();
+    }
+    return out_stdout.buf + out_stdout.len;
+}
+
+static inline void out_commit(size_t n) {
+    out_stdout.len += n;
+}
+
+// A complete escape sequence was parsed: drop it, or emit it if it changes
+// the style (SGR) or is a terminal control sequence like clear screen
+static inline void out_escape_done(void) {
+    struct out_stream *s = &out_stdout;
+    size_t len = s->escape;
+    s->escape = 0;
+    if (!out_color_enabled()) {
+        return;
+    }
+    if (s->seq[len - 1] == 'm') {
+        if (len == s->style_len && memcmp(s->seq, s->style, len) == 0) {
+            return;
+        }
+        memcpy(s->style, s->seq, len);
+        s->style_len = len;
+    }
+    out_raw(s->seq, len);
+}
+
+// Append styled text
+static inline void out_write(const char *data, size_t len) {
+    struct out_stream *s = &out_stdout;
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (s->escape == 0) {
+            if (c == '\033') {
+                out_raw(data + start, i - start);
+                s->seq[s->escape++] = c;
+                start = i + 1;
+            }
+            continue;
+        }
+        if (s->escape < OUT_STYLE_MAX) {
+            s->seq[s->escape++] = c;
+        }
+        // ESC [ parameters... final byte
+        if (s->escape == 2 && c != '[') {
+            s->escape = 0;
+        } else if (s->escape > 2 && c >= 0x40 && c <= 0x7e) {
+            out_escape_done();
+        } else if (s->escape == OUT_STYLE_MAX) {
+            s->escape = 0;
+        }
+        start = i + 1;
+    }
+    if (s->escape == 0) {
+        out_raw(data + start, len - start);
+    }
+}
+
+static inline void out_str(const char *str) {
+    out_write(str, strlen(str));
+}
+
+#endif // ERDEMOS_OUTPUT_H
@@ -0,0 +1,217 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ERDEMOS_POOL_H
+#define ERDEMOS_POOL_H
+
+// Thread pool for builtins that walk directory trees
+//
+// Tasks are intrusive: the caller embeds a struct pool_task in its own
+// work item, so submitting never allocates. Workers are started on first
+// use and then stay idle between commands. Completion is tracked by the
+// caller; pool_lock()/pool_done_wait()/pool_done_signal() give it a shared
+// mutex and condition variable to do so.
+//
+// Scheduling is work-stealing. Every worker has its own deque: tasks a
+// worker submits go on its own deque and it takes the newest first, so a
+// tree walk stays depth first and keeps few directories open. Tasks from
+// other threads go on a shared queue. An idle worker takes from the shared
+// queue, then steals the oldest task of another worker, which is the one
+// nearest the root and so likely the most work.
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define POOL_MIN_THREADS 4
+#define POOL_MAX_THREADS 16
+#define POOL_SHARED POOL_MAX_THREADS    // Deque index of the shared queue
+
+struct pool_task {
+    void (*run)(struct pool_task *task);
+    struct pool_task *next;         // Towards the oldest task
+    struct pool_task *prev;         // Towards the newest task
+};
+
+struct pool_deque {
+    pthread_mutex_t lock;
+    struct pool_task *newest;
+    struct pool_task *oldest;
+};
+
+struct pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // Signalled when a task is queued
+    pthread_cond_t done;        // Broadcast by pool_done_signal()
+    int queued;                 // Tasks in all deques, atomic
+    int idle;                   // Workers waiting for work, under lock
+    int threads;
+    struct pool_deque deques[POOL_MAX_THREADS + 1];
+};
+
+static struct pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread int pool_self = POOL_SHARED;    // Deque of the calling thread
+
+static inline void pool_push(struct pool_deque *deque, struct pool_task *task) {
+    pthread_mutex_lock(&deque->lock);
+    task->prev = NULL;
+    task->next = deque->newest;
+    if (deque->newest != NULL) {
+        deque->newest->prev = task;
+    } else {
+        deque->oldest = task;
+    }
+    deque->newest = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// Take the newest (own deque) or the oldest (stealing) task, or NULL
+static inline struct pool_task *pool_pop(struct pool_deque *deque, int newest) {
+    pthread_mutex_lock(&deque->lock);
+    struct pool_task *task = newest ? deque->newest : deque->oldest;
+    if (task != NULL) {
+        if (newest) {
+            deque->newest = task->next;
+            if (task->next != NULL) {
+                task->next->prev = NULL;
+            } else {
+                deque->oldest = NULL;
+            }
+        } else {
+            deque->oldest = task->prev;
+            if (task->prev != NULL) {
+                task->prev->next = NULL;
+            } else {
+                deque->newest = NULL;
+            }
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return task;
+}
+
+static inline struct pool_task *pool_take(int self) {
+    struct pool_task *task = pool_pop(&pool.deques[self], 1);
+    if (task == NULL) {
+        task = pool_pop(&pool.deques[POOL_SHARED], 0);
+    }
+    for (int i = 1; task == NULL && i < pool.threads; i++) {
+        task = pool_pop(&pool.deques[(self + i) % pool.threads], 0);
+    }
+    if (task != NULL) {
+        __atomic_sub_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+    }
+    return task;
+}
+
+static void *pool_worker(void *arg) {
+    pool_self = (int)(long)arg;
+    while (1) {
+        struct pool_task *task = pool_take(pool_self);
+        if (task != NULL) {
+            task->run(task);
+            continue;
+        }
+        // Nothing anywhere: sleep until pool_submit() queues something
+        pthread_mutex_lock(&pool.lock);
+        pool.idle++;
+        while (__atomic_load_n(&pool.queued, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        pool.idle--;
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+// Start the workers if needed. Directory walks wait on storage more than
+// on the CPU, so the pool has twice as many threads as CPUs.
+static inline int pool_start(void) {
+    if (pool.threads > 0) {
+        return pool.threads;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int want = (cpus > 0) ? (int)cpus * 2 : POOL_MIN_THREADS;
+    if (want < POOL_MIN_THREADS) {
+        want = POOL_MIN_THREADS;
+    }
+    if (want > POOL_MAX_THREADS) {
+        want = POOL_MAX_THREADS;
+    }
+    for (int i = 0; i <= POOL_MAX_THREADS; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < want; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, pool_worker, (void *)(long)i) != 0) {
+            break;
+        }
+        pool.threads++;
+    }
+    pthread_attr_destroy(&attr);
+    return pool.threads;
+}
+
+static inline void pool_submit(struct pool_task *task) {
+    pool_push(&pool.deques[pool_self], task);
+    __atomic_add_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+    // A busy submitter keeps its own work; only wake a worker that sleeps
+    pthread_mutex_lock(&pool.lock);
+    if (pool.idle > 0) {
+        pthread_cond_signal(&pool.work);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static inline void pool_lock(void) {
+    pthread_mutex_lock(&pool.lock);
+}
+
+static inline void pool_unlock(void) {
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// Wait for a pool_done_signal(); call with the pool lock held
+static inline void pool_done_wait(void) {
+    pthread_cond_wait(&pool.done, &pool.lock);
+}
+
+// Wake pool_done_wait() callers; call with the pool lock held
+static inline void pool_done_signal(void) {
+    pthread_cond_broadcast(&pool.done);
+}
+
+// A forked child has none of the workers: start from scratch if needed
+static inline void pool_after_fork(void) {
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    for (int i = 0; i <= POOL_MAX_THREADS; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].newest = NULL;
+        pool.deques[i].oldest = NULL;
+    }
+    pool.queued = 0;
+    pool.idle = 0;
+    pool.threads = 0;
+}
+
+#endif // ERDEMOS_POOL_H
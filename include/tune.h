@@ -0,0 +1,252 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ERDEMOS_TUNE_H
+#define ERDEMOS_TUNE_H
+
+// Kernel tunables and tuning profiles, for sysctl in ersh and for init
+//
+// A key is a sysctl name like vm.swappiness, which is the file
+// /proc/sys/vm/swappiness, or with an mm. prefix a file below
+// /sys/kernel/mm, where transparent huge pages and KSM are controlled
+// (mm.transparent_hugepage.enabled). Keys may use / instead of dots for
+// names that contain dots themselves.
+//
+// Both roots are opened once, and so is every top-level directory (vm,
+// kernel, ...) on first use; a read or write is then one openat()
+// relative to a kept directory fd, a pread() or pwrite() and a close().
+// A profile is a named batch of settings that is applied in order; a key
+// the running kernel does not have is reported and skipped.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TUNE_ROOT_SYSCTL 0
+#define TUNE_ROOT_MM     1
+#define TUNE_CACHE_SIZE  8
+#define TUNE_PATH_MAX    256
+
+struct tune_setting {
+    const char *key;
+    const char *value;
+};
+
+struct tune_profile {
+    const char *name;
+    const char *description;
+    const struct tune_setting *settings;    // Ends with a NULL key
+};
+
+static const struct tune_setting tune_throughput[] = {
+    { "vm.swappiness", "10" },
+    { "vm.dirty_ratio", "40" },
+    { "vm.dirty_background_ratio", "10" },
+    { "kernel.sched_autogroup_enabled", "0" },
+    { "mm.transparent_hugepage.enabled", "always" },
+    { "mm.transparent_hugepage.defrag", "madvise" },
+    { "mm.ksm.run", "0" },
+    { NULL, NULL },
+};
+
+static const struct tune_setting tune_latency[] = {
+    { "vm.swappiness", "10" },
+    { "vm.dirty_ratio", "10" },
+    { "vm.dirty_background_ratio", "3" },
+    { "kernel.sched_autogroup_enabled", "0" },
+    { "kernel.timer_migration", "0" },
+    { "mm.transparent_hugepage.enabled", "madvise" },
+    { "mm.transparent_hugepage.defrag", "never" },
+    { "mm.ksm.run", "0" },
+    { NULL, NULL },
+};
+
+static const struct tune_setting tune_lowmem[] = {
+    { "vm.swappiness", "100" },
+    { "vm.dirty_ratio", "5" },
+    { "vm.dirty_background_ratio", "2" },
+    { "vm.vfs_cache_pressure", "200" },
+    { "kernel.sched_autogroup_enabled", "1" },
+    { "mm.transparent_hugepage.enabled", "never" },
+    { "mm.ksm.sleep_millisecs", "200" },
+    { "mm.ksm.run", "1" },
+    { NULL, NULL },
+};
+
+static const struct tune_profile tune_profiles[] = {
+    { "throughput", "Large write-back batches, huge pages always", tune_throughput },
+    { "latency", "Small write-back batches, no huge page compaction stalls", tune_latency },
+    { "lowmem", "Reclaim early, no huge pages, merge identical pages (KSM)", tune_lowmem },
+};
+
+#define TUNE_PROFILE_COUNT (int)(sizeof(tune_profiles) / sizeof(tune_profiles[0]))
+
+struct tune_dirs {
+    int roots[2];                   // /proc/sys and /sys/kernel/mm, -1 if missing
+    int cached;
+    struct {
+        int root;
+        int fd;
+        char name[32];
+    } cache[TUNE_CACHE_SIZE];       // Top-level directories opened so far
+};
+
+static inline const struct tune_profile *tune_profile_find(const char *name) {
+    for (int i = 0; i < TUNE_PROFILE_COUNT; i++) {
+        if (strcmp(tune_profiles[i].name, name) == 0) {
+            return &tune_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+static inline void tune_open(struct tune_dirs *dirs) {
+    dirs->roots[TUNE_ROOT_SYSCTL] = open("/proc/sys", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    dirs->roots[TUNE_ROOT_MM] = open("/sys/kernel/mm", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    dirs->cached = 0;
+}
+
+static inline void tune_close(struct tune_dirs *dirs) {
+    for (int i = 0; i < dirs->cached; i++) {
+        close(dirs->cache[i].fd);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (dirs->roots[i] >= 0) {
+            close(dirs->roots[i]);
+        }
+    }
+    dirs->cached = 0;
+}
+
+// Turn key into a directory fd and a path relative to it; returns the fd,
+// or -1 with errno set (ENOENT for a key that is not a tunable's name)
+static inline int tune_resolve(struct tune_dirs *dirs, const char *key, char *path) {
+    int root = TUNE_ROOT_SYSCTL;
+    if (strncmp(key, "mm.", 3) == 0 || strncmp(key, "mm/", 3) == 0) {
+        root = TUNE_ROOT_MM;
+        key += 3;
+    }
+    size_t len = strlen(key);
+    if (len == 0 || len >= TUNE_PATH_MAX || key[0] == '/' || strstr(key, "..") != NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    int slashes = strchr(key, '/') != NULL;
+    for (size_t i = 0; i <= len; i++) {
+        path[i] = (!slashes && key[i] == '.') ? '/' : key[i];
+    }
+    if (dirs->roots[root] < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    // Keep the top-level directory open for the next key
+    char *slash = strchr(path, '/');
+    size_t top = (slash != NULL) ? (size_t)(slash - path) : 0;
+    if (top == 0 || top >= sizeof(dirs->cache[0].name)) {
+        return dirs->roots[root];
+    }
+    for (int i = 0; i < dirs->cached; i++) {
+        if (dirs->cache[i].root == root && strncmp(dirs->cache[i].name, path, top) == 0 &&
+            dirs->cache[i].name[top] == '\0') {
+            memmove(path, slash + 1, strlen(slash + 1) + 1);
+            return dirs->cache[i].fd;
+        }
+    }
+    if (dirs->cached == TUNE_CACHE_SIZE) {
+        return dirs->roots[root];
+    }
+    *slash = '\0';
+    int fd = openat(dirs->roots[root], path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        *slash = '/';
+        return dirs->roots[root];
+    }
+    dirs->cache[dirs->cached].root = root;
+    dirs->cache[dirs->cached].fd = fd;
+    memcpy(dirs->cache[dirs->cached].name, path, top + 1);
+    dirs->cached++;
+    memmove(path, slash + 1, strlen(slash + 1) + 1);
+    return fd;
+}
+
+// Read the value of key into buf without the final newline; returns its
+// length, or -1 with errno set
+static inline ssize_t tune_read(struct tune_dirs *dirs, const char *key, char *buf, size_t size) {
+    char path[TUNE_PATH_MAX];
+    int dir = tune_resolve(dirs, key, path);
+    if (dir < 0) {
+        return -1;
+    }
+    int fd = openat(dir, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t len = pread(fd, buf, size - 1, 0);
+    int saved = errno;
+    close(fd);
+    if (len < 0) {
+        errno = saved;
+        return -1;
+    }
+    while (len > 0 && buf[len - 1] == '\n') {
+        len--;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// Write value to key; returns 0, or -1 with errno set
+static inline int tune_write(struct tune_dirs *dirs, const char *key, const char *value) {
+    char path[TUNE_PATH_MAX];
+    int dir = tune_resolve(dirs, key, path);
+    if (dir < 0) {
+        return -1;
+    }
+    int fd = openat(dir, path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t len = strlen(value);
+    ssize_t written = pwrite(fd, value, len, 0);
+    int saved = errno;
+    close(fd);
+    if (written != (ssize_t)len) {
+        errno = (written < 0) ? saved : EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Apply every setting of profile in order, calling report with the error
+// (0 on success) and the microseconds each write took; returns the number
+// of failed settings
+static inline int tune_apply(struct tune_dirs *dirs, const struct tune_profile *profile,
+                             void (*report)(const struct tune_setting *setting, int error, long us)) {
+    int failed = 0;
+    for (const struct tune_setting *setting = profile->settings; setting->key != NULL; setting++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int error = (tune_write(dirs, setting->key, setting->value) == 0) ? 0 : errno;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        failed += (error != 0);
+        report(setting, error, (end.tv_sec - start.tv_sec) * 1000000L +
+                               (end.tv_nsec - start.tv_nsec) / 1000);
+    }
+    return failed;
+}
+
+#endif // ERDEMOS_TUNE_H
@@ -0,0 +1,175 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ERDEMOS_URING_H
+#define ERDEMOS_URING_H
+
+// Minimal io_uring for batching file system calls
+//
+// Builtins that make many independent calls (mkdir of many paths, and so
+// on) queue them as submission entries and hand the whole batch to the
+// kernel with one io_uring_enter(). There is no liburing in the initramfs,
+// so the rings are set up with the raw system calls. Callers must have a
+// fallback: io_uring may be missing from the kernel or disabled by sysctl.
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct uring {
+    int fd;
+    unsigned entries;
+    unsigned queued;                // Entries filled but not yet submitted
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *ring;
+    size_t ring_size;
+    size_t sqes_size;
+};
+
+// Set up a ring with room for entries submissions; returns 0 or -1
+static inline int uring_init(struct uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(SYS_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+    // Kernels from 5.4 on map both rings at once
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring->fd);
+        return -1;
+    }
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+    ring->ring = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->ring == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(ring->ring, ring->ring_size);
+        close(ring->fd);
+        return -1;
+    }
+    char *base = ring->ring;
+    ring->entries = params.sq_entries;
+    ring->sq_head = (unsigned *)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(base + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(base + params.sq_off.array);
+    ring->cq_head = (unsigned *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+    return 0;
+}
+
+static inline void uring_free(struct uring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring, ring->ring_size);
+    close(ring->fd);
+}
+
+// Next free submission entry, zeroed, or NULL when the batch is full
+static inline struct io_uring_sqe *uring_sqe(struct uring *ring) {
+    if (ring->queued == ring->entries) {
+        return NULL;
+    }
+    unsigned tail = *ring->sq_tail + ring->queued;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+static inline unsigned uring_ready(struct uring *ring) {
+    return __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *ring->cq_head;
+}
+
+// Submit the queued entries and wait until the submitted ones have all
+// completed; returns how many were submitted. The kernel takes entries in
+// queue order, so those it did not take are the last ones queued: they
+// are dropped from the ring and the caller has to do them another way.
+// Results are read with uring_cqe()/uring_cqe_seen(); the completions of
+// earlier batches must have been read already.
+static inline unsigned uring_submit_wait(struct uring *ring) {
+    unsigned count = ring->queued;
+    if (count == 0) {
+        return 0;
+    }
+    unsigned tail = *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, tail + count, __ATOMIC_RELEASE);
+    ring->queued = 0;
+    unsigned submitted = 0;
+    while (submitted < count) {
+        int n = syscall(SYS_io_uring_enter, ring->fd, count - submitted, 0, 0, NULL, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        submitted += (unsigned)n;
+    }
+    if (submitted < count) {
+        // Take the rest back, so the next io_uring_enter() does not see it
+        __atomic_store_n(ring->sq_tail, tail + submitted, __ATOMIC_RELEASE);
+    }
+    // Entries in flight still use the caller's buffers and fds: the wait
+    // has to go on until they complete, whatever io_uring_enter() says
+    while (uring_ready(ring) < submitted) {
+        int n = syscall(SYS_io_uring_enter, ring->fd, 0, submitted - uring_ready(ring),
+                        IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n < 0 && errno != EINTR) {
+            sched_yield();
+        }
+    }
+    return submitted;
+}
+
+// Oldest unread completion, or NULL
+static inline struct io_uring_cqe *uring_cqe(struct uring *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+static inline void uring_cqe_seen(struct uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif // ERDEMOS_URING_H
@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+#
+# Copyright 2025 Erdem Ersoy (eersoy93)
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+set -euo pipefail
+
+# Break the binaries in output/ down by section and symbol, compare them with
+# the previous report and enforce the byte budgets from size-budget.conf
+#
+# Usage: ./size-report.sh [symbols]
+#   symbols  Number of largest symbols and symbol deltas to list (default 15)
+
+ROOT_DIR=$(cd "$(dirname "$0")" && pwd)
+cd "$ROOT_DIR"
+
+# Configuration
+OUTPUT_DIR=output
+REPORT_DIR="$OUTPUT_DIR/size-report"
+BUDGET_FILE=size-budget.conf
+BINARIES="init ersh poweroff loadkeys"
+TOP=${1:-15}
+
+# Helper functions
+info() { echo "[$(date +%H:%M:%S)] $*"; }
+die() { echo "Error: $*" >&2; exit 1; }
+require_cmd() { command -v "$1" >/dev/null 2>&1 || die "Required command not found: $1"; }
+
+# Dependency checks
+for cmd in size nm awk; do
+    require_cmd "$cmd"
+done
+
+mkdir -p "$REPORT_DIR"
+over_budget=0
+
+for name in $BINARIES; do
+    bin="$OUTPUT_DIR/$name"
+    [ -f "$bin" ] || die "Binary not found: $bin (run ./build.sh first)"
+
+    # Keep the last report around as the baseline for this one
+    for kind in sections symbols; do
+        if [ -f "$REPORT_DIR/$name.$kind" ]; then
+            mv "$REPORT_DIR/$name.$kind" "$REPORT_DIR/$name.$kind.prev"
+        fi
+    done
+
+    size -A "$bin" | awk 'NR > 2 && $1 != "Total" && NF >= 2 { print $1, $2 }' > "$REPORT_DIR/$name.sections"
+    nm --size-sort -S --radix=d "$bin" | awk 'NF == 4 { print $4, $2 + 0, $3 }' > "$REPORT_DIR/$name.symbols"
+
+    bytes=$(stat -c %s "$bin")
+    budget=$(awk -F= -v n="$name" '$1 == n { print $2 }' "$BUDGET_FILE" 2>/dev/null || true)
+
+    echo
+    if [ -n "$budget" ]; then
+        info "$name: $bytes bytes (budget $budget, $((budget - bytes)) left)"
+    else
+        info "$name: $bytes bytes (no budget)"
+    fi
+
+    # Sections with the delta against the previous report
+    prev_sections="$REPORT_DIR/$name.sections.prev"
+    [ -f "$prev_sections" ] || prev_sections="$REPORT_DIR/$name.sections"
+    echo "  Section                       Bytes      Delta"
+    awk '
+        FNR == NR { prev[$1] = $2; next }
+        $2 > 0 {
+            delta = ($1 in prev) ? $2 - prev[$1] : $2
+            printf "  %-24s %10d %+10d\n", $1, $2, delta
+        }
+    ' "$prev_sections" "$REPORT_DIR/$name.sections"
+
+    # Largest symbols
+    echo "  Largest symbols               Bytes  Type"
+    sort -k2,2nr "$REPORT_DIR/$name.symbols" |
+        awk -v top="$TOP" 'NR <= top { printf "  %-24.24s %10d  %s\n", $1, $2, $3 }'
+
+    # Symbols that grew, appeared or disappeared since the previous report
+    if [ -f "$REPORT_DIR/$name.symbols.prev" ]; then
+        echo "  Symbol changes                Delta"
+        awk '
+            FNR == NR { prev[$1] += $2; next }
+            { cur[$1] += $2 }
+            END {
+                for (s in cur) if (cur[s] != prev[s]) print s, cur[s] - prev[s]
+                for (s in prev) if (!(s in cur)) print s, -prev[s]
+            }
+        ' "$REPORT_DIR/$name.symbols.prev" "$REPORT_DIR/$name.symbols" |
+            sort -k2,2nr | awk -v top="$TOP" 'NR <= top { printf "  %-24.24s %+10d\n", $1, $2 }'
+    fi
+
+    if [ -n "$budget" ] && [ "$bytes" -gt "$budget" ]; then
+        echo "Error: $name is $((bytes - budget)) bytes over its budget of $budget" >&2
+        over_budget=1
+    fi
+done
+
+exit "$over_budget"
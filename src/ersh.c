@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <string.h>
 #include <sys/wait.h>
@@ -19,16 +20,90 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/statfs.h>
+#include <linux/fs.h>
+#include <sys/sysmacros.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <linux/sched.h>
+#include <linux/ioprio.h>
 #include "../include/colors.h"
+#include "../include/output.h"
+#include "../include/json.h"
+#include "../include/async_writer.h"
+#include "../include/pool.h"
+#include "../include/uring.h"
+#include "../include/fstab.h"
+#include "../include/tune.h"
 #include "../include/version.h"
 
-#define MAX_CMD_LEN 1024
-#define MAX_ARGS 64
+#define MAX_CMD_LEN 4096
+#define MAX_ARGS 512
+#define URING_BATCH 256         // Ring entries, and paths per submission
+#define URING_MIN_BATCH 8       // Fewer calls are not worth a ring
 
-// Simple write wrapper
+// Output modes of data-producing builtins: colored text, a JSON document
+// (--json) or NUL-terminated names (-0)
+#define OUTPUT_TEXT 0
+#define OUTPUT_JSON 1
+#define OUTPUT_NUL  2
+
+// Styled write wrapper, buffered and tty-aware (see output.h)
 static void write_str(const char *str) {
-    ssize_t ret = write(1, str, strlen(str));
-    (void)ret;  // Ignore return value intentionally
+    out_str(str);
+}
+
+// Lock the shell's own text into memory. init requests this through
+// ERSH_MLOCK when the preload manifest marks /bin/ersh with "mlock".
+static void lock_text(void) {
+    extern char __executable_start[], etext[];
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned long start = (unsigned long)__executable_start & ~(page - 1);
+    unsigned long end = (unsigned long)etext;
+    if (mlock((void *)start, end - start) != 0) {
+        write_str(ERDEMOS_WARNING_COLOR "ersh: cannot lock text into memory" COLOR_RESET "\n");
+    }
+}
+
+// Fork with all pending output written first, so it cannot be duplicated
+// or reordered with the child's. The child writes synchronously.
+static pid_t shell_fork(void) {
+    out_flush();
+    async_writer_drain();
+    pid_t pid = fork();
+    if (pid == 0) {
+        async_writer_after_fork();
+        pool_after_fork();
+    }
+    return pid;
+}
+
+// Replace a forked child with an external command
+static __attribute__((noreturn)) void exec_command(char **args) {
+    execvp(args[0], args);
+    write_str(ERDEMOS_ERROR_COLOR "ersh: command not found: " ERDEMOS_COMMAND_COLOR);
+    write_str(args[0]);
+    write_str("\n");
+    out_flush();
+    _exit(127);
+}
+
+// Write everything out before the shell exits
+static void flush_output_at_exit(void) {
+    async_writer_stop();
+    out_flush();
 }
 
 // Parse command line into arguments
@@ -43,47 +118,167 @@ static int parse_args(char *line, char **args) {
     return i;
 }
 
-// Write size right-aligned in a field of width 10
-static void write_size_aligned(off_t size) {
-    char buf[32];
-    int i = 0;
-    
-    // Convert number to string (reverse)
-    off_t n = size;
-    if (n == 0) {
-        buf[i++] = '0';
-    } else {
-        while (n > 0) {
-            buf[i++] = '0' + (n % 10);
-            n /= 10;
+// Write an unsigned decimal number
+static void write_uint(unsigned long long n) {
+    char buf[24];
+    int i = sizeof(buf);
+    buf[--i] = '\0';
+    do {
+        buf[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    write_str(buf + i);
+}
+
+// Growable byte buffer, for output built away from the main thread
+struct strbuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static void sb_append(struct strbuf *sb, const char *data, size_t len) {
+    if (sb->len + len > sb->cap) {
+        size_t cap = (sb->cap > 0) ? sb->cap : 256;
+        while (cap < sb->len + len) {
+            cap *= 2;
         }
+        char *grown = realloc(sb->data, cap);
+        if (grown == NULL) {
+            return;     // Out of memory: the text is lost, not the shell
+        }
+        sb->data = grown;
+        sb->cap = cap;
     }
-    
-    // Pad with spaces (right-align to 10 characters)
-    int padding = 10 - i;
-    for (int j = 0; j < padding; j++) {
-        write_str(" ");
+    memcpy(sb->data + sb->len, data, len);
+    sb->len += len;
+}
+
+static void sb_str(struct strbuf *sb, const char *str) {
+    sb_append(sb, str, strlen(str));
+}
+
+static void sb_free(struct strbuf *sb) {
+    free(sb->data);
+    sb->data = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+// Append n right-aligned in a field of the given width (at most 20)
+static void sb_uint_aligned(struct strbuf *sb, unsigned long long n, int width) {
+    char buf[40];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    while (i > (int)sizeof(buf) - width) {
+        buf[--i] = ' ';
     }
-    
-    // Write in correct order
-    while (i > 0) {
-        char c[2] = {buf[--i], '\0'};
-        write_str(c);
+    sb_append(sb, buf + i, sizeof(buf) - i);
+}
+
+// Append str left-aligned in a field of the given width
+static void sb_str_padded(struct strbuf *sb, const char *str, size_t width) {
+    size_t len = strlen(str);
+    sb_append(sb, str, len);
+    while (len++ < width) {
+        sb_append(sb, " ", 1);
+    }
+}
+
+// Append a size like "512", "1.5K" or "23M", rounded up as ls -h does,
+// right-aligned in a field of the given width
+static void sb_size_human(struct strbuf *sb, off_t size, int width) {
+    static const char units[] = "KMGTPE";
+    unsigned long long n = (size > 0) ? (unsigned long long)size : 0;
+    if (n < 1024) {
+        sb_uint_aligned(sb, n, width);
+        return;
+    }
+    int unit = 0;
+    unsigned long long div = 1024;
+    while (n / div >= 1024 && unit < 5) {
+        div <<= 10;
+        unit++;
+    }
+    unsigned long long whole = n / div;
+    unsigned long long rem = n % div;
+    char buf[24];
+    int len = 0;
+    if (whole < 10) {
+        unsigned long long tenths = (rem * 10 + div - 1) / div;
+        if (tenths == 10) {
+            whole++;
+            tenths = 0;
+        }
+        buf[len++] = '0' + whole;
+        if (whole < 10) {
+            buf[len++] = '.';
+            buf[len++] = '0' + tenths;
+        } else {
+            buf[len++] = '0';
+        }
+    } else {
+        whole += (rem > 0);
+        char digits[20];
+        int i = 0;
+        do {
+            digits[i++] = '0' + whole % 10;
+            whole /= 10;
+        } while (whole > 0);
+        while (i > 0) {
+            buf[len++] = digits[--i];
+        }
+    }
+    buf[len++] = units[unit];
+    for (int pad = len; pad < width; pad++) {
+        sb_append(sb, " ", 1);
     }
+    sb_append(sb, buf, len);
+}
+
+// Append file permissions in ls -l format
+static void sb_permissions(struct strbuf *sb, mode_t mode) {
+    char buf[10] = {
+        S_ISDIR(mode) ? 'd' : (S_ISLNK(mode) ? 'l' : '-'),
+        (mode & S_IRUSR) ? 'r' : '-',
+        (mode & S_IWUSR) ? 'w' : '-',
+        (mode & S_IXUSR) ? 'x' : '-',
+        (mode & S_IRGRP) ? 'r' : '-',
+        (mode & S_IWGRP) ? 'w' : '-',
+        (mode & S_IXGRP) ? 'x' : '-',
+        (mode & S_IROTH) ? 'r' : '-',
+        (mode & S_IWOTH) ? 'w' : '-',
+        (mode & S_IXOTH) ? 'x' : '-',
+    };
+    sb_append(sb, buf, sizeof(buf));
+}
+
+// File type names used in machine-readable output
+static const char *mode_type_name(mode_t mode) {
+    if (S_ISREG(mode)) return "file";
+    if (S_ISDIR(mode)) return "directory";
+    if (S_ISLNK(mode)) return "symlink";
+    if (S_ISCHR(mode)) return "char";
+    if (S_ISBLK(mode)) return "block";
+    if (S_ISFIFO(mode)) return "fifo";
+    if (S_ISSOCK(mode)) return "socket";
+    return "unknown";
 }
 
-// Write file permissions in ls -l format
-static void write_permissions(mode_t mode) {
-    write_str((S_ISDIR(mode)) ? "d" : "-");
-    write_str((mode & S_IRUSR) ? "r" : "-");
-    write_str((mode & S_IWUSR) ? "w" : "-");
-    write_str((mode & S_IXUSR) ? "x" : "-");
-    write_str((mode & S_IRGRP) ? "r" : "-");
-    write_str((mode & S_IWGRP) ? "w" : "-");
-    write_str((mode & S_IXGRP) ? "x" : "-");
-    write_str((mode & S_IROTH) ? "r" : "-");
-    write_str((mode & S_IWOTH) ? "w" : "-");
-    write_str((mode & S_IXOTH) ? "x" : "-");
+static const char *dirent_type_name(unsigned char type) {
+    switch (type) {
+    case DT_REG: return "file";
+    case DT_DIR: return "directory";
+    case DT_LNK: return "symlink";
+    case DT_CHR: return "char";
+    case DT_BLK: return "block";
+    case DT_FIFO: return "fifo";
+    case DT_SOCK: return "socket";
+    default: return "unknown";
+    }
 }
 
 // Built-in commands
@@ -91,6 +286,10 @@ static void write_permissions(mode_t mode) {
 // Forward declaration for recursive directory removal
 static int remove_directory_recursive(const char *path);
 
+// Forward declaration for builtins that run other commands
+#define NOT_BUILTIN -1
+static int run_builtin(char **args);
+
 static int builtin_cd(char **args) {
     if (args[1] == NULL) {
         write_str(ERDEMOS_ERROR_COLOR "ersh: cd: missing argument" COLOR_RESET "\n");
@@ -103,6 +302,45 @@ static int builtin_cd(char **args) {
     return 0;
 }
 
+static int builtin_console(char **args) {
+    if (args[1] == NULL) {
+        write_str(ERDEMOS_PRIMARY_COLOR "console: ");
+        if (async_out.running) {
+            write_str(async_out.policy == ASYNC_DROP ? "async (drop)" : "async (block)");
+        } else {
+            write_str("sync");
+        }
+        write_str(", ");
+        write_uint(async_out.dropped);
+        write_str(" bytes dropped" COLOR_RESET "\n");
+        return 0;
+    }
+    if (strcmp(args[1], "sync") == 0) {
+        async_writer_stop();
+        return 0;
+    }
+    if (strcmp(args[1], "async") == 0) {
+        int policy = ASYNC_BLOCK;
+        if (args[2] != NULL && strcmp(args[2], "drop") == 0) {
+            policy = ASYNC_DROP;
+        } else if (args[2] != NULL && strcmp(args[2], "block") != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: console: invalid policy: " COLOR_RESET);
+            write_str(args[2]);
+            write_str("\n");
+            return 1;
+        }
+        if (async_writer_start(policy) != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: console: cannot start writer thread" COLOR_RESET "\n");
+            return 1;
+        }
+        return 0;
+    }
+    write_str(ERDEMOS_ERROR_COLOR "ersh: console: invalid mode: " COLOR_RESET);
+    write_str(args[1]);
+    write_str("\n");
+    return 1;
+}
+
 static int builtin_copyright(char **args) {
     (void)args;
     write_str(ERDEMOS_PRIMARY_COLOR "erdemOS " ERDEMOS_VERSION "\n\n");
@@ -110,487 +348,6392 @@ static int builtin_copyright(char **args) {
     return 0;
 }
 
-static int builtin_exit(char **args) {
-    (void)args;
-    exit(0);
+// Mount table
+//
+// /proc/self/mountinfo is read with one read() into a buffer big enough
+// for the whole table (grown and read again if it was not) and split in
+// place: every field is NUL-terminated where it stands, so the entries
+// only point into the buffer.
+
+#define DF_TIMEOUT_MS 2000      // Longest wait for statfs() on any mount
+#define DF_STACK_SIZE (64 * 1024)   // Per statfs() thread
+
+struct mount_entry {
+    unsigned id;
+    unsigned parent;
+    dev_t dev;
+    const char *root;           // Path inside the file system
+    const char *target;
+    const char *options;        // Per-mount options
+    const char *fstype;
+    const char *source;
+    const char *super_options;  // File system options
+};
+
+struct mount_table {
+    char *text;
+    struct mount_entry *entries;
+    size_t count;
+};
+
+// Cut the next space-separated field out of a line and decode its \ooo
+// escapes in place
+static char *mount_field(char **cursor) {
+    char *start = *cursor;
+    char *end = strchr(start, ' ');
+    if (end != NULL) {
+        *end = '\0';
+        *cursor = end + 1;
+    } else {
+        *cursor = start + strlen(start);
+    }
+    return mount_unescape(start);
 }
 
-static int builtin_help(char **args) {
-    // If specific command requested, show detailed help
-    if (args[1] != NULL) {
-        const char *cmd = args[1];
-        
-        if (strcmp(cmd, "cd") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "cd" ERDEMOS_PRIMARY_COLOR " - Change directory\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "cd [directory]" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Changes the current working directory to the specified path.\n" COLOR_RESET);
-            return 0;
+static void mount_table_free(struct mount_table *table) {
+    free(table->text);
+    free(table->entries);
+    table->text = NULL;
+    table->entries = NULL;
+    table->count = 0;
+}
+
+// Load and split the mount table; returns 0 or -1
+static int mount_table_load(struct mount_table *table) {
+    memset(table, 0, sizeof(*table));
+    int fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t cap = 16384;
+    ssize_t len;
+    while (1) {
+        table->text = malloc(cap);
+        if (table->text == NULL) {
+            close(fd);
+            return -1;
         }
-        if (strcmp(cmd, "copyright") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "copyright" ERDEMOS_PRIMARY_COLOR " - Show copyright\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "copyright" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Displays copyright information.\n" COLOR_RESET);
-            return 0;
+        len = pread(fd, table->text, cap - 1, 0);
+        if (len < 0 || (size_t)len < cap - 1) {
+            break;
         }
-        if (strcmp(cmd, "exit") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "exit" ERDEMOS_PRIMARY_COLOR " - Exit shell\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "exit" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Exits the shell.\n" COLOR_RESET);
-            return 0;
+        free(table->text);
+        cap *= 4;
+    }
+    close(fd);
+    if (len < 0) {
+        mount_table_free(table);
+        return -1;
+    }
+    table->text[len] = '\0';
+    
+    size_t lines = 0;
+    for (ssize_t i = 0; i < len; i++) {
+        lines += (table->text[i] == '\n');
+    }
+    table->entries = calloc(lines + 1, sizeof(*table->entries));
+    if (table->entries == NULL) {
+        mount_table_free(table);
+        return -1;
+    }
+    
+    // id parent major:minor root target options [optional...] - type source super
+    char *line = table->text;
+    while (*line != '\0') {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        } else {
+            next = line + strlen(line);
         }
-        if (strcmp(cmd, "help") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "help" ERDEMOS_PRIMARY_COLOR " - Show help\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "help [command]" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Shows general help or detailed help for a specific command.\n" COLOR_RESET);
-            return 0;
+        struct mount_entry *entry = &table->entries[table->count];
+        char *cursor = line;
+        entry->id = (unsigned)strtoul(mount_field(&cursor), NULL, 10);
+        entry->parent = (unsigned)strtoul(mount_field(&cursor), NULL, 10);
+        char *minor;
+        unsigned major = (unsigned)strtoul(mount_field(&cursor), &minor, 10);
+        entry->dev = makedev(major, (*minor == ':') ? strtoul(minor + 1, NULL, 10) : 0);
+        entry->root = mount_field(&cursor);
+        entry->target = mount_field(&cursor);
+        entry->options = mount_field(&cursor);
+        while (*cursor != '\0' && strcmp(mount_field(&cursor), "-") != 0) {
+            // Optional fields like shared:1
         }
-        if (strcmp(cmd, "license") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "license" ERDEMOS_PRIMARY_COLOR " - Show license\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "license" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Displays license information.\n" COLOR_RESET);
-            return 0;
+        entry->fstype = mount_field(&cursor);
+        entry->source = mount_field(&cursor);
+        entry->super_options = mount_field(&cursor);
+        if (*entry->target == '/') {
+            table->count++;
         }
-        if (strcmp(cmd, "loadkeys") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "loadkeys" ERDEMOS_PRIMARY_COLOR " - Load keyboard layout\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "loadkeys [us|trq|trf]" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Changes the keyboard layout.\n");
-            write_str("Layouts:\n");
-            write_str("  us   English (US) keyboard layout\n");
-            write_str("  trq  Turkish Q keyboard layout\n");
-            write_str("  trf  Turkish F keyboard layout\n" COLOR_RESET);
-            return 0;
+        line = next;
+    }
+    return 0;
+}
+
+// df
+//
+// Each row gets a detached thread of its own, which looks up the mount
+// holding the path and calls statfs(), so one hung network or FUSE mount
+// costs DF_TIMEOUT_MS instead of blocking the listing. A thread that never
+// returns still holds a reference to the job, which the last of the
+// threads and the shell frees.
+
+struct df_job;
+
+struct df_stat {
+    struct df_job *job;
+    char *path;                     // Path argument, NULL to show mount
+    const struct mount_entry *mount;    // Set by the thread for a path
+    struct statfs st;
+    int state;                      // 0 pending, 1 done, -1 failed, -2 no mount; under the job lock
+};
+
+struct df_job {
+    pthread_mutex_t lock;
+    pthread_cond_t done;            // Waits on CLOCK_MONOTONIC
+    struct mount_table table;
+    struct df_stat *stats;
+    size_t count;
+    size_t pending;                 // Under the job lock
+    int refs;                       // Under the job lock
+};
+
+static void df_job_release(struct df_job *job) {
+    pthread_mutex_lock(&job->lock);
+    int refs = --job->refs;
+    pthread_mutex_unlock(&job->lock);
+    if (refs == 0) {
+        for (size_t i = 0; i < job->count; i++) {
+            free(job->stats[i].path);
         }
-        if (strcmp(cmd, "ls") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "ls" ERDEMOS_PRIMARY_COLOR " - List directory contents\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "ls [-al] [directory]" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Lists files and directories in the specified or current directory.\n");
-            write_str("Options:\n");
-            write_str("  -a      Show all files including hidden (starting with '.')\n");
-            write_str("  -l      Use long listing format (permissions, size, name)\n" COLOR_RESET);
-            return 0;
+        pthread_cond_destroy(&job->done);
+        pthread_mutex_destroy(&job->lock);
+        mount_table_free(&job->table);
+        free(job->stats);
+        free(job);
+    }
+}
+
+// Mark row finished with state; the last reference frees the job
+static void df_stat_finish(struct df_stat *row, const struct mount_entry *mount,
+                           const struct statfs *st, int state) {
+    struct df_job *job = row->job;
+    pthread_mutex_lock(&job->lock);
+    row->mount = mount;
+    if (state == 1) {
+        row->st = *st;
+    }
+    row->state = state;
+    job->pending--;
+    pthread_cond_signal(&job->done);
+    pthread_mutex_unlock(&job->lock);
+    df_job_release(job);
+}
+
+static void *df_stat_main(void *arg) {
+    struct df_stat *row = arg;
+    const struct mount_entry *mount = row->mount;
+    if (row->path != NULL) {
+        // The one holding the path is the last mounted on its device,
+        // which is the one on top
+        struct stat st;
+        if (stat(row->path, &st) == 0) {
+            for (size_t m = 0; m < row->job->table.count; m++) {
+                if (row->job->table.entries[m].dev == st.st_dev) {
+                    mount = &row->job->table.entries[m];
+                }
+            }
         }
-        if (strcmp(cmd, "mkdir") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "mkdir" ERDEMOS_PRIMARY_COLOR " - Create directory\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "mkdir [directory]" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Creates a new directory with the specified name.\n" COLOR_RESET);
-            return 0;
+        if (mount == NULL) {
+            df_stat_finish(row, NULL, NULL, -2);
+            return NULL;
         }
-        if (strcmp(cmd, "poweroff") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "poweroff" ERDEMOS_PRIMARY_COLOR " - Power off system\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "poweroff" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Exits the shell and powers off the system.\n" COLOR_RESET);
-            return 0;
+    }
+    struct statfs st;
+    int result = statfs(mount->target, &st);
+    df_stat_finish(row, mount, &st, (result == 0) ? 1 : -1);
+    return NULL;
+}
+
+// Append one cell of a df row; col 0 is the source, 1 to 3 sizes, 4 the use
+static void df_cell(struct strbuf *sb, const struct df_stat *row, int col, int inodes, int human) {
+    const struct statfs *st = &row->st;
+    unsigned long long total = inodes ? st->f_files : st->f_blocks;
+    unsigned long long free_count = inodes ? st->f_ffree : st->f_bfree;
+    unsigned long long avail = inodes ? st->f_ffree : st->f_bavail;
+    unsigned long long used = total - free_count;
+    unsigned long long unit = inodes ? 1 : (unsigned long long)(st->f_frsize ? st->f_frsize : st->f_bsize);
+    unsigned long long value = (col == 1) ? total : (col == 2) ? used : avail;
+    if (col == 0) {
+        sb_str(sb, row->mount->source);
+    } else if (col == 4) {
+        if (used + avail == 0) {
+            sb_str(sb, "-");
+        } else {
+            // Rounded up, like df: 0% only when nothing is used
+            sb_uint_aligned(sb, (used * 100 + used + avail - 1) / (used + avail), 0);
+            sb_str(sb, "%");
         }
-        if (strcmp(cmd, "pwd") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "pwd" ERDEMOS_PRIMARY_COLOR " - Print working directory\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "pwd" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Displays the current working directory path.\n" COLOR_RESET);
-            return 0;
+    } else if (human) {
+        sb_size_human(sb, (off_t)(value * unit), 0);
+    } else {
+        sb_uint_aligned(sb, inodes ? value : value * unit / 1024, 0);
+    }
+}
+
+static void df_print(struct df_stat *stats, const char *states, size_t count, int inodes, int human) {
+    static const char *headers[2][5] = {
+        { "Filesystem", "1K-blocks", "Used", "Available", "Use%" },
+        { "Filesystem", "Inodes", "IUsed", "IFree", "IUse%" },
+    };
+    const char **header = (const char **)headers[inodes];
+    const char *size_header = human ? "Size" : header[1];
+    const char *avail_header = (human && !inodes) ? "Avail" : header[3];
+    
+    // Measure every cell first to size the columns
+    size_t width[5];
+    width[0] = strlen(header[0]);
+    width[1] = strlen(size_header);
+    width[2] = strlen(header[2]);
+    width[3] = strlen(avail_header);
+    width[4] = strlen(header[4]);
+    struct strbuf cell = {0};
+    for (size_t i = 0; i < count; i++) {
+        for (int col = 0; col < 5 && states[i] == 1; col++) {
+            cell.len = 0;
+            df_cell(&cell, &stats[i], col, inodes, human);
+            if (cell.len > width[col]) {
+                width[col] = cell.len;
+            }
         }
-        if (strcmp(cmd, "rm") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "rm" ERDEMOS_PRIMARY_COLOR " - Remove file or directory\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "rm [-rf] [file/dir ...]" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Removes files or directories.\n");
-            write_str("Options:\n");
-            write_str("  -r, -R  Remove directories recursively\n");
-            write_str("  -f      Force removal, ignore errors\n" COLOR_RESET);
-            return 0;
+    }
+    
+    struct strbuf out = {0};
+    sb_str(&out, ERDEMOS_PRIMARY_COLOR);
+    sb_str_padded(&out, header[0], width[0]);
+    const char *titles[] = { NULL, size_header, header[2], avail_header, header[4] };
+    for (int col = 1; col < 5; col++) {
+        sb_str(&out, " ");
+        for (size_t pad = strlen(titles[col]); pad < width[col]; pad++) {
+            sb_str(&out, " ");
         }
-        if (strcmp(cmd, "touch") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "touch" ERDEMOS_PRIMARY_COLOR " - Create empty file\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "touch [file]" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Creates an empty file with the specified name.\n" COLOR_RESET);
-            return 0;
+        sb_str(&out, titles[col]);
+    }
+    sb_str(&out, " Mounted on\n" COLOR_RESET);
+    for (size_t i = 0; i < count; i++) {
+        if (states[i] != 1) {
+            continue;
         }
-        if (strcmp(cmd, "version") == 0) {
-            write_str(ERDEMOS_COMMAND_COLOR "version" ERDEMOS_PRIMARY_COLOR " - Show version\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "version" COLOR_RESET "\n");
-            write_str(ERDEMOS_PRIMARY_COLOR "Displays the erdemOS version number.\n" COLOR_RESET);
-            return 0;
+        for (int col = 0; col < 5; col++) {
+            cell.len = 0;
+            df_cell(&cell, &stats[i], col, inodes, human);
+            if (col > 0) {
+                sb_str(&out, " ");
+                for (size_t pad = cell.len; pad < width[col]; pad++) {
+                    sb_str(&out, " ");
+                }
+            }
+            sb_append(&out, cell.data, cell.len);
+            for (size_t pad = cell.len; col == 0 && pad < width[0]; pad++) {
+                sb_str(&out, " ");
+            }
         }
-        
-        // Unknown command
-        write_str(ERDEMOS_ERROR_COLOR "ersh: help: unknown command: " COLOR_RESET);
-        write_str(cmd);
-        write_str("\n");
-        return 1;
+        sb_str(&out, " ");
+        sb_str(&out, stats[i].mount->target);
+        sb_str(&out, "\n");
     }
-    
-    // Show general help
-    write_str(ERDEMOS_PRIMARY_COLOR "ersh - Erdem Shell\n\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "Built-in commands:\n\n");
-    write_str(ERDEMOS_COMMAND_COLOR "cd [dir]" ERDEMOS_PRIMARY_COLOR "            - Change directory\n");
-    write_str(ERDEMOS_COMMAND_COLOR "copyright" ERDEMOS_PRIMARY_COLOR "           - Show copyright\n");
-    write_str(ERDEMOS_COMMAND_COLOR "exit" ERDEMOS_PRIMARY_COLOR "                - Exit shell\n");
-    write_str(ERDEMOS_COMMAND_COLOR "help [command]" ERDEMOS_PRIMARY_COLOR "      - Show this help\n");
-    write_str(ERDEMOS_COMMAND_COLOR "license" ERDEMOS_PRIMARY_COLOR "             - Show license\n");
-    write_str(ERDEMOS_COMMAND_COLOR "loadkeys [layout]" ERDEMOS_PRIMARY_COLOR "   - Load keyboard layout (us|trq|trf)\n");
-    write_str(ERDEMOS_COMMAND_COLOR "ls [-al] [dir]" ERDEMOS_PRIMARY_COLOR "      - List directory contents\n");
-    write_str(ERDEMOS_COMMAND_COLOR "mkdir [dir]" ERDEMOS_PRIMARY_COLOR "         - Create directory\n");
-    write_str(ERDEMOS_COMMAND_COLOR "poweroff" ERDEMOS_PRIMARY_COLOR "            - Exit shell and power off system\n");
-    write_str(ERDEMOS_COMMAND_COLOR "pwd" ERDEMOS_PRIMARY_COLOR "                 - Print working directory\n");
-    write_str(ERDEMOS_COMMAND_COLOR "rm [-rf] [file/dir]" ERDEMOS_PRIMARY_COLOR " - Remove file or directory\n");
-    write_str(ERDEMOS_COMMAND_COLOR "touch [file]" ERDEMOS_PRIMARY_COLOR "        - Create empty file\n");
-    write_str(ERDEMOS_COMMAND_COLOR "version" ERDEMOS_PRIMARY_COLOR "             - Show version\n");
-    write_str("\nType " ERDEMOS_COMMAND_COLOR "'help [command]'" ERDEMOS_PRIMARY_COLOR " for detailed help on a specific command.\n");
-    return 0;
+    out_write(out.data, out.len);
+    sb_free(&out);
+    sb_free(&cell);
 }
 
-static int builtin_license(char **args) {
-    (void)args;
-    write_str(ERDEMOS_PRIMARY_COLOR "Licensed under the Apache License, Version 2.0 (the \"License\");\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "you may not use this file except in compliance with the License.\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "You may obtain a copy of the License at\n\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "    http://www.apache.org/licenses/LICENSE-2.0\n\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "Unless required by applicable law or agreed to in writing, software\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "distributed under the License is distributed on an \"AS IS\" BASIS,\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "See the License for the specific language governing permissions and\n");
-    write_str(ERDEMOS_PRIMARY_COLOR "limitations under the License.\n" COLOR_RESET);
-    return 0;
+static void df_json(struct df_stat *stats, const char *states, size_t count) {
+    struct json_writer json = {0};
+    json_begin_array(&json);
+    for (size_t i = 0; i < count; i++) {
+        if (states[i] != 1) {
+            continue;
+        }
+        const struct statfs *st = &stats[i].st;
+        unsigned long long unit = st->f_frsize ? st->f_frsize : st->f_bsize;
+        json_begin_object(&json);
+        json_field_string(&json, "source", stats[i].mount->source);
+        json_field_string(&json, "target", stats[i].mount->target);
+        json_field_string(&json, "type", stats[i].mount->fstype);
+        json_field_uint(&json, "size", st->f_blocks * unit);
+        json_field_uint(&json, "used", (st->f_blocks - st->f_bfree) * unit);
+        json_field_uint(&json, "avail", st->f_bavail * unit);
+        json_field_uint(&json, "inodes", st->f_files);
+        json_field_uint(&json, "iused", st->f_files - st->f_ffree);
+        json_field_uint(&json, "ifree", st->f_ffree);
+        json_end_object(&json);
+    }
+    json_end_array(&json);
+    out_str("\n");
 }
 
-static int builtin_loadkeys(char **args) {
-    if (args[1] == NULL) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: missing argument" COLOR_RESET "\n");
-        write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "loadkeys [us|trq|trf]" COLOR_RESET "\n");
+static int builtin_df(char **args) {
+    int human = 0;
+    int inodes = 0;
+    int output = OUTPUT_TEXT;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        const char *opt = args[arg_idx];
+        int valid = (opt[1] != '\0');
+        if (strcmp(opt, "--json") == 0) {
+            output = OUTPUT_JSON;
+        } else if (opt[1] == '-') {
+            valid = 0;
+        }
+        for (int i = 1; opt[1] != '-' && opt[i] != '\0'; i++) {
+            // -h and -i, also as -hi
+            if (opt[i] == 'h') {
+                human = 1;
+            } else if (opt[i] == 'i') {
+                inodes = 1;
+            } else {
+                valid = 0;
+            }
+        }
+        if (!valid) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: df: invalid option: " COLOR_RESET);
+            write_str(opt);
+            write_str("\n");
+            return 1;
+        }
+        arg_idx++;
+    }
+    
+    struct df_job *job = calloc(1, sizeof(*job));
+    if (job == NULL || mount_table_load(&job->table) != 0) {
+        free(job);
+        write_str(ERDEMOS_ERROR_COLOR "ersh: df: cannot read /proc/self/mountinfo" COLOR_RESET "\n");
+        return 1;
+    }
+    size_t rows = (args[arg_idx] != NULL) ? 0 : job->table.count;
+    for (int i = arg_idx; args[i] != NULL; i++) {
+        rows++;
+    }
+    job->stats = calloc(rows + 1, sizeof(*job->stats));
+    char *states = malloc(rows + 1);
+    if (job->stats == NULL || states == NULL) {
+        free(states);
+        mount_table_free(&job->table);
+        free(job->stats);
+        free(job);
+        write_str(ERDEMOS_ERROR_COLOR "ersh: df: out of memory" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // The mounts to show: all, or the one holding each path
+    for (int i = arg_idx; args[i] != NULL; i++) {
+        job->stats[job->count].path = strdup(args[i]);
+        if (job->stats[job->count].path != NULL) {
+            job->count++;
+        }
+    }
+    if (args[arg_idx] == NULL) {
+        for (size_t m = 0; m < job->table.count; m++) {
+            job->stats[job->count++].mount = &job->table.entries[m];
+        }
+    }
+    
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&job->done, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_mutex_init(&job->lock, NULL);
+    job->pending = job->count;
+    job->refs = 1 + (int)job->count;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, DF_STACK_SIZE);
+    for (size_t i = 0; i < job->count; i++) {
+        pthread_t thread;
+        job->stats[i].job = job;
+        if (pthread_create(&thread, &attr, df_stat_main, &job->stats[i]) != 0) {
+            df_stat_finish(&job->stats[i], job->stats[i].mount, NULL, -1);
+        }
+    }
+    pthread_attr_destroy(&attr);
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += DF_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (DF_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    int status = 0;
+    pthread_mutex_lock(&job->lock);
+    while (job->pending > 0 && pthread_cond_timedwait(&job->done, &job->lock, &deadline) != ETIMEDOUT) {
+    }
+    // Results that arrive after this are ignored
+    for (size_t i = 0; i < job->count; i++) {
+        states[i] = (char)job->stats[i].state;
+        // Without a path, mounts with no blocks (proc, sysfs, ...) are left out
+        if (states[i] == 1 && args[arg_idx] == NULL &&
+            (inodes ? job->stats[i].st.f_files : job->stats[i].st.f_blocks) == 0) {
+            states[i] = 2;
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    
+    for (size_t i = 0; i < job->count; i++) {
+        const char *name = (job->stats[i].path != NULL) ? job->stats[i].path : job->stats[i].mount->target;
+        if (states[i] == -2) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: df: no mount found: " COLOR_RESET);
+            write_str(name);
+            write_str("\n");
+            status = 1;
+        } else if (states[i] == 0 || states[i] == -1) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: df: ");
+            write_str((states[i] == 0) ? "timed out: " COLOR_RESET : "cannot read: " COLOR_RESET);
+            write_str(name);
+            write_str("\n");
+            status = 1;
+        }
+    }
+    if (output == OUTPUT_JSON) {
+        df_json(job->stats, states, job->count);
+    } else if (job->count > 0) {
+        df_print(job->stats, states, job->count, inodes, human);
+    }
+    free(states);
+    df_job_release(job);
+    return status;
+}
+
+static int builtin_exit(char **args) {
+    (void)args;
+    exit(0);
+}
+
+// Parse a size like 4096, 64K, 2GiB or 10MB: K, M, G, T, P and E alone or
+// with iB are powers of 1024, with B powers of 1000
+static int parse_size(const char *text, off_t *size) {
+    if (*text < '0' || *text > '9') {
+        return -1;
+    }
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    const char *units = "KMGTPE";
+    const char *unit = (*end != '\0') ? strchr(units, *end) : NULL;
+    if (unit != NULL) {
+        unsigned long long base = 1024;
+        if (strcmp(end + 1, "B") == 0) {
+            base = 1000;
+        } else if (end[1] != '\0' && strcmp(end + 1, "iB") != 0) {
+            return -1;
+        }
+        for (int i = 0; i <= unit - units; i++) {
+            if (value > (unsigned long long)INT64_MAX / base) {
+                return -1;
+            }
+            value *= base;
+        }
+    } else if (*end != '\0') {
+        return -1;
+    }
+    if (value > (unsigned long long)INT64_MAX) {
+        return -1;
+    }
+    *size = (off_t)value;
+    return 0;
+}
+
+static int fallocate_error(const char *what, const char *path) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: fallocate: ");
+    write_str(what);
+    write_str(": " COLOR_RESET);
+    write_str(path);
+    write_str("\n");
+    return 1;
+}
+
+// Punch out every whole block of zeros in [start, end). Only the data
+// extents are read: SEEK_DATA/SEEK_HOLE skip the holes already there.
+static int fallocate_dig(int fd, off_t start, off_t end, blksize_t block) {
+    size_t chunk = (1 << 20) / block * block;
+    if (chunk == 0) {
+        chunk = block;
+    }
+    char *buf = malloc(chunk);
+    if (buf == NULL) {
+        return -1;
+    }
+    int result = 0;
+    off_t pos = start;
+    while (pos < end && result == 0) {
+        off_t data = lseek(fd, pos, SEEK_DATA);
+        if (data < 0 || data >= end) {
+            break;                  // ENXIO: only holes from here on
+        }
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        if (hole < 0 || hole > end) {
+            hole = end;
+        }
+        // Blocks of zeros are collected into one run and punched at once
+        off_t run = -1;
+        off_t at = data - data % block;
+        if (at < start) {
+            at += block;
+        }
+        while (at + block <= hole && result == 0) {
+            size_t want = chunk;
+            if ((off_t)want > hole - at) {
+                want = (size_t)((hole - at) / block * block);
+            }
+            ssize_t got = pread(fd, buf, want, at);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < block) {
+                result = (got < 0) ? -1 : 0;
+                break;
+            }
+            for (ssize_t i = 0; i + block <= got; i += block, at += block) {
+                int zero = buf[i] == 0 && memcmp(buf + i, buf + i + 1, block - 1) == 0;
+                if (zero && run < 0) {
+                    run = at;
+                } else if (!zero && run >= 0) {
+                    result |= fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, run, at - run);
+                    run = -1;
+                }
+            }
+        }
+        if (run >= 0 && result == 0) {
+            result = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, run, at - run);
+        }
+        pos = hole;
+    }
+    free(buf);
+    return result;
+}
+
+static int builtin_fallocate(char **args) {
+    int mode = 0;
+    int dig = 0;
+    off_t offset = 0;
+    off_t length = -1;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        const char *opt = args[arg_idx++];
+        if (strcmp(opt, "-l") == 0 || strcmp(opt, "-o") == 0) {
+            off_t value;
+            if (args[arg_idx] == NULL) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: fallocate: missing value for " COLOR_RESET);
+                write_str(opt);
+                write_str("\n");
+                return 1;
+            }
+            if (parse_size(args[arg_idx], &value) != 0) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: fallocate: invalid size: " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                return 1;
+            }
+            *((opt[1] == 'l') ? &length : &offset) = value;
+            arg_idx++;
+        } else if (strcmp(opt, "-n") == 0) {
+            mode |= FALLOC_FL_KEEP_SIZE;
+        } else if (strcmp(opt, "-p") == 0) {
+            mode |= FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+        } else if (strcmp(opt, "-z") == 0) {
+            mode |= FALLOC_FL_ZERO_RANGE;
+        } else if (strcmp(opt, "-d") == 0 || strcmp(opt, "--dig") == 0) {
+            dig = 1;
+        } else {
+            return fallocate_error("invalid option", opt);
+        }
+    }
+    
+    char *path = args[arg_idx];
+    if (path == NULL || args[arg_idx + 1] != NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: fallocate: expected one file" COLOR_RESET "\n");
+        return 1;
+    }
+    if ((mode & FALLOC_FL_PUNCH_HOLE) && (mode & FALLOC_FL_ZERO_RANGE)) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: fallocate: -p and -z cannot be combined" COLOR_RESET "\n");
+        return 1;
+    }
+    if (!dig && length <= 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: fallocate: -l length is required" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // Only plain preallocation may create the file
+    int fd = open(path, O_RDWR | O_CLOEXEC | ((mode == 0 && !dig) ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        return fallocate_error("cannot open", path);
+    }
+    int result;
+    if (dig) {
+        struct stat st;
+        result = fstat(fd, &st);
+        if (result == 0) {
+            off_t end = (length > 0 && offset + length < st.st_size) ? offset + length : st.st_size;
+            result = fallocate_dig(fd, offset, end, st.st_blksize);
+        }
+    } else {
+        result = fallocate(fd, mode, offset, length);
+    }
+    if (result != 0) {
+        fallocate_error((errno == EOPNOTSUPP) ? "not supported by the file system" : "failed", path);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int builtin_help(char **args) {
+    // If specific command requested, show detailed help
+    if (args[1] != NULL) {
+        const char *cmd = args[1];
+        
+        if (strcmp(cmd, "cd") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "cd" ERDEMOS_PRIMARY_COLOR " - Change directory\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "cd [directory]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Changes the current working directory to the specified path.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "chmod") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "chmod" ERDEMOS_PRIMARY_COLOR " - Change file mode\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "chmod [-R] mode file..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Sets the mode of each file. The mode is octal (755) or symbolic\n");
+            write_str("clauses [ugoa][+-=][rwxXst], separated by commas (u+x,go-w).\n");
+            write_str("Options:\n");
+            write_str("  -R      Change directories recursively, in parallel; links are skipped\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "chown") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "chown" ERDEMOS_PRIMARY_COLOR " - Change file owner and group\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "chown [-R] [owner][:group] file..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Sets the owner and/or group of each file, by name or number.\n");
+            write_str("Options:\n");
+            write_str("  -R      Change directories recursively, in parallel; links themselves\n");
+            write_str("          are changed, not followed\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "chrt") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "chrt" ERDEMOS_PRIMARY_COLOR " - Run a command with a scheduling policy\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "chrt [policy] [-R] priority command [arg...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "chrt -p [policy] priority pid..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "chrt -p pid" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Runs command with the policy (default -r), set between fork and exec,\n");
+            write_str("or changes or shows the policy of running processes.\n");
+            write_str("Policies:\n");
+            write_str("  -f      SCHED_FIFO, priority 1-99\n");
+            write_str("  -r      SCHED_RR, priority 1-99\n");
+            write_str("  -o      SCHED_OTHER, priority 0\n");
+            write_str("  -b      SCHED_BATCH, priority 0\n");
+            write_str("  -i      SCHED_IDLE, priority 0\n");
+            write_str("  -d      SCHED_DEADLINE, priority 0, with these in nanoseconds:\n");
+            write_str("  -T ns   Runtime\n");
+            write_str("  -D ns   Deadline (default: the period, else the runtime)\n");
+            write_str("  -P ns   Period (default: the deadline)\n");
+            write_str("  -R      Reset to SCHED_OTHER in children\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "console") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "console" ERDEMOS_PRIMARY_COLOR " - Console output mode\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "console [sync|async [block|drop]]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Shows or sets how the shell writes to the console.\n");
+            write_str("Modes:\n");
+            write_str("  sync    Write output directly (default)\n");
+            write_str("  async   Hand output to a writer thread, so a slow console does not stall the shell\n");
+            write_str("Policies when the buffer is full and output is not a terminal:\n");
+            write_str("  block   Wait for the console (default)\n");
+            write_str("  drop    Discard output and count the dropped bytes\n");
+            write_str("ERSH_CONSOLE=async or ERSH_CONSOLE=async-drop selects the mode at startup.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "copyright") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "copyright" ERDEMOS_PRIMARY_COLOR " - Show copyright\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "copyright" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Displays copyright information.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "df") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "df" ERDEMOS_PRIMARY_COLOR " - Show free disk space\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "df [-hi] [--json] [path...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Shows size, used and available space of every mounted file system, or of\n");
+            write_str("the ones holding the given paths. File systems without blocks are left out.\n");
+            write_str("Options:\n");
+            write_str("  -h      Human-readable sizes (1K, 234M, 2G)\n");
+            write_str("  -i      Inodes instead of blocks\n");
+            write_str("  --json  Print a JSON array with sizes in bytes and inode counts\n");
+            write_str("A mount that does not answer within 2 seconds is reported and skipped.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "exit") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "exit" ERDEMOS_PRIMARY_COLOR " - Exit shell\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "exit" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Exits the shell.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "fallocate") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "fallocate" ERDEMOS_PRIMARY_COLOR " - Preallocate or deallocate file space\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "fallocate [-n] [-p|-z] [-o offset] -l length file" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "fallocate --dig [-o offset] [-l length] file" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Allocates blocks for the range without writing them; the file is created\n");
+            write_str("if needed. Sizes take K, M, G, T suffixes (KiB, ...) or KB, MB, ... for 1000.\n");
+            write_str("Options:\n");
+            write_str("  -n      Keep the file size\n");
+            write_str("  -p      Punch a hole: deallocate the range\n");
+            write_str("  -z      Zero the range\n");
+            write_str("  --dig   Punch out blocks of zeros, reading only the allocated extents\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "help") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "help" ERDEMOS_PRIMARY_COLOR " - Show help\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "help [command]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Shows general help or detailed help for a specific command.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "ionice") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "ionice" ERDEMOS_PRIMARY_COLOR " - Run a command with an I/O priority\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "ionice [-c class] [-n level] command [arg...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "ionice [-c class] [-n level] -p pid..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Runs command with the I/O scheduling class and level, or changes or\n");
+            write_str("shows those of running processes.\n");
+            write_str("Options:\n");
+            write_str("  -c class  none (0), realtime (1), best-effort (2) or idle (3)\n");
+            write_str("  -n level  0 (highest) to 7 for realtime and best-effort (default 4)\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "kill") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "kill" ERDEMOS_PRIMARY_COLOR " - Send a signal to processes\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "kill [-s sig | -sig] pid..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "kill -l" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Sends sig (default TERM) to each pid through a pidfd, so a reused pid is\n");
+            write_str("never signalled. A negative pid (after --) is a process group.\n");
+            write_str("Signals are given by name (TERM, SIGTERM) or number; -l lists them.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "license") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "license" ERDEMOS_PRIMARY_COLOR " - Show license\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "license" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Displays license information.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "limit") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "limit" ERDEMOS_PRIMARY_COLOR " - Run a command with resource limits\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "limit [-H|-S] -option value... command [arg...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Runs command with the limits set in its own process, between fork and\n");
+            write_str("exec; the shell keeps its limits. Options and values are as for\n");
+            write_str("ulimit (see help ulimit).\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "loadkeys") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "loadkeys" ERDEMOS_PRIMARY_COLOR " - Load keyboard layout\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "loadkeys [us|trq|trf]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Changes the keyboard layout.\n");
+            write_str("Layouts:\n");
+            write_str("  us   English (US) keyboard layout\n");
+            write_str("  trq  Turkish Q keyboard layout\n");
+            write_str("  trf  Turkish F keyboard layout\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "ls") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "ls" ERDEMOS_PRIMARY_COLOR " - List directory contents\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "ls [-alhR0] [--json] [directory]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Lists files and directories in the specified or current directory.\n");
+            write_str("Options:\n");
+            write_str("  -a      Show all files including hidden (starting with '.')\n");
+            write_str("  -l      Use long listing format (permissions, links, owner, group, size, mtime, name)\n");
+            write_str("  -h      With -l, print sizes like 1.5K, 23M\n");
+            write_str("  -R      List subdirectories recursively, sorted, depth first\n");
+            write_str("  -0      Print names only, each terminated by a NUL byte\n");
+            write_str("  --json  Print a JSON array of {name, type} objects\n");
+            write_str("          (with -l: mode, size, nlink, uid, gid, owner, group, mtime)\n");
+            write_str("Names are colored by type and extension from LS_COLORS (dircolors format).\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "mkdir") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "mkdir" ERDEMOS_PRIMARY_COLOR " - Create directory\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "mkdir [-p] directory..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Creates each directory, in order.\n");
+            write_str("Options:\n");
+            write_str("  -p      Create missing parents; existing directories are not an error\n");
+            write_str("On SMP systems many directories are created in batches through io_uring\n");
+            write_str("(ERSH_URING=1 forces it, ERSH_URING=0 disables it).\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "mount") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "mount" ERDEMOS_PRIMARY_COLOR " - Mount a file system\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "mount [-t type] [-o options] source target" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "mount -a" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Mounts source on target; without arguments, lists mounts like " ERDEMOS_COMMAND_COLOR "mounts" ERDEMOS_PRIMARY_COLOR ".\n");
+            write_str("Options:\n");
+            write_str("  -t      File system type (required unless -o bind)\n");
+            write_str("  -o      Comma-separated options: ro, nosuid, nodev, noexec, noatime,\n");
+            write_str("          bind, and file system options like size=64m\n");
+            write_str("  -a      Mount every /etc/fstab entry not mounted yet, at the same time\n");
+            write_str("          except where one mount point is inside another\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "mounts") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "mounts" ERDEMOS_PRIMARY_COLOR " - List mounted file systems\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "mounts [--json]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Lists the mount table as source, mount point, type and options.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "mv") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "mv" ERDEMOS_PRIMARY_COLOR " - Move or rename files\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "mv [-n] source... target" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "mv -x path1 path2" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Renames source to target, or moves each source into the target directory.\n");
+            write_str("Options:\n");
+            write_str("  -n      Never replace an existing target (checked atomically)\n");
+            write_str("  -x      Exchange two existing paths atomically\n");
+            write_str("Across file systems the source is copied, then removed. Directory trees\n");
+            write_str("are copied in parallel.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "nice") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "nice" ERDEMOS_PRIMARY_COLOR " - Run a command with a niceness\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "nice [-n increment | -increment] command [arg...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Runs command with its niceness raised by increment (default 10);\n");
+            write_str("a negative increment needs privileges. Without a command, shows the\n");
+            write_str("niceness. nice, taskset, chrt, ionice and limit combine in any order;\n");
+            write_str("the command runs in a single child that applies all of them.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "pidof") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "pidof" ERDEMOS_PRIMARY_COLOR " - Find processes by name\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "pidof name..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Prints the pid of every process named like one of the names.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "pkill") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "pkill" ERDEMOS_PRIMARY_COLOR " - Signal processes by name\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "pkill [-sig] [-f] [-x] pattern..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Sends sig (default TERM) to every process whose name matches one of the\n");
+            write_str("patterns, in a single pass over /proc. Patterns are regular expressions\n");
+            write_str("made of literals, ., [set], [^set], *, +, ?, ^, $ and \\ escapes.\n");
+            write_str("Options:\n");
+            write_str("  -f      Match the full command line instead of the name\n");
+            write_str("  -x      Match the whole name only\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "poweroff") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "poweroff" ERDEMOS_PRIMARY_COLOR " - Power off system\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "poweroff" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Exits the shell and powers off the system.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "pwd") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "pwd" ERDEMOS_PRIMARY_COLOR " - Print working directory\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "pwd" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Displays the current working directory path.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "renice") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "renice" ERDEMOS_PRIMARY_COLOR " - Change the niceness of processes\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "renice [-n] priority [-p|-g] id..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Sets the niceness (-20 to 19) of processes, or after -g of process groups.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "rm") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "rm" ERDEMOS_PRIMARY_COLOR " - Remove file or directory\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "rm [-rf] [file/dir ...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Removes files or directories.\n");
+            write_str("Options:\n");
+            write_str("  -r, -R  Remove directories recursively\n");
+            write_str("  -f      Force removal, ignore errors\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "sleep") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "sleep" ERDEMOS_PRIMARY_COLOR " - Wait for a while\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "sleep duration..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Waits for the sum of the durations, without starting a process.\n");
+            write_str("A duration is seconds, fractions allowed, with an optional suffix:\n");
+            write_str("s for seconds, m for minutes, h for hours or d for days.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "stat") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "stat" ERDEMOS_PRIMARY_COLOR " - Show file status\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "stat [-L] [-c format] [--sync=none|force] [--json] file..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Shows the status of each file, asking the kernel only for the fields used.\n");
+            write_str("Options:\n");
+            write_str("  -L            Follow symbolic links\n");
+            write_str("  -c format     Print format for each file, followed by a newline\n");
+            write_str("  --sync=none   Do not revalidate attributes with network or FUSE servers\n");
+            write_str("  --sync=force  Always revalidate attributes\n");
+            write_str("  --json        Print a JSON array of objects\n");
+            write_str("Format directives:\n");
+            write_str("  %n name       %s size        %b blocks      %B block unit  %o IO block\n");
+            write_str("  %F type       %a mode (oct)  %A mode        %h links       %i inode\n");
+            write_str("  %u/%U owner   %g/%G group    %d/%D device   %M mount ID    %% percent\n");
+            write_str("  %x/%X access  %y/%Y modify   %z/%Z change   %w/%W birth (as text/seconds)\n");
+            write_str("\\t and \\n in format are a tab and a newline.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "sysctl") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "sysctl" ERDEMOS_PRIMARY_COLOR " - Show or set kernel tunables\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "sysctl [-n] key[=value]..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "sysctl -a [-n]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "sysctl -P [profile]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Shows each key, or sets it to value. A key like vm.swappiness names\n");
+            write_str("/proc/sys/vm/swappiness; with an mm. prefix it names a file below\n");
+            write_str("/sys/kernel/mm, like mm.transparent_hugepage.enabled.\n");
+            write_str("Options:\n");
+            write_str("  -n          Print only the values\n");
+            write_str("  -a          Show every key below /proc/sys\n");
+            write_str("  -P          List the tuning profiles, or apply one and show how long\n");
+            write_str("              each write took. init applies one at boot when the\n");
+            write_str("              kernel command line has erdemos_tune=profile.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "taskset") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "taskset" ERDEMOS_PRIMARY_COLOR " - Run a command on some CPUs\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "taskset [-c] cpus command [arg...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "       " ERDEMOS_COMMAND_COLOR "taskset -p [-c] [cpus] pid" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Runs command with its CPU affinity set to cpus, or shows and changes\n");
+            write_str("the affinity of a running process. cpus is a hexadecimal mask like 0x3,\n");
+            write_str("or with -c a list like 0-3,8,10-15:2 (every second CPU of 10-15).\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "timeout") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "timeout" ERDEMOS_PRIMARY_COLOR " - Run a command with a time limit\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "timeout [-s sig] [-k duration] duration command [arg...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Runs command, builtin or not, and sends it sig (default TERM) once\n");
+            write_str("duration has passed (see help sleep). The command runs in its own\n");
+            write_str("process group and the signal goes to all of it. The status is the\n");
+            write_str("command's, or 124 if it timed out.\n");
+            write_str("Options:\n");
+            write_str("  -s sig       Signal to send, by name or number\n");
+            write_str("  -k duration  Also send KILL if the command still runs duration later\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "touch") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "touch" ERDEMOS_PRIMARY_COLOR " - Create files or set their times\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "touch [-c] [-d date] [-r file] file..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Creates each missing file, empty, and sets the access and modification\n");
+            write_str("times of existing ones to now.\n");
+            write_str("Options:\n");
+            write_str("  -c       Do not create missing files\n");
+            write_str("  -d date  Use date: @SECONDS, YYYY-MM-DD or YYYY-MM-DDTHH:MM[:SS] (local time)\n");
+            write_str("  -r file  Use the times of file\n");
+            write_str("On SMP systems many files are created in batches through io_uring\n");
+            write_str("(ERSH_URING=1 forces it, ERSH_URING=0 disables it).\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "truncate") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "truncate" ERDEMOS_PRIMARY_COLOR " - Set file size\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "truncate [-c] -s [+|-]size file..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Shrinks or extends each file to size, or by size with + or -.\n");
+            write_str("Extending leaves a hole; no data is written.\n");
+            write_str("Options:\n");
+            write_str("  -c      Do not create missing files\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "ulimit") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "ulimit" ERDEMOS_PRIMARY_COLOR " - Show or set the shell's resource limits\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "ulimit [-H|-S] [-a] [-option [value]]..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Shows the limits given without a value (all without options) and sets\n");
+            write_str("those given with one, for the shell and every command started later.\n");
+            write_str("A value is a number or unlimited; memory limits are in kbytes, or a\n");
+            write_str("size with a suffix like 256M.\n");
+            write_str("Options:\n");
+            write_str("  -H      Hard limit only (shown or set)\n");
+            write_str("  -S      Soft limit only (default: shown is soft, set is both)\n");
+            write_str("  -n      Open files\n");
+            write_str("  -v      Virtual memory\n");
+            write_str("  -t      CPU time in seconds\n");
+            write_str("  -u      Processes of the user\n");
+            write_str("  -l      Locked memory\n");
+            write_str("  -s      Stack size\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "umount") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "umount" ERDEMOS_PRIMARY_COLOR " - Unmount file systems\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "umount [-l] target..." COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Unmounts the file system mounted on each target.\n");
+            write_str("Options:\n");
+            write_str("  -l      Lazy: detach now, clean up once it is no longer busy\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "version") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "version" ERDEMOS_PRIMARY_COLOR " - Show version\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "version" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Displays the erdemOS version number.\n" COLOR_RESET);
+            return 0;
+        }
+        if (strcmp(cmd, "watch") == 0) {
+            write_str(ERDEMOS_COMMAND_COLOR "watch" ERDEMOS_PRIMARY_COLOR " - Run a command repeatedly\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "watch [-n interval] command [arg...]" COLOR_RESET "\n");
+            write_str(ERDEMOS_PRIMARY_COLOR "Runs command every interval (default 2 seconds, see help sleep) and\n");
+            write_str("shows its output full screen, redrawing only the characters that\n");
+            write_str("changed. Press any key to stop.\n" COLOR_RESET);
+            return 0;
+        }
+        
+        // Unknown command
+        write_str(ERDEMOS_ERROR_COLOR "ersh: help: unknown command: " COLOR_RESET);
+        write_str(cmd);
+        write_str("\n");
+        return 1;
+    }
+    
+    // Show general help
+    write_str(ERDEMOS_PRIMARY_COLOR "ersh - Erdem Shell\n\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "Built-in commands:\n\n");
+    write_str(ERDEMOS_COMMAND_COLOR "cd [dir]" ERDEMOS_PRIMARY_COLOR "            - Change directory\n");
+    write_str(ERDEMOS_COMMAND_COLOR "chmod [-R] mode" ERDEMOS_PRIMARY_COLOR "     - Change file mode\n");
+    write_str(ERDEMOS_COMMAND_COLOR "chown [-R] owner" ERDEMOS_PRIMARY_COLOR "    - Change file owner and group\n");
+    write_str(ERDEMOS_COMMAND_COLOR "chrt [-f] prio cmd" ERDEMOS_PRIMARY_COLOR "  - Run a command with a scheduling policy\n");
+    write_str(ERDEMOS_COMMAND_COLOR "console [mode]" ERDEMOS_PRIMARY_COLOR "      - Show or set console output mode\n");
+    write_str(ERDEMOS_COMMAND_COLOR "copyright" ERDEMOS_PRIMARY_COLOR "           - Show copyright\n");
+    write_str(ERDEMOS_COMMAND_COLOR "df [-hi] [path]" ERDEMOS_PRIMARY_COLOR "     - Show free disk space\n");
+    write_str(ERDEMOS_COMMAND_COLOR "exit" ERDEMOS_PRIMARY_COLOR "                - Exit shell\n");
+    write_str(ERDEMOS_COMMAND_COLOR "fallocate -l len f" ERDEMOS_PRIMARY_COLOR "  - Preallocate file space\n");
+    write_str(ERDEMOS_COMMAND_COLOR "help [command]" ERDEMOS_PRIMARY_COLOR "      - Show this help\n");
+    write_str(ERDEMOS_COMMAND_COLOR "ionice -c cls cmd" ERDEMOS_PRIMARY_COLOR "   - Run a command with an I/O priority\n");
+    write_str(ERDEMOS_COMMAND_COLOR "kill [-sig] pid..." ERDEMOS_PRIMARY_COLOR "  - Send a signal to processes\n");
+    write_str(ERDEMOS_COMMAND_COLOR "license" ERDEMOS_PRIMARY_COLOR "             - Show license\n");
+    write_str(ERDEMOS_COMMAND_COLOR "limit -n N cmd" ERDEMOS_PRIMARY_COLOR "      - Run a command with resource limits\n");
+    write_str(ERDEMOS_COMMAND_COLOR "loadkeys [layout]" ERDEMOS_PRIMARY_COLOR "   - Load keyboard layout (us|trq|trf)\n");
+    write_str(ERDEMOS_COMMAND_COLOR "ls [-alhR] [dir]" ERDEMOS_PRIMARY_COLOR "    - List directory contents\n");
+    write_str(ERDEMOS_COMMAND_COLOR "mkdir [-p] dir..." ERDEMOS_PRIMARY_COLOR "   - Create directory\n");
+    write_str(ERDEMOS_COMMAND_COLOR "mount [-a] src dst" ERDEMOS_PRIMARY_COLOR "  - Mount a file system\n");
+    write_str(ERDEMOS_COMMAND_COLOR "mounts" ERDEMOS_PRIMARY_COLOR "              - List mounted file systems\n");
+    write_str(ERDEMOS_COMMAND_COLOR "mv [-nx] src dst" ERDEMOS_PRIMARY_COLOR "    - Move or rename files\n");
+    write_str(ERDEMOS_COMMAND_COLOR "nice [-n inc] cmd" ERDEMOS_PRIMARY_COLOR "   - Run a command with a niceness\n");
+    write_str(ERDEMOS_COMMAND_COLOR "pidof name..." ERDEMOS_PRIMARY_COLOR "       - Find processes by name\n");
+    write_str(ERDEMOS_COMMAND_COLOR "pkill [-sig] pat" ERDEMOS_PRIMARY_COLOR "    - Signal processes by name\n");
+    write_str(ERDEMOS_COMMAND_COLOR "poweroff" ERDEMOS_PRIMARY_COLOR "            - Exit shell and power off system\n");
+    write_str(ERDEMOS_COMMAND_COLOR "pwd" ERDEMOS_PRIMARY_COLOR "                 - Print working directory\n");
+    write_str(ERDEMOS_COMMAND_COLOR "renice prio pid" ERDEMOS_PRIMARY_COLOR "     - Change the niceness of processes\n");
+    write_str(ERDEMOS_COMMAND_COLOR "rm [-rf] [file/dir]" ERDEMOS_PRIMARY_COLOR " - Remove file or directory\n");
+    write_str(ERDEMOS_COMMAND_COLOR "sleep duration" ERDEMOS_PRIMARY_COLOR "      - Wait for a while\n");
+    write_str(ERDEMOS_COMMAND_COLOR "stat [-c fmt] file" ERDEMOS_PRIMARY_COLOR "  - Show file status\n");
+    write_str(ERDEMOS_COMMAND_COLOR "sysctl key[=value]" ERDEMOS_PRIMARY_COLOR "  - Show or set kernel tunables\n");
+    write_str(ERDEMOS_COMMAND_COLOR "taskset cpus cmd" ERDEMOS_PRIMARY_COLOR "    - Run a command on some CPUs\n");
+    write_str(ERDEMOS_COMMAND_COLOR "timeout dur cmd" ERDEMOS_PRIMARY_COLOR "     - Run a command with a time limit\n");
+    write_str(ERDEMOS_COMMAND_COLOR "touch [file...]" ERDEMOS_PRIMARY_COLOR "     - Create files or set their times\n");
+    write_str(ERDEMOS_COMMAND_COLOR "truncate -s size f" ERDEMOS_PRIMARY_COLOR "  - Set file size\n");
+    write_str(ERDEMOS_COMMAND_COLOR "ulimit [-a]" ERDEMOS_PRIMARY_COLOR "         - Show or set resource limits\n");
+    write_str(ERDEMOS_COMMAND_COLOR "umount [-l] dir" ERDEMOS_PRIMARY_COLOR "     - Unmount file systems\n");
+    write_str(ERDEMOS_COMMAND_COLOR "version" ERDEMOS_PRIMARY_COLOR "             - Show version\n");
+    write_str(ERDEMOS_COMMAND_COLOR "watch [-n s] cmd" ERDEMOS_PRIMARY_COLOR "    - Run a command repeatedly\n");
+    write_str("\nType " ERDEMOS_COMMAND_COLOR "'help [command]'" ERDEMOS_PRIMARY_COLOR " for detailed help on a specific command.\n");
+    return 0;
+}
+
+// Signal names, without the SIG prefix, indexed by number
+static const char *const signal_names[] = {
+    NULL, "HUP", "INT", "QUIT", "ILL", "TRAP", "ABRT", "BUS", "FPE", "KILL", "USR1",
+    "SEGV", "USR2", "PIPE", "ALRM", "TERM", "STKFLT", "CHLD", "CONT", "STOP", "TSTP",
+    "TTIN", "TTOU", "URG", "XCPU", "XFSZ", "VTALRM", "PROF", "WINCH", "IO", "PWR", "SYS",
+};
+
+#define SIGNAL_COUNT (int)(sizeof(signal_names) / sizeof(signal_names[0]))
+
+// A signal as a number, a name or a SIG-prefixed name; -1 if invalid
+static int signal_parse(const char *text) {
+    if (*text >= '0' && *text <= '9') {
+        char *end;
+        long sig = strtol(text, &end, 10);
+        return (*end == '\0' && sig >= 0 && sig < _NSIG) ? (int)sig : -1;
+    }
+    if (strncmp(text, "SIG", 3) == 0) {
+        text += 3;
+    }
+    for (int sig = 1; sig < SIGNAL_COUNT; sig++) {
+        if (strcmp(text, signal_names[sig]) == 0) {
+            return sig;
+        }
+    }
+    return -1;
+}
+
+// Parse a leading -SIG, -s SIG or -NUM option; returns the index of the
+// next argument, or -1 after reporting an invalid signal
+static int signal_option(char **args, int arg_idx, const char *cmd, int *sig) {
+    const char *text = NULL;
+    if (args[arg_idx] != NULL && strcmp(args[arg_idx], "-s") == 0 && args[arg_idx + 1] != NULL) {
+        text = args[arg_idx + 1];
+        arg_idx += 2;
+    } else if (args[arg_idx] != NULL && args[arg_idx][0] == '-' && args[arg_idx][1] != '\0' &&
+               strchr("fxl-", args[arg_idx][1]) == NULL) {
+        text = args[arg_idx] + 1;
+        arg_idx++;
+    }
+    if (text != NULL && (*sig = signal_parse(text)) < 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+        write_str(cmd);
+        write_str(": invalid signal: " COLOR_RESET);
+        write_str(text);
+        write_str("\n");
+        return -1;
+    }
+    return arg_idx;
+}
+
+// Send sig through a pidfd, so a pid that has been reused in the meantime
+// is never hit; kill() only where pidfds are not supported
+static int signal_pid(pid_t pid, int sig) {
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) {
+        return (errno == ENOSYS) ? kill(pid, sig) : -1;
+    }
+    int result = (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+    close(pidfd);
+    return result;
+}
+
+static int builtin_kill(char **args) {
+    if (args[1] != NULL && strcmp(args[1], "-l") == 0) {
+        for (int sig = 1; sig < SIGNAL_COUNT; sig++) {
+            out_str(ERDEMOS_PRIMARY_COLOR);
+            write_uint(sig);
+            out_str(" ");
+            out_str(signal_names[sig]);
+            out_str((sig % 8 == 0) ? "\n" : "\t");
+        }
+        out_str("\n" COLOR_RESET);
+        return 0;
+    }
+    
+    int sig = SIGTERM;
+    int arg_idx = signal_option(args, 1, "kill", &sig);
+    if (arg_idx < 0) {
+        return 1;
+    }
+    if (args[arg_idx] != NULL && strcmp(args[arg_idx], "--") == 0) {
+        arg_idx++;
+    }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: kill: missing pid" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    int status = 0;
+    for (; args[arg_idx] != NULL; arg_idx++) {
+        char *end;
+        long pid = strtol(args[arg_idx], &end, 10);
+        if (*end != '\0' || end == args[arg_idx]) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: kill: invalid pid: " COLOR_RESET);
+            write_str(args[arg_idx]);
+            write_str("\n");
+            status = 1;
+            continue;
+        }
+        // A negative pid is a process group, which has no pidfd
+        int result = (pid > 0) ? signal_pid((pid_t)pid, sig) : kill((pid_t)pid, sig);
+        if (result != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: kill: cannot signal: " COLOR_RESET);
+            write_str(args[arg_idx]);
+            write_str("\n");
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int builtin_license(char **args) {
+    (void)args;
+    write_str(ERDEMOS_PRIMARY_COLOR "Licensed under the Apache License, Version 2.0 (the \"License\");\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "you may not use this file except in compliance with the License.\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "You may obtain a copy of the License at\n\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "    http://www.apache.org/licenses/LICENSE-2.0\n\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "Unless required by applicable law or agreed to in writing, software\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "distributed under the License is distributed on an \"AS IS\" BASIS,\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "See the License for the specific language governing permissions and\n");
+    write_str(ERDEMOS_PRIMARY_COLOR "limitations under the License.\n" COLOR_RESET);
+    return 0;
+}
+
+static int builtin_loadkeys(char **args) {
+    if (args[1] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: missing argument" COLOR_RESET "\n");
+        write_str(ERDEMOS_PRIMARY_COLOR "Usage: " ERDEMOS_COMMAND_COLOR "loadkeys [us|trq|trf]" COLOR_RESET "\n");
         return 1;
     }
     
     const char *layout = args[1];
     
-    // Validate layout parameter
-    if (strcmp(layout, "us") != 0 && 
-        strcmp(layout, "trq") != 0 && 
-        strcmp(layout, "trf") != 0) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: invalid layout: " COLOR_RESET);
-        write_str(layout);
+    // Validate layout parameter
+    if (strcmp(layout, "us") != 0 && 
+        strcmp(layout, "trq") != 0 && 
+        strcmp(layout, "trf") != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: invalid layout: " COLOR_RESET);
+        write_str(layout);
+        write_str("\n");
+        write_str(ERDEMOS_PRIMARY_COLOR "Valid layouts: us, trq, trf\n" COLOR_RESET);
+        return 1;
+    }
+    
+    // Execute the loadkeys binary
+    pid_t pid = shell_fork();
+    if (pid == 0) {
+        // Child process
+        char *loadkeys_args[] = {"/bin/loadkeys", (char *)layout, NULL};
+        execv("/bin/loadkeys", loadkeys_args);
+        // If execv fails, show error
+        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: failed to execute /bin/loadkeys\n" COLOR_RESET);
+        out_flush();
+        _exit(1);
+    } else if (pid < 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: fork failed\n" COLOR_RESET);
+        return 1;
+    } else {
+        // Parent process - wait for child
+        int status;
+        waitpid(pid, &status, 0);
+        out_forget_style();
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+}
+
+// ls: directory listing
+//
+// A directory is read completely and sorted by name before it is printed.
+// With -R, every directory becomes an ls_node that a pool worker reads,
+// sorts and formats into the node's own buffer, queueing its
+// subdirectories as new nodes. The main thread walks the tree depth-first,
+// waiting for each node in turn, so the output is the same as a serial
+// walk no matter which worker finishes first.
+
+struct ls_options {
+    int color;              // Color names by type and extension
+    int show_all;
+    int long_format;
+    int human;              // -h sizes
+    int recursive;
+    int64_t now;            // Reference time for -l dates
+    int output;
+};
+
+struct ls_entry {
+    size_t name;            // Offset into ls_dir.names
+    unsigned char type;     // d_type, may be DT_UNKNOWN
+};
+
+struct ls_dir {
+    struct strbuf names;    // NUL-terminated names, back to back
+    struct ls_entry *entries;
+    size_t count;
+    size_t cap;
+};
+
+struct ls_node {
+    struct pool_task task;          // First member: the pool hands it back
+    const struct ls_options *opt;
+    char *path;
+    struct strbuf out;              // Formatted listing
+    struct ls_node **children;
+    size_t child_count;
+    size_t child_cap;
+    int failed;
+    int done;                       // Protected by the pool lock
+};
+
+static int ls_compare(const void *a, const void *b, void *names) {
+    const struct ls_entry *x = a;
+    const struct ls_entry *y = b;
+    return strcmp((const char *)names + x->name, (const char *)names + y->name);
+}
+
+// Read every entry of dir (skipping hidden ones unless show_all) and sort
+static void ls_read_dir(DIR *dir, int show_all, struct ls_dir *list) {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!show_all && entry->d_name[0] == '.') {
+            continue;
+        }
+        if (list->count == list->cap) {
+            size_t cap = (list->cap > 0) ? list->cap * 2 : 64;
+            struct ls_entry *grown = realloc(list->entries, cap * sizeof(*grown));
+            if (grown == NULL) {
+                break;
+            }
+            list->entries = grown;
+            list->cap = cap;
+        }
+        size_t offset = list->names.len;
+        sb_append(&list->names, entry->d_name, strlen(entry->d_name) + 1);
+        if (list->names.len == offset) {
+            break;
+        }
+        list->entries[list->count].name = offset;
+        list->entries[list->count].type = entry->d_type;
+        list->count++;
+    }
+    if (list->count > 1) {
+        qsort_r(list->entries, list->count, sizeof(*list->entries), ls_compare,
+                list->names.data);
+    }
+}
+
+static void ls_free_dir(struct ls_dir *list) {
+    sb_free(&list->names);
+    free(list->entries);
+}
+
+// ls colors
+//
+// Names are colored by file type, from d_type, and regular files also by
+// extension. The rules come from LS_COLORS (or LS_COLORS_DEFAULT) in the
+// dircolors format "di=1;34:*.tar=1;31:..." and are compiled once at
+// startup: type rules into ls_type_colors, extension rules into an
+// open-addressing hash table, so a lookup costs one hash of the name's
+// extension and no syscalls. fstatat is only needed for DT_UNKNOWN, or
+// for the executable bit when an "ex" rule is set (none by default).
+
+#define LS_COLORS_DEFAULT "di=1;34:ln=1;36:pi=33:so=1;35:bd=1;33:cd=1;33:" \
+                          "*.tar=1;31:*.gz=1;31:*.xz=1;31:*.zst=1;31:*.cpio=1;31:" \
+                          "*.sh=32:*.c=33:*.h=33"
+
+enum {
+    LS_COLOR_FILE,
+    LS_COLOR_DIR,
+    LS_COLOR_LINK,
+    LS_COLOR_FIFO,
+    LS_COLOR_SOCK,
+    LS_COLOR_BLK,
+    LS_COLOR_CHR,
+    LS_COLOR_EXEC,
+    LS_COLOR_TYPES
+};
+
+static const char *const ls_color_keys[LS_COLOR_TYPES] = {
+    "fi", "di", "ln", "pi", "so", "bd", "cd", "ex"
+};
+
+struct ls_color_rule {
+    uint32_t hash;
+    const char *ext;        // Lowercase, without the dot; NULL if the slot is free
+    const char *sgr;        // Complete escape sequence
+};
+
+static const char *ls_type_colors[LS_COLOR_TYPES];
+static struct ls_color_rule *ls_color_table;
+static uint32_t ls_color_mask;
+
+// FNV-1a over the ASCII-lowercased bytes of str[0..len)
+static uint32_t ls_color_hash(const char *str, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+static int ls_color_ext_equal(const char *rule, const char *ext, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = ext[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (rule[i] != c) {
+            return 0;
+        }
+    }
+    return rule[len] == '\0';
+}
+
+static void ls_color_insert(char *ext, const char *sgr) {
+    size_t len = strlen(ext);
+    for (size_t i = 0; i < len; i++) {
+        if (ext[i] >= 'A' && ext[i] <= 'Z') {
+            ext[i] += 'a' - 'A';
+        }
+    }
+    uint32_t hash = ls_color_hash(ext, len);
+    uint32_t slot = hash & ls_color_mask;
+    while (ls_color_table[slot].ext != NULL) {
+        if (ls_color_table[slot].hash == hash && strcmp(ls_color_table[slot].ext, ext) == 0) {
+            break;      // A later rule for the same extension wins
+        }
+        slot = (slot + 1) & ls_color_mask;
+    }
+    ls_color_table[slot].hash = hash;
+    ls_color_table[slot].ext = ext;
+    ls_color_table[slot].sgr = sgr;
+}
+
+// Compile LS_COLORS into the lookup tables; called once at startup
+static void ls_colors_init(void) {
+    const char *env = getenv("LS_COLORS");
+    char *spec = strdup((env != NULL) ? env : LS_COLORS_DEFAULT);
+    if (spec == NULL) {
+        return;
+    }
+    
+    // Size the table for a load factor of at most one half
+    uint32_t rules = 0;
+    for (const char *p = spec; *p != '\0'; p++) {
+        rules += (*p == ':');
+    }
+    uint32_t size = 16;
+    while (size < 2 * (rules + 1)) {
+        size *= 2;
+    }
+    ls_color_table = calloc(size, sizeof(*ls_color_table));
+    if (ls_color_table == NULL) {
+        free(spec);
+        return;
+    }
+    ls_color_mask = size - 1;
+    
+    // The spec is split in place; keys and extensions point into it
+    char *saveptr;
+    for (char *rule = strtok_r(spec, ":", &saveptr); rule != NULL;
+         rule = strtok_r(NULL, ":", &saveptr)) {
+        char *value = strchr(rule, '=');
+        if (value == NULL || value[1] == '\0') {
+            continue;
+        }
+        *value++ = '\0';
+        char *sgr = malloc(strlen(value) + 4);
+        if (sgr == NULL) {
+            break;
+        }
+        strcpy(sgr, "\033[");
+        strcat(sgr, value);
+        strcat(sgr, "m");
+        
+        if (rule[0] == '*' && rule[1] == '.' && rule[2] != '\0') {
+            ls_color_insert(rule + 2, sgr);
+            continue;
+        }
+        int type = 0;
+        while (type < LS_COLOR_TYPES && strcmp(rule, ls_color_keys[type]) != 0) {
+            type++;
+        }
+        if (type < LS_COLOR_TYPES) {
+            ls_type_colors[type] = sgr;
+        } else {
+            free(sgr);      // Unsupported key, e.g. "*README" or "or"
+        }
+    }
+}
+
+// Color for a name of the given d_type; mode is 0 unless the file was
+// stat'ed. Returns NULL when no rule applies.
+static const char *ls_color_for(const char *name, unsigned char type, mode_t mode) {
+    switch (type) {
+    case DT_DIR: return ls_type_colors[LS_COLOR_DIR];
+    case DT_LNK: return ls_type_colors[LS_COLOR_LINK];
+    case DT_FIFO: return ls_type_colors[LS_COLOR_FIFO];
+    case DT_SOCK: return ls_type_colors[LS_COLOR_SOCK];
+    case DT_BLK: return ls_type_colors[LS_COLOR_BLK];
+    case DT_CHR: return ls_type_colors[LS_COLOR_CHR];
+    }
+    if ((mode & (S_IXUSR | S_IXGRP | S_IXOTH)) && ls_type_colors[LS_COLOR_EXEC] != NULL) {
+        return ls_type_colors[LS_COLOR_EXEC];
+    }
+    const char *dot = strrchr(name, '.');
+    if (ls_color_table != NULL && dot != NULL && dot != name && dot[1] != '\0') {
+        const char *ext = dot + 1;
+        size_t len = strlen(ext);
+        uint32_t hash = ls_color_hash(ext, len);
+        for (uint32_t slot = hash & ls_color_mask; ls_color_table[slot].ext != NULL;
+             slot = (slot + 1) & ls_color_mask) {
+            if (ls_color_table[slot].hash == hash &&
+                ls_color_ext_equal(ls_color_table[slot].ext, ext, len)) {
+                return ls_color_table[slot].sgr;
+            }
+        }
+    }
+    return ls_type_colors[LS_COLOR_FILE];
+}
+
+// ls -l: owner names and times
+//
+// /etc/passwd and /etc/group are read once, on the first long listing,
+// into small open-addressing maps from id to name. /etc/localtime (TZif)
+// is read once too; the UTC offset of a time is found by a binary search
+// of its transitions, or UTC when there is no zone file. Times are then
+// formatted by hand with a per-day cache, so a directory of files from
+// the same day costs one date conversion, not a localtime() and strftime()
+// per entry. Everything is loaded by the main thread before any -R worker
+// starts, and is read-only afterwards.
+
+#define LS_RECENT_SECONDS (182LL * 24 * 3600)   // Older times show the year
+
+struct id_name {
+    uint32_t id;
+    const char *name;       // NULL if the slot is free
+};
+
+struct id_map {
+    struct id_name *slots;
+    uint32_t mask;
+    int loaded;
+};
+
+static struct id_map ls_users;
+static struct id_map ls_groups;
+
+static uint32_t id_map_hash(uint32_t id) {
+    return id * 2654435761u;
+}
+
+// Read a whole file into a NUL-terminated buffer
+static char *read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    size_t cap = 4096;
+    size_t used = 0;
+    char *data = malloc(cap);
+    while (data != NULL) {
+        if (used + 1 == cap) {
+            char *grown = realloc(data, cap * 2);
+            if (grown == NULL) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, data + used, cap - used - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            data[used] = '\0';
+            break;
+        }
+        used += n;
+    }
+    close(fd);
+    *len = used;
+    return data;
+}
+
+// Load "name:password:id:..." lines; the first entry for an id wins
+static void id_map_load(struct id_map *map, const char *path) {
+    map->loaded = 1;
+    size_t len;
+    char *text = read_file(path, &len);
+    if (text == NULL) {
+        return;
+    }
+    uint32_t lines = 1;
+    for (size_t i = 0; i < len; i++) {
+        lines += (text[i] == '\n');
+    }
+    uint32_t size = 16;
+    while (size < 2 * lines) {
+        size *= 2;
+    }
+    map->slots = calloc(size, sizeof(*map->slots));
+    if (map->slots == NULL) {
+        free(text);
+        return;
+    }
+    map->mask = size - 1;
+    
+    // Names point into text, which is kept for the life of the shell
+    char *line = text;
+    while (*line != '\0') {
+        char *end = strchr(line, '\n');
+        if (end != NULL) {
+            *end = '\0';
+        }
+        char *name_end = strchr(line, ':');
+        char *id_field = (name_end != NULL) ? strchr(name_end + 1, ':') : NULL;
+        if (id_field != NULL && id_field[1] >= '0' && id_field[1] <= '9') {
+            *name_end = '\0';
+            uint32_t id = (uint32_t)strtoul(id_field + 1, NULL, 10);
+            uint32_t slot = id_map_hash(id) & map->mask;
+            while (map->slots[slot].name != NULL && map->slots[slot].id != id) {
+                slot = (slot + 1) & map->mask;
+            }
+            if (map->slots[slot].name == NULL) {
+                map->slots[slot].id = id;
+                map->slots[slot].name = line;
+            }
+        }
+        if (end == NULL) {
+            break;
+        }
+        line = end + 1;
+    }
+}
+
+static const char *id_map_lookup(const struct id_map *map, uint32_t id) {
+    if (map->slots == NULL) {
+        return NULL;
+    }
+    for (uint32_t slot = id_map_hash(id) & map->mask; map->slots[slot].name != NULL;
+         slot = (slot + 1) & map->mask) {
+        if (map->slots[slot].id == id) {
+            return map->slots[slot].name;
+        }
+    }
+    return NULL;
+}
+
+// Id of a name, by a scan: only needed once per command; returns 0 or -1
+static int id_map_find(const struct id_map *map, const char *name, uint32_t *id) {
+    if (map->slots == NULL) {
+        return -1;
+    }
+    for (uint32_t slot = 0; slot <= map->mask; slot++) {
+        if (map->slots[slot].name != NULL && strcmp(map->slots[slot].name, name) == 0) {
+            *id = map->slots[slot].id;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+struct time_zone {
+    int64_t *times;         // Transition times, ascending
+    int32_t *offsets;       // UTC offset in effect from each transition on
+    size_t count;
+    int32_t initial;        // Offset before the first transition
+    int loaded;
+};
+
+static struct time_zone ls_zone;
+
+static int64_t tzif_int(const unsigned char *p, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value = (value << 8) | p[i];
+    }
+    // Sign-extend 32-bit values
+    if (size == 4) {
+        return (int32_t)(uint32_t)value;
+    }
+    return (int64_t)value;
+}
+
+// Parse the transitions of a TZif file, using the 64-bit data when the
+// file has it. The POSIX TZ footer for times after the last transition
+// is not evaluated; the last offset simply stays in effect.
+static void time_zone_load(struct time_zone *zone, const char *path) {
+    zone->loaded = 1;
+    size_t len;
+    unsigned char *data = (unsigned char *)read_file(path, &len);
+    if (data == NULL) {
+        return;
+    }
+    
+    const unsigned char *p = data;
+    const unsigned char *end = data + len;
+    int time_size = 4;
+    for (int pass = 0; pass < 2; pass++) {
+        if (end - p < 44 || memcmp(p, "TZif", 4) != 0) {
+            break;
+        }
+        int version = p[4];
+        uint32_t isutcnt = tzif_int(p + 20, 4);
+        uint32_t isstdcnt = tzif_int(p + 24, 4);
+        uint32_t leapcnt = tzif_int(p + 28, 4);
+        uint32_t timecnt = tzif_int(p + 32, 4);
+        uint32_t typecnt = tzif_int(p + 36, 4);
+        uint32_t charcnt = tzif_int(p + 40, 4);
+        p += 44;
+        size_t block = (size_t)timecnt * time_size + timecnt + typecnt * 6 + charcnt +
+                       (size_t)leapcnt * (time_size + 4) + isstdcnt + isutcnt;
+        if ((size_t)(end - p) < block || typecnt == 0) {
+            break;
+        }
+        if (pass == 0 && version >= '2') {
+            // Skip the 32-bit data in favour of the 64-bit block after it
+            p += block;
+            time_size = 8;
+            continue;
+        }
+        
+        const unsigned char *times = p;
+        const unsigned char *indexes = times + (size_t)timecnt * time_size;
+        const unsigned char *types = indexes + timecnt;
+        zone->times = malloc(timecnt * sizeof(*zone->times) + 1);
+        zone->offsets = malloc(timecnt * sizeof(*zone->offsets) + 1);
+        if (zone->times == NULL || zone->offsets == NULL) {
+            break;
+        }
+        // Before the first transition: the first standard-time type
+        zone->initial = tzif_int(types, 4);
+        for (uint32_t i = 0; i < typecnt; i++) {
+            if (types[i * 6 + 4] == 0) {
+                zone->initial = tzif_int(types + i * 6, 4);
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < timecnt; i++) {
+            uint32_t type = indexes[i];
+            if (type >= typecnt) {
+                type = 0;
+            }
+            zone->times[i] = tzif_int(times + (size_t)i * time_size, time_size);
+            zone->offsets[i] = tzif_int(types + type * 6, 4);
+        }
+        zone->count = timecnt;
+        break;
+    }
+    free(data);
+}
+
+// UTC offset at t, and the interval [*from, *until) it stays valid for
+static int32_t time_zone_offset(const struct time_zone *zone, int64_t t,
+                                int64_t *from, int64_t *until) {
+    size_t lo = 0;
+    size_t hi = zone->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (zone->times[mid] <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    // lo is the number of transitions at or before t
+    *from = (lo > 0) ? zone->times[lo - 1] : INT64_MIN;
+    *until = (lo < zone->count) ? zone->times[lo] : INT64_MAX;
+    return (lo > 0) ? zone->offsets[lo - 1] : zone->initial;
+}
+
+// Civil date from days since 1970-01-01 (proleptic Gregorian)
+static void civil_from_days(int64_t days, int64_t *year, int *month, int *day) {
+    days += 719468;
+    int64_t era = ((days >= 0) ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    *day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int)((mp < 10) ? mp + 3 : mp - 9);
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+// Days since 1970-01-01 from a civil date (proleptic Gregorian)
+static int64_t days_from_civil(int64_t year, int month, int day) {
+    year -= (month <= 2);
+    int64_t era = ((year >= 0) ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * ((month > 2) ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Incremental "Mon DD HH:MM" / "Mon DD  YYYY" formatter; one per thread
+struct time_format {
+    int64_t now;
+    int64_t from;           // Interval where offset applies
+    int64_t until;
+    int32_t offset;
+    int64_t day;            // Local day of the cached date, or INT64_MIN
+    char date[7];           // "Mon DD "
+    char year[5];           // " YYYY", right-aligned
+};
+
+static void time_format_init(struct time_format *tf, int64_t now) {
+    tf->now = now;
+    tf->from = 0;
+    tf->until = 0;          // Empty: the first call looks the offset up
+    tf->offset = 0;
+    tf->day = INT64_MIN;
+}
+
+static void sb_time(struct strbuf *sb, struct time_format *tf, int64_t t) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if (t < tf->from || t >= tf->until) {
+        tf->offset = time_zone_offset(&ls_zone, t, &tf->from, &tf->until);
+    }
+    int64_t local = t + tf->offset;
+    int64_t day = local / 86400;
+    int64_t seconds = local % 86400;
+    if (seconds < 0) {
+        seconds += 86400;
+        day--;
+    }
+    
+    if (day != tf->day) {
+        int64_t year;
+        int month, mday;
+        civil_from_days(day, &year, &month, &mday);
+        memcpy(tf->date, months + (month - 1) * 3, 3);
+        tf->date[3] = ' ';
+        tf->date[4] = (mday >= 10) ? '0' + mday / 10 : ' ';
+        tf->date[5] = '0' + mday % 10;
+        tf->date[6] = ' ';
+        memcpy(tf->year, "     ", 5);
+        for (int i = 4; i >= 0 && (i == 4 || year > 0); i--) {
+            tf->year[i] = '0' + year % 10;
+            year /= 10;
+        }
+        tf->day = day;
+    }
+    
+    sb_append(sb, tf->date, sizeof(tf->date));
+    if (t > tf->now - LS_RECENT_SECONDS && t <= tf->now + 3600) {
+        char clock[5] = {
+            '0' + seconds / 36000, '0' + seconds / 3600 % 10, ':',
+            '0' + seconds / 600 % 6, '0' + seconds / 60 % 10,
+        };
+        sb_append(sb, clock, sizeof(clock));
+    } else {
+        sb_append(sb, tf->year, 5);
+    }
+}
+
+// Load what long listings need, once per shell
+static void ls_long_init(void) {
+    if (!ls_users.loaded) {
+        id_map_load(&ls_users, "/etc/passwd");
+    }
+    if (!ls_groups.loaded) {
+        id_map_load(&ls_groups, "/etc/group");
+    }
+    if (!ls_zone.loaded) {
+        time_zone_load(&ls_zone, "/etc/localtime");
+    }
+}
+
+// Append an owner or group name, or the id when it has no name
+static void sb_id_name(struct strbuf *sb, const struct id_map *map, uint32_t id) {
+    const char *name = id_map_lookup(map, id);
+    if (name != NULL) {
+        sb_str_padded(sb, name, 8);
+        return;
+    }
+    char buf[12];
+    int i = sizeof(buf);
+    buf[--i] = '\0';
+    do {
+        buf[--i] = '0' + id % 10;
+        id /= 10;
+    } while (id > 0);
+    sb_str_padded(sb, buf + i, 8);
+}
+
+static void ls_add_child(struct ls_node *node, const char *name) {
+    if (node->child_count == node->child_cap) {
+        size_t cap = (node->child_cap > 0) ? node->child_cap * 2 : 8;
+        struct ls_node **grown = realloc(node->children, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return;
+        }
+        node->children = grown;
+        node->child_cap = cap;
+    }
+    size_t path_len = strlen(node->path);
+    size_t name_len = strlen(name);
+    struct ls_node *child = calloc(1, sizeof(*child));
+    char *path = malloc(path_len + name_len + 2);
+    if (child == NULL || path == NULL) {
+        free(child);
+        free(path);
+        return;
+    }
+    memcpy(path, node->path, path_len);
+    if (path_len == 0 || path[path_len - 1] != '/') {
+        path[path_len++] = '/';
+    }
+    memcpy(path + path_len, name, name_len + 1);
+    child->opt = node->opt;
+    child->path = path;
+    node->children[node->child_count++] = child;
+}
+
+// Read, sort and format one directory into node->out
+static void ls_list_dir(struct ls_node *node) {
+    const struct ls_options *opt = node->opt;
+    struct strbuf *out = &node->out;
+    
+    DIR *dir = opendir(node->path);
+    if (dir == NULL) {
+        sb_str(out, ERDEMOS_ERROR_COLOR "ersh: ls: cannot open directory: " COLOR_RESET);
+        sb_str(out, node->path);
+        sb_str(out, "\n");
+        node->failed = 1;
+        return;
+    }
+    if (opt->recursive) {
+        sb_str(out, ERDEMOS_PRIMARY_COLOR);
+        sb_str(out, node->path);
+        sb_str(out, ":\n");
+    }
+    
+    struct ls_dir list = {0};
+    ls_read_dir(dir, opt->show_all, &list);
+    int fd = dirfd(dir);
+    
+    struct time_format times;
+    time_format_init(&times, opt->now);
+    
+    // The executable bit needs a stat that plain listings do without
+    int want_exec = opt->color && ls_type_colors[LS_COLOR_EXEC] != NULL;
+    
+    for (size_t i = 0; i < list.count; i++) {
+        const char *name = list.names.data + list.entries[i].name;
+        unsigned char type = list.entries[i].type;
+        struct stat st;
+        mode_t mode = 0;
+        
+        int have_stat = 0;
+        if (opt->long_format || type == DT_UNKNOWN || (want_exec && type == DT_REG)) {
+            have_stat = (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0);
+        }
+        if (have_stat) {
+            mode = st.st_mode;
+            type = IFTODT(mode);
+        }
+        
+        const char *color = opt->color ? ls_color_for(name, type, mode) : NULL;
+        if (have_stat && opt->long_format) {
+            sb_str(out, ERDEMOS_PRIMARY_COLOR);
+            sb_permissions(out, st.st_mode);
+            sb_uint_aligned(out, st.st_nlink, 3);
+            sb_str(out, " ");
+            sb_id_name(out, &ls_users, st.st_uid);
+            sb_str(out, " ");
+            sb_id_name(out, &ls_groups, st.st_gid);
+            if (opt->human) {
+                sb_size_human(out, st.st_size, 6);
+            } else {
+                sb_uint_aligned(out, st.st_size, 10);
+            }
+            sb_str(out, " ");
+            sb_time(out, &times, st.st_mtim.tv_sec);
+            sb_str(out, "  ");
+            sb_str(out, (color != NULL) ? color : ERDEMOS_COMMAND_COLOR);
+            sb_str(out, name);
+            sb_str(out, "\n");
+        } else if (opt->long_format) {
+            // Fallback if stat fails
+            sb_str(out, ERDEMOS_PRIMARY_COLOR);
+            sb_str(out, name);
+            sb_str(out, "\n");
+        } else {
+            sb_str(out, (color != NULL) ? color : ERDEMOS_PRIMARY_COLOR);
+            sb_str(out, name);
+            sb_str(out, ERDEMOS_PRIMARY_COLOR "  ");
+        }
+        
+        // Symbolic links are never followed
+        if (opt->recursive && type == DT_DIR && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+            ls_add_child(node, name);
+        }
+    }
+    if (!opt->long_format) {
+        sb_str(out, "\n");
+    }
+    
+    ls_free_dir(&list);
+    closedir(dir);
+}
+
+static void ls_task_run(struct pool_task *task);
+
+static void ls_submit(struct ls_node *node) {
+    node->task.run = ls_task_run;
+    if (pool.threads > 0) {
+        pool_submit(&node->task);
+    } else {
+        ls_task_run(&node->task);   // No workers: walk serially
+    }
+}
+
+static void ls_task_run(struct pool_task *task) {
+    struct ls_node *node = (struct ls_node *)task;
+    ls_list_dir(node);
+    // This worker takes its newest task first: queue the last child first
+    // so subdirectories are listed in the order they are printed
+    for (size_t i = node->child_count; i > 0; i--) {
+        ls_submit(node->children[i - 1]);
+    }
+    pool_lock();
+    node->done = 1;
+    pool_done_signal();
+    pool_unlock();
+}
+
+// Print node and its subdirectories in order, freeing them as it goes
+static int ls_print_tree(struct ls_node *node) {
+    pool_lock();
+    while (!node->done) {
+        pool_done_wait();
+    }
+    pool_unlock();
+    
+    out_write(node->out.data, node->out.len);
+    sb_free(&node->out);
+    int status = node->failed;
+    for (size_t i = 0; i < node->child_count; i++) {
+        write_str("\n");
+        status |= ls_print_tree(node->children[i]);
+    }
+    free(node->children);
+    free(node->path);
+    free(node);
+    return status;
+}
+
+// --json and -0: one directory, written straight to the output buffer
+static int ls_machine_readable(const char *path, const struct ls_options *opt) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: ls: cannot open directory: " COLOR_RESET);
+        write_str(path);
+        write_str("\n");
+        return 1;
+    }
+    
+    struct ls_dir list = {0};
+    ls_read_dir(dir, opt->show_all, &list);
+    int fd = dirfd(dir);
+    
+    struct json_writer json = {0};
+    if (opt->output == OUTPUT_JSON) {
+        json_begin_array(&json);
+    }
+    for (size_t i = 0; i < list.count; i++) {
+        const char *name = list.names.data + list.entries[i].name;
+        
+        // Names only, each terminated by a NUL byte
+        if (opt->output == OUTPUT_NUL) {
+            out_raw(name, strlen(name) + 1);
+            continue;
+        }
+        
+        struct stat st;
+        int have_stat = opt->long_format &&
+                        fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+        json_begin_object(&json);
+        json_field_string(&json, "name", name);
+        json_field_string(&json, "type", have_stat ? mode_type_name(st.st_mode)
+                                                   : dirent_type_name(list.entries[i].type));
+        if (have_stat) {
+            json_field_uint(&json, "mode", st.st_mode & 07777);
+            json_field_uint(&json, "size", st.st_size);
+            json_field_uint(&json, "nlink", st.st_nlink);
+            json_field_uint(&json, "uid", st.st_uid);
+            json_field_uint(&json, "gid", st.st_gid);
+            const char *owner = id_map_lookup(&ls_users, st.st_uid);
+            const char *group = id_map_lookup(&ls_groups, st.st_gid);
+            if (owner != NULL) {
+                json_field_string(&json, "owner", owner);
+            }
+            if (group != NULL) {
+                json_field_string(&json, "group", group);
+            }
+            json_field_int(&json, "mtime", st.st_mtim.tv_sec);
+        }
+        json_end_object(&json);
+    }
+    if (opt->output == OUTPUT_JSON) {
+        json_end_array(&json);
+        out_raw("\n", 1);
+    }
+    
+    ls_free_dir(&list);
+    closedir(dir);
+    return 0;
+}
+
+static int builtin_ls(char **args) {
+    struct ls_options opt = { .output = OUTPUT_TEXT };
+    int arg_idx = 1;
+    const char *path = ".";
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        if (strcmp(args[arg_idx], "--json") == 0) {
+            opt.output = OUTPUT_JSON;
+            arg_idx++;
+            continue;
+        }
+        for (int i = 1; args[arg_idx][i] != '\0'; i++) {
+            if (args[arg_idx][i] == 'a') {
+                opt.show_all = 1;
+            } else if (args[arg_idx][i] == 'l') {
+                opt.long_format = 1;
+            } else if (args[arg_idx][i] == 'h') {
+                opt.human = 1;
+            } else if (args[arg_idx][i] == 'R') {
+                opt.recursive = 1;
+            } else if (args[arg_idx][i] == '0') {
+                opt.output = OUTPUT_NUL;
+            }
+        }
+        arg_idx++;
+    }
+    
+    // Get path if provided
+    if (args[arg_idx] != NULL) {
+        path = args[arg_idx];
+    }
+    
+    if (opt.long_format) {
+        ls_long_init();
+        opt.now = time(NULL);
+    }
+    
+    if (opt.output != OUTPUT_TEXT) {
+        if (opt.recursive) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: ls: -R cannot be combined with --json or -0" COLOR_RESET "\n");
+            return 1;
+        }
+        return ls_machine_readable(path, &opt);
+    }
+    
+    struct ls_node *root = calloc(1, sizeof(*root));
+    char *root_path = strdup(path);
+    if (root == NULL || root_path == NULL) {
+        free(root);
+        free(root_path);
+        write_str(ERDEMOS_ERROR_COLOR "ersh: ls: out of memory" COLOR_RESET "\n");
+        return 1;
+    }
+    opt.color = out_color_enabled();
+    root->opt = &opt;
+    root->path = root_path;
+    if (opt.recursive) {
+        pool_start();
+    }
+    ls_submit(root);
+    int status = ls_print_tree(root);
+    write_str(COLOR_RESET);
+    return status;
+}
+
+// Shell-wide io_uring, set up on first use; NULL when unavailable. The
+// kernel runs file creation from io_uring on worker threads, which only
+// pays off with a CPU to spare, so by default the ring is only used on
+// SMP systems. ERSH_URING=1 forces it on, ERSH_URING=0 off. The ring fd
+// is close-on-exec.
+static struct uring *shell_uring(void) {
+    static struct uring ring;
+    static int state;       // 0 untried, 1 ready, -1 unavailable
+    if (state == 0) {
+        const char *env = getenv("ERSH_URING");
+        int wanted = (env != NULL) ? strcmp(env, "0") != 0
+                                   : sysconf(_SC_NPROCESSORS_ONLN) > 1;
+        state = (wanted && uring_init(&ring, URING_BATCH) == 0) ? 1 : -1;
+    }
+    return (state > 0) ? &ring : NULL;
+}
+
+// mkdir: openat chains and batched creation
+//
+// The directory fds of the previous path's parent are kept in a chain,
+// so consecutive paths with a common prefix (a/b/1, a/b/2, ...) only
+// resolve the components that differ, each relative to its parent fd
+// instead of from the start of the path. The last component is created
+// with mkdirat() on its parent fd; with many paths those calls are queued
+// on the shell's io_uring and submitted in batches. Chain fds replaced
+// while a batch is queued are closed after the batch completes.
+
+#define MKDIR_MAX_DEPTH 128
+
+struct mkdir_pending {
+    int parent;
+    int index;              // Argument index, for errors
+};
+
+struct mkdir_state {
+    char **args;
+    int parents;            // -p
+    struct uring *ring;
+    struct mkdir_pending pending[URING_BATCH];
+    int closing[URING_BATCH];
+    int closing_count;
+    int absolute;           // The chain starts at "/" rather than the cwd
+    int base;
+    const char *names[MKDIR_MAX_DEPTH];
+    size_t lens[MKDIR_MAX_DEPTH];
+    int fds[MKDIR_MAX_DEPTH];
+    int depth;
+    int status;
+};
+
+static void mkdir_error(const char *path) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: mkdir: cannot create directory: " COLOR_RESET);
+    write_str(path);
+    write_str("\n");
+}
+
+// Whether a failed mkdirat is fine: -p and a directory is already there
+static int mkdir_exists_ok(struct mkdir_state *st, int parent, const char *name, int err) {
+    struct stat sb;
+    return st->parents && err == EEXIST &&
+           fstatat(parent, name, &sb, 0) == 0 && S_ISDIR(sb.st_mode);
+}
+
+static void mkdir_flush(struct mkdir_state *st) {
+    struct uring *ring = st->ring;
+    if (ring != NULL && ring->queued > 0) {
+        unsigned count = ring->queued;
+        unsigned submitted = uring_submit_wait(ring);
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_cqe(ring)) != NULL) {
+            struct mkdir_pending *p = &st->pending[cqe->user_data];
+            char *path = st->args[p->index];
+            const char *leaf = strrchr(path, '/');
+            leaf = (leaf != NULL) ? leaf + 1 : path;
+            if (cqe->res < 0 && !mkdir_exists_ok(st, p->parent, leaf, -cqe->res)) {
+                mkdir_error(path);
+                st->status = 1;
+            }
+            uring_cqe_seen(ring);
+        }
+        // Entries the kernel did not take: create them one by one
+        for (unsigned i = submitted; i < count; i++) {
+            struct mkdir_pending *p = &st->pending[i];
+            char *path = st->args[p->index];
+            const char *leaf = strrchr(path, '/');
+            leaf = (leaf != NULL) ? leaf + 1 : path;
+            if (mkdirat(p->parent, leaf, 0755) != 0 && !mkdir_exists_ok(st, p->parent, leaf, errno)) {
+                mkdir_error(path);
+                st->status = 1;
+            }
+        }
+    }
+    for (int i = 0; i < st->closing_count; i++) {
+        close(st->closing[i]);
+    }
+    st->closing_count = 0;
+}
+
+// Drop chain entries from depth on; their fds may still be queued
+static void mkdir_truncate(struct mkdir_state *st, int depth) {
+    while (st->depth > depth) {
+        int fd = st->fds[--st->depth];
+        if (st->ring == NULL || st->ring->queued == 0) {
+            close(fd);
+            continue;
+        }
+        if (st->closing_count == URING_BATCH) {
+            mkdir_flush(st);
+            close(fd);
+            continue;
+        }
+        st->closing[st->closing_count++] = fd;
+    }
+}
+
+// Open (with -p: create) one component below parent
+static int mkdir_open_component(struct mkdir_state *st, int parent, const char *name, size_t len) {
+    char buf[NAME_MAX + 1];
+    if (len > NAME_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    int fd = openat(parent, buf, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0 || errno != ENOENT) {
+        return fd;
+    }
+    if (st->parents) {
+        if (mkdirat(parent, buf, 0755) != 0 && errno != EEXIST) {
+            return -1;
+        }
+    } else if (st->ring != NULL && st->ring->queued > 0) {
+        mkdir_flush(st);    // An earlier argument may create it
+    } else {
+        return -1;
+    }
+    return openat(parent, buf, O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Bring the chain to the parent of path; returns the parent fd, or -1
+static int mkdir_walk(struct mkdir_state *st, const char *path, const char *leaf) {
+    int absolute = (path[0] == '/');
+    if (absolute != st->absolute) {
+        mkdir_truncate(st, 0);
+        if (st->base != AT_FDCWD) {
+            close(st->base);
+        }
+        st->base = AT_FDCWD;
+        st->absolute = 0;
+        if (absolute) {
+            int root = open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+            if (root < 0) {
+                return -1;
+            }
+            st->base = root;
+            st->absolute = 1;
+        }
+    }
+    
+    int depth = 0;
+    const char *p = path;
+    while (1) {
+        while (*p == '/') {
+            p++;
+        }
+        if (p >= leaf) {
+            break;
+        }
+        const char *end = p;
+        while (*end != '/') {
+            end++;
+        }
+        size_t len = end - p;
+        if (depth < st->depth && (st->lens[depth] != len || memcmp(st->names[depth], p, len) != 0)) {
+            mkdir_truncate(st, depth);
+        }
+        if (depth == st->depth) {
+            if (depth == MKDIR_MAX_DEPTH) {
+                errno = ENAMETOOLONG;
+                return -1;
+            }
+            int parent = (depth > 0) ? st->fds[depth - 1] : st->base;
+            int fd = mkdir_open_component(st, parent, p, len);
+            if (fd < 0) {
+                return -1;
+            }
+            st->names[depth] = p;
+            st->lens[depth] = len;
+            st->fds[depth] = fd;
+            st->depth++;
+        }
+        depth++;
+        p = end;
+    }
+    mkdir_truncate(st, depth);
+    return (depth > 0) ? st->fds[depth - 1] : st->base;
+}
+
+static int builtin_mkdir(char **args) {
+    struct mkdir_state *st = calloc(1, sizeof(*st));
+    if (st == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mkdir: out of memory" COLOR_RESET "\n");
+        return 1;
+    }
+    st->args = args;
+    st->base = AT_FDCWD;
+    
+    int arg_idx = 1;
+    if (args[arg_idx] != NULL && strcmp(args[arg_idx], "-p") == 0) {
+        st->parents = 1;
+        arg_idx++;
+    }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mkdir: missing argument" COLOR_RESET "\n");
+        free(st);
+        return 1;
+    }
+    int count = 0;
+    while (args[arg_idx + count] != NULL) {
+        count++;
+    }
+    if (count >= URING_MIN_BATCH) {
+        st->ring = shell_uring();
+    }
+    
+    for (; args[arg_idx] != NULL; arg_idx++) {
+        char *path = args[arg_idx];
+        
+        // Strip trailing slashes; what is left after the last one is the leaf
+        size_t len = strlen(path);
+        while (len > 1 && path[len - 1] == '/') {
+            path[--len] = '\0';
+        }
+        char *leaf = strrchr(path, '/');
+        leaf = (leaf != NULL) ? leaf + 1 : path;
+        
+        int parent = mkdir_walk(st, path, leaf);
+        if (parent == -1) {
+            mkdir_error(path);
+            st->status = 1;
+            continue;
+        }
+        if (*leaf == '\0') {
+            // "/": it exists, which is only fine with -p
+            if (!st->parents) {
+                mkdir_error(path);
+                st->status = 1;
+            }
+            continue;
+        }
+        
+        struct io_uring_sqe *sqe = NULL;
+        if (st->ring != NULL) {
+            if (st->ring->queued == st->ring->entries) {
+                mkdir_flush(st);
+            }
+            sqe = uring_sqe(st->ring);
+        }
+        if (sqe != NULL) {
+            unsigned slot = st->ring->queued - 1;
+            st->pending[slot].parent = parent;
+            st->pending[slot].index = arg_idx;
+            sqe->opcode = IORING_OP_MKDIRAT;
+            sqe->fd = parent;
+            sqe->addr = (uintptr_t)leaf;
+            sqe->len = 0755;
+            sqe->user_data = slot;
+            continue;
+        }
+        if (mkdirat(parent, leaf, 0755) != 0 && !mkdir_exists_ok(st, parent, leaf, errno)) {
+            mkdir_error(path);
+            st->status = 1;
+        }
+    }
+    
+    mkdir_flush(st);
+    mkdir_truncate(st, 0);
+    if (st->base != AT_FDCWD) {
+        close(st->base);
+    }
+    int status = st->status;
+    free(st);
+    return status;
+}
+
+static int builtin_mounts(char **args) {
+    int json_output = args[1] != NULL && strcmp(args[1], "--json") == 0;
+    struct mount_table table;
+    if (mount_table_load(&table) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mounts: cannot read /proc/self/mountinfo" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    struct json_writer json = {0};
+    if (json_output) {
+        json_begin_array(&json);
+    }
+    for (size_t i = 0; i < table.count; i++) {
+        const struct mount_entry *entry = &table.entries[i];
+        if (json_output) {
+            json_begin_object(&json);
+            json_field_uint(&json, "id", entry->id);
+            json_field_uint(&json, "parent", entry->parent);
+            json_field_string(&json, "source", entry->source);
+            json_field_string(&json, "target", entry->target);
+            json_field_string(&json, "type", entry->fstype);
+            json_field_string(&json, "root", entry->root);
+            json_field_string(&json, "options", entry->options);
+            json_field_string(&json, "super_options", entry->super_options);
+            json_end_object(&json);
+            continue;
+        }
+        // source on target type fstype (options), as mount prints it
+        out_str(ERDEMOS_PRIMARY_COLOR);
+        out_str(entry->source);
+        out_str(" on ");
+        out_str(entry->target);
+        out_str(" type ");
+        out_str(entry->fstype);
+        out_str(" (");
+        out_str(entry->options);
+        // The file system's own options, less its read-only state
+        const char *super = entry->super_options;
+        if (strncmp(super, "rw", 2) == 0 || strncmp(super, "ro", 2) == 0) {
+            super += (super[2] == ',') ? 3 : (super[2] == '\0') ? 2 : 0;
+        }
+        if (*super != '\0') {
+            out_str(",");
+            out_str(super);
+        }
+        out_str(")\n" COLOR_RESET);
+    }
+    if (json_output) {
+        json_end_array(&json);
+        out_str("\n");
+    }
+    mount_table_free(&table);
+    return 0;
+}
+
+// Report fstab entries that could not be mounted
+static void mount_report(const struct fstab_entry *entry) {
+    if (entry->error == 0) {
+        return;
+    }
+    write_str(ERDEMOS_ERROR_COLOR "ersh: mount: ");
+    write_str(entry->skipped ? "parent not mounted: " COLOR_RESET : "cannot mount: " COLOR_RESET);
+    write_str(entry->target);
+    write_str("\n");
+}
+
+static int builtin_mount(char **args) {
+    const char *type = NULL;
+    const char *options = NULL;
+    int all = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        if (strcmp(args[arg_idx], "-t") == 0 || strcmp(args[arg_idx], "-o") == 0) {
+            if (args[arg_idx + 1] == NULL) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: mount: missing value for " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                return 1;
+            }
+            *((args[arg_idx][1] == 't') ? &type : &options) = args[arg_idx + 1];
+            arg_idx++;
+        } else if (strcmp(args[arg_idx], "-a") == 0) {
+            all = 1;
+        } else {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: mount: invalid option: " COLOR_RESET);
+            write_str(args[arg_idx]);
+            write_str("\n");
+            return 1;
+        }
+        arg_idx++;
+    }
+    
+    if (all) {
+        int failed = fstab_mount_all("/etc/fstab", mount_report);
+        if (failed < 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: mount: cannot read /etc/fstab" COLOR_RESET "\n");
+        }
+        return failed != 0;
+    }
+    if (args[arg_idx] == NULL) {
+        return builtin_mounts(args);
+    }
+    if (args[arg_idx + 1] == NULL || args[arg_idx + 2] != NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mount: expected source and target" COLOR_RESET "\n");
+        return 1;
+    }
+    // There is no probing of the file system type
+    if (type == NULL && !mount_has_option(options, "bind")) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mount: -t type is required" COLOR_RESET "\n");
+        return 1;
+    }
+    if (mount_fs(args[arg_idx], args[arg_idx + 1], type, options) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mount: cannot mount: " COLOR_RESET);
+        write_str(args[arg_idx + 1]);
+        write_str("\n");
+        return 1;
+    }
+    return 0;
+}
+
+// mv: rename, or copy and remove across file systems
+//
+// A move is one renameat2() into a cached fd of the destination
+// directory. Only when that fails with EXDEV is the source copied: file
+// data with copy_file_range(), or sendfile() where the kernel refuses a
+// cross-file-system range, so it never passes through a user space
+// buffer. Each directory of a tree is a pool task that copies its files
+// and queues its subdirectories, so large trees copy in parallel. The
+// source is removed only once the whole copy has succeeded.
+
+struct mv_job {
+    int no_clobber;                 // -n
+    int outstanding;                // Directory tasks not finished, under the pool lock
+    int failed;
+    struct strbuf errors;           // Messages from workers, under the pool lock
+    struct mv_dir *dirs;            // Every directory task, for the final pass
+};
+
+struct mv_dir {
+    struct pool_task task;          // First member: the pool hands it back
+    struct mv_job *job;
+    char *src;
+    char *dst;
+    struct stat st;
+    struct mv_dir *next;
+};
+
+static void mv_error(const char *what, const char *path) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: mv: ");
+    write_str(what);
+    write_str(": " COLOR_RESET);
+    write_str(path);
+    write_str("\n");
+}
+
+// Record an error from any thread; printed by the main thread
+static void mv_job_fail(struct mv_job *job, const char *path) {
+    pool_lock();
+    job->failed = 1;
+    sb_str(&job->errors, ERDEMOS_ERROR_COLOR "ersh: mv: cannot copy: " COLOR_RESET);
+    sb_str(&job->errors, path);
+    sb_str(&job->errors, "\n");
+    pool_unlock();
+}
+
+static char *path_join(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+    if (path != NULL) {
+        memcpy(path, dir, dir_len);
+        if (dir_len == 0 || path[dir_len - 1] != '/') {
+            path[dir_len++] = '/';
+        }
+        memcpy(path + dir_len, name, name_len + 1);
+    }
+    return path;
+}
+
+// Copy file data inside the kernel until end of file
+static int copy_file_data(int in, int out) {
+    int use_sendfile = 0;
+    while (1) {
+        ssize_t n;
+        if (!use_sendfile) {
+            n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+            if (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                use_sendfile = 1;
+                continue;
+            }
+        } else {
+            n = sendfile(out, in, NULL, 1 << 30);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return (int)n;
+        }
+    }
+}
+
+// Copy anything but a directory, keeping mode, owner and times
+static int mv_copy_node(const char *src, const char *dst, const struct stat *st, int no_clobber) {
+    struct timespec times[2] = { st->st_atim, st->st_mtim };
+    if (S_ISREG(st->st_mode)) {
+        int in = open(src, O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            return -1;
+        }
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (no_clobber ? O_EXCL : O_TRUNC);
+        int out = open(dst, flags, st->st_mode & 07777);
+        if (out < 0) {
+            close(in);
+            return -1;
+        }
+        int result = copy_file_data(in, out);
+        if (fchown(out, st->st_uid, st->st_gid) != 0) {
+            // Not being allowed to keep the owner is not an error
+        }
+        fchmod(out, st->st_mode & 07777);
+        futimens(out, times);
+        close(in);
+        if (close(out) != 0) {
+            result = -1;
+        }
+        return result;
+    }
+    if (!no_clobber) {
+        unlink(dst);
+    }
+    if (S_ISLNK(st->st_mode)) {
+        char target[PATH_MAX];
+        ssize_t len = readlink(src, target, sizeof(target) - 1);
+        if (len < 0) {
+            return -1;
+        }
+        target[len] = '\0';
+        if (symlink(target, dst) != 0) {
+            return -1;
+        }
+        if (lchown(dst, st->st_uid, st->st_gid) != 0) {
+            // As above
+        }
+    } else if (mknod(dst, st->st_mode, st->st_rdev) != 0) {
+        return -1;
+    } else if (chown(dst, st->st_uid, st->st_gid) != 0) {
+        // As above
+    }
+    return utimensat(AT_FDCWD, dst, times, AT_SYMLINK_NOFOLLOW);
+}
+
+static void mv_dir_run(struct pool_task *task);
+
+// Queue the copy of one directory; the job owns the task from here on
+static void mv_dir_submit(struct mv_job *job, char *src, char *dst, const struct stat *st) {
+    struct mv_dir *dir = calloc(1, sizeof(*dir));
+    if (dir == NULL) {
+        mv_job_fail(job, src);
+        free(src);
+        free(dst);
+        return;
+    }
+    dir->job = job;
+    dir->src = src;
+    dir->dst = dst;
+    dir->st = *st;
+    dir->task.run = mv_dir_run;
+    pool_lock();
+    dir->next = job->dirs;
+    job->dirs = dir;
+    job->outstanding++;
+    pool_unlock();
+    if (pool.threads > 0) {
+        pool_submit(&dir->task);
+    } else {
+        mv_dir_run(&dir->task);     // No workers: copy serially
+    }
+}
+
+static void mv_dir_run(struct pool_task *task) {
+    struct mv_dir *dir = (struct mv_dir *)task;
+    struct mv_job *job = dir->job;
+    
+    DIR *stream = NULL;
+    // The directory is writable by us until the final pass sets its mode
+    if (mkdir(dir->dst, 0700) != 0 && (job->no_clobber || errno != EEXIST)) {
+        mv_job_fail(job, dir->dst);
+    } else if ((stream = opendir(dir->src)) == NULL) {
+        mv_job_fail(job, dir->src);
+    } else {
+        struct dirent *entry;
+        while ((entry = readdir(stream)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            char *src = path_join(dir->src, entry->d_name);
+            char *dst = path_join(dir->dst, entry->d_name);
+            struct stat st;
+            if (src == NULL || dst == NULL || lstat(src, &st) != 0) {
+                mv_job_fail(job, (src != NULL) ? src : dir->src);
+                free(src);
+                free(dst);
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                mv_dir_submit(job, src, dst, &st);
+                continue;
+            }
+            if (mv_copy_node(src, dst, &st, job->no_clobber) != 0) {
+                mv_job_fail(job, src);
+            }
+            free(src);
+            free(dst);
+        }
+        closedir(stream);
+    }
+    
+    pool_lock();
+    if (--job->outstanding == 0) {
+        pool_done_signal();
+    }
+    pool_unlock();
+}
+
+// Copy src to dst after a failed rename, then remove src
+static int mv_copy_and_remove(const char *src, const char *dst, int no_clobber) {
+    struct stat st;
+    if (lstat(src, &st) != 0) {
+        mv_error("cannot stat", src);
+        return 1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        if (mv_copy_node(src, dst, &st, no_clobber) != 0) {
+            mv_error("cannot copy", src);
+            return 1;
+        }
+        if (unlink(src) != 0) {
+            mv_error("cannot remove", src);
+            return 1;
+        }
+        return 0;
+    }
+    
+    struct mv_job job = { .no_clobber = no_clobber };
+    char *src_copy = strdup(src);
+    char *dst_copy = strdup(dst);
+    if (src_copy == NULL || dst_copy == NULL) {
+        free(src_copy);
+        free(dst_copy);
+        mv_error("out of memory", src);
+        return 1;
+    }
+    pool_start();
+    mv_dir_submit(&job, src_copy, dst_copy, &st);
+    pool_lock();
+    while (job.outstanding > 0) {
+        pool_done_wait();
+    }
+    pool_unlock();
+    
+    // Directory modes and times last, now that nothing is written into them
+    while (job.dirs != NULL) {
+        struct mv_dir *dir = job.dirs;
+        struct timespec times[2] = { dir->st.st_atim, dir->st.st_mtim };
+        if (chown(dir->dst, dir->st.st_uid, dir->st.st_gid) != 0) {
+            // Not being allowed to keep the owner is not an error
+        }
+        chmod(dir->dst, dir->st.st_mode & 07777);
+        utimensat(AT_FDCWD, dir->dst, times, 0);
+        job.dirs = dir->next;
+        free(dir->src);
+        free(dir->dst);
+        free(dir);
+    }
+    
+    out_write(job.errors.data, job.errors.len);
+    sb_free(&job.errors);
+    if (job.failed) {
+        mv_error("not removed after failed copy", src);
+        return 1;
+    }
+    if (remove_directory_recursive(src) != 0) {
+        mv_error("cannot remove", src);
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_mv(char **args) {
+    unsigned int flags = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        for (int i = 1; args[arg_idx][i] != '\0'; i++) {
+            if (args[arg_idx][i] == 'n') {
+                flags |= RENAME_NOREPLACE;
+            } else if (args[arg_idx][i] == 'x') {
+                flags |= RENAME_EXCHANGE;
+            } else {
+                mv_error("invalid option", args[arg_idx]);
+                return 1;
+            }
+        }
+        arg_idx++;
+    }
+    
+    int count = 0;
+    while (args[arg_idx + count] != NULL) {
+        count++;
+    }
+    if (count < 2) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mv: missing argument" COLOR_RESET "\n");
+        return 1;
+    }
+    if (flags == (RENAME_NOREPLACE | RENAME_EXCHANGE)) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: mv: -n and -x cannot be combined" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // Exchange two paths
+    char *dest = args[arg_idx + count - 1];
+    if (flags & RENAME_EXCHANGE) {
+        if (count != 2) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: mv: -x takes exactly two paths" COLOR_RESET "\n");
+            return 1;
+        }
+        if (syscall(SYS_renameat2, AT_FDCWD, args[arg_idx], AT_FDCWD, dest, RENAME_EXCHANGE) != 0) {
+            mv_error("cannot exchange", args[arg_idx]);
+            return 1;
+        }
+        return 0;
+    }
+    
+    // Into a directory: one fd for every rename
+    int dest_fd = open(dest, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dest_fd < 0 && count > 2) {
+        mv_error("target is not a directory", dest);
+        return 1;
+    }
+    
+    int status = 0;
+    for (int i = 0; i < count - 1; i++) {
+        char *src = args[arg_idx + i];
+        size_t len = strlen(src);
+        while (len > 1 && src[len - 1] == '/') {
+            src[--len] = '\0';
+        }
+        
+        const char *name = dest;
+        char *target = NULL;
+        if (dest_fd >= 0) {
+            const char *slash = strrchr(src, '/');
+            name = (slash != NULL) ? slash + 1 : src;
+            target = path_join(dest, name);
+            if (target == NULL) {
+                mv_error("out of memory", src);
+                status = 1;
+                continue;
+            }
+        }
+        int dir_fd = (dest_fd >= 0) ? dest_fd : AT_FDCWD;
+        if (syscall(SYS_renameat2, AT_FDCWD, src, dir_fd, name, flags) == 0) {
+            free(target);
+            continue;
+        }
+        if (errno == EXDEV) {
+            status |= mv_copy_and_remove(src, (target != NULL) ? target : dest, flags != 0);
+        } else if (errno == EEXIST) {
+            mv_error("target exists", (target != NULL) ? target : dest);
+            status = 1;
+        } else {
+            mv_error("cannot move", src);
+            status = 1;
+        }
+        free(target);
+    }
+    
+    if (dest_fd >= 0) {
+        close(dest_fd);
+    }
+    return status;
+}
+
+// chmod and chown
+//
+// Both change one directory entry at a time relative to an open fd of its
+// directory (fchmodat/fchownat), so no path is resolved twice. With -R
+// each directory is a pool task; a directory fd stays open until all of
+// its subdirectories have been opened from it, so a depth-first walk keeps
+// only a few fds. A mode is parsed once into an and/or mask pair, so the
+// new mode of each file is (old & and) | or.
+
+struct mode_change {
+    mode_t and_mask;
+    mode_t or_mask;
+    mode_t x_and_mask;              // The pair for directories and executables,
+    mode_t x_or_mask;               // which differs only when X is used
+};
+
+// Parse an octal mode or symbolic clauses like "u+x,go-w,a=rX"
+static int mode_change_parse(const char *text, struct mode_change *change) {
+    if (*text >= '0' && *text <= '7') {
+        char *end;
+        unsigned long mode = strtoul(text, &end, 8);
+        if (*end != '\0' || mode > 07777) {
+            return -1;
+        }
+        change->and_mask = change->x_and_mask = 0;
+        change->or_mask = change->x_or_mask = (mode_t)mode;
+        return 0;
+    }
+    
+    mode_t mask = umask(0);
+    umask(mask);
+    change->and_mask = change->x_and_mask = 07777;
+    change->or_mask = change->x_or_mask = 0;
+    const char *p = text;
+    while (1) {
+        mode_t who = 0;
+        for (; *p != '\0' && strchr("ugoa", *p) != NULL; p++) {
+            who |= (*p == 'u') ? (S_ISUID | S_IRWXU) :
+                   (*p == 'g') ? (S_ISGID | S_IRWXG) :
+                   (*p == 'o') ? (S_ISVTX | S_IRWXO) : 07777;
+        }
+        // Without u, g, o or a the umask bits are left alone
+        mode_t allowed = (who != 0) ? who : (07777 & ~mask);
+        mode_t clear = (who != 0) ? who : 07777;
+        if (*p != '+' && *p != '-' && *p != '=') {
+            return -1;
+        }
+        while (*p == '+' || *p == '-' || *p == '=') {
+            char op = *p++;
+            mode_t bits = 0;
+            mode_t x_bits = 0;
+            for (; *p != '\0' && *p != ',' && *p != '+' && *p != '-' && *p != '='; p++) {
+                if (*p == 'r') {
+                    bits |= 0444;
+                } else if (*p == 'w') {
+                    bits |= 0222;
+                } else if (*p == 'x') {
+                    bits |= 0111;
+                } else if (*p == 'X') {
+                    x_bits |= 0111;
+                } else if (*p == 's') {
+                    bits |= S_ISUID | S_ISGID;
+                } else if (*p == 't') {
+                    bits |= S_ISVTX;
+                } else {
+                    return -1;
+                }
+            }
+            bits &= allowed;
+            x_bits = (x_bits & allowed) | bits;
+            if (op == '=') {
+                change->and_mask &= ~clear;
+                change->or_mask &= ~clear;
+                change->x_and_mask &= ~clear;
+                change->x_or_mask &= ~clear;
+            }
+            if (op == '-') {
+                change->and_mask &= ~bits;
+                change->or_mask &= ~bits;
+                change->x_and_mask &= ~x_bits;
+                change->x_or_mask &= ~x_bits;
+            } else {
+                change->or_mask |= bits;
+                change->x_or_mask |= x_bits;
+            }
+        }
+        if (*p == '\0') {
+            return 0;
+        }
+        if (*p++ != ',') {
+            return -1;
+        }
+    }
+}
+
+static mode_t mode_change_apply(const struct mode_change *change, mode_t mode) {
+    if (S_ISDIR(mode) || (mode & 0111)) {
+        return (mode & change->x_and_mask) | change->x_or_mask;
+    }
+    return (mode & change->and_mask) | change->or_mask;
+}
+
+struct perm_job {
+    const char *cmd;                // "chmod" or "chown"
+    int chown;
+    struct mode_change mode;
+    int need_stat;                  // The new mode depends on the old one
+    uid_t uid;                      // -1 to keep
+    gid_t gid;
+    int outstanding;                // Directory tasks not finished, under the pool lock
+    int failed;
+    struct strbuf errors;           // Messages from workers, under the pool lock
+};
+
+// An open directory, shared by the tasks of its subdirectories
+struct perm_dir {
+    DIR *stream;
+    int fd;
+    int refs;                       // Atomic
+};
+
+static struct perm_dir perm_cwd = { .fd = AT_FDCWD };
+
+struct perm_task {
+    struct pool_task task;          // First member: the pool hands it back
+    struct perm_job *job;
+    struct perm_dir *parent;
+    char *path;
+};
+
+static void perm_job_fail(struct perm_job *job, const char *what, const char *path) {
+    pool_lock();
+    job->failed = 1;
+    sb_str(&job->errors, ERDEMOS_ERROR_COLOR "ersh: ");
+    sb_str(&job->errors, job->cmd);
+    sb_str(&job->errors, ": ");
+    sb_str(&job->errors, what);
+    sb_str(&job->errors, ": " COLOR_RESET);
+    sb_str(&job->errors, path);
+    sb_str(&job->errors, "\n");
+    pool_unlock();
+}
+
+static void perm_dir_release(struct perm_dir *dir) {
+    if (dir != &perm_cwd && __atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        closedir(dir->stream);
+        free(dir);
+    }
+}
+
+// Change one entry; st is only needed by chmod, flags is 0 or AT_SYMLINK_NOFOLLOW
+static int perm_apply(const struct perm_job *job, int dir_fd, const char *name,
+                      const struct stat *st, int flags) {
+    if (job->chown) {
+        return fchownat(dir_fd, name, job->uid, job->gid, flags);
+    }
+    if (st == NULL) {
+        return fchmodat(dir_fd, name, job->mode.or_mask, 0);
+    }
+    if (S_ISLNK(st->st_mode)) {
+        return 0;                   // Links have no mode of their own
+    }
+    mode_t mode = mode_change_apply(&job->mode, st->st_mode & 07777);
+    if (mode == (st->st_mode & 07777)) {
+        return 0;
+    }
+    return fchmodat(dir_fd, name, mode, 0);
+}
+
+static void perm_task_run(struct pool_task *task);
+
+static void perm_submit(struct perm_job *job, struct perm_dir *parent, char *path) {
+    struct perm_task *child = malloc(sizeof(*child));
+    if (child == NULL) {
+        perm_job_fail(job, "out of memory", path);
+        free(path);
+        return;
+    }
+    child->job = job;
+    child->parent = parent;
+    child->path = path;
+    child->task.run = perm_task_run;
+    if (parent != &perm_cwd) {
+        __atomic_add_fetch(&parent->refs, 1, __ATOMIC_ACQ_REL);
+    }
+    pool_lock();
+    job->outstanding++;
+    pool_unlock();
+    if (pool.threads > 0) {
+        pool_submit(&child->task);
+    } else {
+        perm_task_run(&child->task);   // No workers: walk serially
+    }
+}
+
+static void perm_task_run(struct pool_task *task) {
+    struct perm_task *self = (struct perm_task *)task;
+    struct perm_job *job = self->job;
+    
+    // Command line paths may be links to directories, entries below not
+    const char *name = self->path;
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    if (self->parent != &perm_cwd) {
+        name = strrchr(self->path, '/') + 1;
+        flags |= O_NOFOLLOW;
+    }
+    int fd = openat(self->parent->fd, name, flags);
+    perm_dir_release(self->parent);
+    struct perm_dir *dir = NULL;
+    if (fd >= 0) {
+        dir = malloc(sizeof(*dir));
+        if (dir != NULL && (dir->stream = fdopendir(fd)) == NULL) {
+            free(dir);
+            dir = NULL;
+        }
+        if (dir == NULL) {
+            close(fd);
+        }
+    }
+    
+    if (dir == NULL) {
+        perm_job_fail(job, "cannot open directory", self->path);
+    } else {
+        dir->fd = fd;
+        dir->refs = 1;
+        struct dirent *entry;
+        while ((entry = readdir(dir->stream)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            struct stat st;
+            const struct stat *stp = NULL;
+            int is_dir = (entry->d_type == DT_DIR);
+            // chmod must not follow links, so it always looks at them first
+            int need_stat = (entry->d_type == DT_UNKNOWN) ||
+                            (!job->chown && (job->need_stat || entry->d_type == DT_LNK));
+            int ok = 1;
+            if (need_stat) {
+                ok = (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0);
+                stp = &st;
+                is_dir = ok && S_ISDIR(st.st_mode);
+            }
+            if (ok && perm_apply(job, fd, entry->d_name, stp, AT_SYMLINK_NOFOLLOW) == 0) {
+                if (is_dir) {
+                    char *path = path_join(self->path, entry->d_name);
+                    if (path != NULL) {
+                        perm_submit(job, dir, path);
+                    }
+                }
+                continue;
+            }
+            char *path = path_join(self->path, entry->d_name);
+            perm_job_fail(job, job->chown ? "cannot change owner" : "cannot change permissions",
+                          (path != NULL) ? path : entry->d_name);
+            free(path);
+        }
+        perm_dir_release(dir);
+    }
+    
+    free(self->path);
+    free(self);
+    pool_lock();
+    if (--job->outstanding == 0) {
+        pool_done_signal();
+    }
+    pool_unlock();
+}
+
+// Apply a change to each path, and with -R to everything below it
+static int perm_run(struct perm_job *job, char **paths, int recursive) {
+    if (recursive) {
+        pool_start();
+    }
+    int status = 0;
+    for (int i = 0; paths[i] != NULL; i++) {
+        struct stat st;
+        if (stat(paths[i], &st) != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+            write_str(job->cmd);
+            write_str(": cannot access: " COLOR_RESET);
+            write_str(paths[i]);
+            write_str("\n");
+            status = 1;
+            continue;
+        }
+        if (perm_apply(job, AT_FDCWD, paths[i], &st, 0) != 0) {
+            perm_job_fail(job, job->chown ? "cannot change owner" : "cannot change permissions",
+                          paths[i]);
+            continue;
+        }
+        if (recursive && S_ISDIR(st.st_mode)) {
+            char *path = strdup(paths[i]);
+            if (path != NULL) {
+                perm_submit(job, &perm_cwd, path);
+            }
+        }
+    }
+    
+    pool_lock();
+    while (job->outstanding > 0) {
+        pool_done_wait();
+    }
+    pool_unlock();
+    out_write(job->errors.data, job->errors.len);
+    sb_free(&job->errors);
+    return status | job->failed;
+}
+
+static int builtin_chmod(char **args) {
+    int recursive = 0;
+    int arg_idx = 1;
+    // Only -R is a flag: "-w" is a mode
+    while (args[arg_idx] != NULL && strcmp(args[arg_idx], "-R") == 0) {
+        recursive = 1;
+        arg_idx++;
+    }
+    if (args[arg_idx] == NULL || args[arg_idx + 1] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: chmod: missing argument" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    struct perm_job job = { .cmd = "chmod" };
+    if (mode_change_parse(args[arg_idx], &job.mode) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: chmod: invalid mode: " COLOR_RESET);
+        write_str(args[arg_idx]);
+        write_str("\n");
+        return 1;
+    }
+    // An octal mode replaces every bit: no need to know the old ones
+    job.need_stat = job.mode.and_mask != 0 || job.mode.x_and_mask != 0 ||
+                    job.mode.or_mask != job.mode.x_or_mask;
+    return perm_run(&job, args + arg_idx + 1, recursive);
+}
+
+// A user or group name, or a number
+static int perm_parse_id(const char *text, struct id_map *map, const char *path, uint32_t *id) {
+    if (*text >= '0' && *text <= '9') {
+        char *end;
+        unsigned long value = strtoul(text, &end, 10);
+        *id = (uint32_t)value;
+        return (*end == '\0' && value <= UINT32_MAX) ? 0 : -1;
+    }
+    if (!map->loaded) {
+        id_map_load(map, path);
+    }
+    return id_map_find(map, text, id);
+}
+
+static int builtin_chown(char **args) {
+    int recursive = 0;
+    int arg_idx = 1;
+    while (args[arg_idx] != NULL && strcmp(args[arg_idx], "-R") == 0) {
+        recursive = 1;
+        arg_idx++;
+    }
+    if (args[arg_idx] == NULL || args[arg_idx + 1] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: chown: missing argument" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // owner, owner:group, or :group
+    struct perm_job job = { .cmd = "chown", .chown = 1, .uid = (uid_t)-1, .gid = (gid_t)-1 };
+    char *owner = args[arg_idx];
+    char *group = strchr(owner, ':');
+    if (group != NULL) {
+        *group++ = '\0';
+    }
+    uint32_t id;
+    int invalid = 0;
+    if (*owner != '\0') {
+        invalid |= perm_parse_id(owner, &ls_users, "/etc/passwd", &id);
+        job.uid = id;
+    }
+    if (group != NULL && *group != '\0') {
+        invalid |= perm_parse_id(group, &ls_groups, "/etc/group", &id);
+        job.gid = id;
+    }
+    if (invalid) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: chown: invalid user or group: " COLOR_RESET);
+        write_str(args[arg_idx]);
+        write_str("\n");
+        return 1;
+    }
+    return perm_run(&job, args + arg_idx + 1, recursive);
+}
+
+// Launch attributes: taskset, chrt, nice, ionice and limit
+//
+// Each of these is a prefix: it records its attribute in launch_attrs and
+// runs the rest of the line, which may be another prefix adding its own.
+// The first command that is not a prefix is forked once, and the child
+// applies everything recorded (CPU affinity, scheduling policy, niceness,
+// I/O priority and resource limits) to itself between fork and exec, so
+// the command runs with them from its first instruction and no wrapper
+// process stays around. A builtin runs in that child too. With -p, the
+// same attributes are read or changed on existing processes instead.
+
+#define LAUNCH_CPUS   0x01
+#define LAUNCH_SCHED  0x02
+#define LAUNCH_NICE   0x04
+#define LAUNCH_IOPRIO 0x08
+#define LAUNCH_LIMITS 0x10
+
+#define NICE_DEFAULT 10
+
+#define LIMIT_SOFT 0x01
+#define LIMIT_HARD 0x02
+#define LIMIT_SHOW 0x04             // ulimit: given without a value
+
+struct limit_option {
+    char option;
+    int resource;
+    rlim_t unit;                    // Of values shown and bare numbers
+    const char *name;
+};
+
+static const struct limit_option limit_table[] = {
+    { 't', RLIMIT_CPU, 1, "cpu time (seconds)" },
+    { 'l', RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)" },
+    { 'n', RLIMIT_NOFILE, 1, "open files" },
+    { 's', RLIMIT_STACK, 1024, "stack size (kbytes)" },
+    { 'u', RLIMIT_NPROC, 1, "max user processes" },
+    { 'v', RLIMIT_AS, 1024, "virtual memory (kbytes)" },
+};
+
+#define LIMIT_COUNT (int)(sizeof(limit_table) / sizeof(limit_table[0]))
+
+struct launch_limit {
+    unsigned which;                 // LIMIT_* bits, 0 if not set
+    rlim_t value;
+};
+
+// struct sched_attr, first version; glibc has no sched_setattr()
+struct sched_attributes {
+    uint32_t size;
+    uint32_t policy;
+    uint64_t flags;
+    int32_t nice;
+    uint32_t priority;
+    uint64_t runtime;           // SCHED_DEADLINE, in nanoseconds
+    uint64_t deadline;
+    uint64_t period;
+};
+
+struct launch_attrs {
+    unsigned set;               // LAUNCH_* bits of the fields in use
+    cpu_set_t cpus;
+    struct sched_attributes sched;
+    int nice;                   // Increment
+    int ioprio;
+    struct launch_limit limits[LIMIT_COUNT];
+};
+
+static struct launch_attrs launch_attrs;
+static int launch_in_child;     // Already forked for the command: exec directly
+
+// Forget the attributes of the last command
+static void launch_reset(void) {
+    memset(&launch_attrs, 0, sizeof(launch_attrs));
+}
+
+// Set the soft and/or hard value of a limit of pid (0 for the caller)
+static int limit_set(pid_t pid, const struct limit_option *option, const struct launch_limit *limit) {
+    struct rlimit value;
+    if (prlimit(pid, option->resource, NULL, &value) != 0) {
+        return -1;
+    }
+    if (limit->which & LIMIT_SOFT) {
+        value.rlim_cur = limit->value;
+    }
+    if (limit->which & LIMIT_HARD) {
+        value.rlim_max = limit->value;
+    }
+    return prlimit(pid, option->resource, &value, NULL);
+}
+
+// Apply the recorded attributes to the calling process; returns NULL or
+// what failed
+static const char *launch_apply(struct launch_attrs *attrs) {
+    if ((attrs->set & LAUNCH_CPUS) && sched_setaffinity(0, sizeof(attrs->cpus), &attrs->cpus) != 0) {
+        return "taskset: cannot set CPU affinity";
+    }
+    if (attrs->set & LAUNCH_SCHED) {
+        // Keep the niceness, which sched_setattr() also sets
+        attrs->sched.nice = getpriority(PRIO_PROCESS, 0);
+        if (syscall(SYS_sched_setattr, 0, &attrs->sched, 0) != 0) {
+            return "chrt: cannot set scheduling policy";
+        }
+    }
+    if (attrs->set & LAUNCH_NICE) {
+        int nice_value = getpriority(PRIO_PROCESS, 0) + attrs->nice;
+        nice_value = (nice_value < -20) ? -20 : (nice_value > 19) ? 19 : nice_value;
+        if (setpriority(PRIO_PROCESS, 0, nice_value) != 0) {
+            return "nice: cannot set niceness";
+        }
+    }
+    if ((attrs->set & LAUNCH_IOPRIO) &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, attrs->ioprio) != 0) {
+        return "ionice: cannot set I/O priority";
+    }
+    for (int i = 0; (attrs->set & LAUNCH_LIMITS) && i < LIMIT_COUNT; i++) {
+        if (attrs->limits[i].which != 0 && limit_set(0, &limit_table[i], &attrs->limits[i]) != 0) {
+            return "limit: cannot set resource limit";
+        }
+    }
+    memset(attrs, 0, sizeof(*attrs));
+    return NULL;
+}
+
+// Whether args is a prefix that runs a command, rather than a command
+static int launch_prefix(char **args) {
+    const char *name = args[0];
+    return args[1] != NULL && strcmp(args[1], "-p") != 0 &&
+           (strcmp(name, "chrt") == 0 || strcmp(name, "ionice") == 0 || strcmp(name, "limit") == 0 ||
+            strcmp(name, "nice") == 0 || strcmp(name, "taskset") == 0);
+}
+
+// Run args with the recorded attributes
+static int launch_command(const char *cmd, char **args) {
+    if (args[0] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+        write_str(cmd);
+        write_str(": missing command" COLOR_RESET "\n");
+        launch_reset();
+        return 1;
+    }
+    if (launch_prefix(args)) {
+        return run_builtin(args);
+    }
+    
+    pid_t pid = launch_in_child ? 0 : shell_fork();
+    if (pid == 0) {
+        const char *failed = launch_apply(&launch_attrs);
+        if (failed != NULL) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+            write_str(failed);
+            write_str(COLOR_RESET "\n");
+            out_flush();
+            _exit(126);
+        }
+        int status = run_builtin(args);
+        if (status == NOT_BUILTIN) {
+            exec_command(args);
+        }
+        out_flush();
+        _exit(status);
+    }
+    launch_reset();
+    if (pid < 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: fork failed" COLOR_RESET "\n");
+        return 1;
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    out_forget_style();
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Parse a pid, or report it as invalid; returns 0 or -1
+static int launch_pid(const char *cmd, const char *text, pid_t *pid) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (*end != '\0' || end == text || value < 0 || value > INT_MAX) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+        write_str(cmd);
+        write_str(": invalid pid: " COLOR_RESET);
+        write_str(text);
+        write_str("\n");
+        return -1;
+    }
+    *pid = (pid_t)value;
+    return 0;
+}
+
+static void launch_pid_error(const char *cmd, const char *what, const char *pid) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+    write_str(cmd);
+    write_str(": cannot ");
+    write_str(what);
+    write_str(": " COLOR_RESET);
+    write_str(pid);
+    write_str("\n");
+}
+
+// "invalid option: " or "missing value for " an option; returns 1
+static int launch_option_error(const char *cmd, const char *what, const char *opt) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+    write_str(cmd);
+    write_str(": ");
+    write_str(what);
+    write_str(COLOR_RESET);
+    write_str(opt);
+    write_str("\n");
+    return 1;
+}
+
+static int parse_int(const char *text, long min, long max, long *value) {
+    char *end;
+    *value = strtol(text, &end, 10);
+    return (*end == '\0' && end != text && *value >= min && *value <= max) ? 0 : -1;
+}
+
+// chrt: scheduling policy and priority
+
+static const char *const sched_policy_names[] = {
+    "SCHED_OTHER", "SCHED_FIFO", "SCHED_RR", "SCHED_BATCH", NULL, "SCHED_IDLE", "SCHED_DEADLINE",
+};
+
+static int builtin_chrt(char **args) {
+    struct sched_attributes attr = { .size = sizeof(attr), .policy = SCHED_RR };
+    int show_pid = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        const char *arg = args[arg_idx++];
+        uint64_t *nanoseconds = NULL;
+        if (strcmp(arg, "--") == 0) {
+            break;
+        } else if (strcmp(arg, "-p") == 0) {
+            show_pid = 1;
+        } else if (strcmp(arg, "-o") == 0) {
+            attr.policy = SCHED_OTHER;
+        } else if (strcmp(arg, "-f") == 0) {
+            attr.policy = SCHED_FIFO;
+        } else if (strcmp(arg, "-r") == 0) {
+            attr.policy = SCHED_RR;
+        } else if (strcmp(arg, "-b") == 0) {
+            attr.policy = SCHED_BATCH;
+        } else if (strcmp(arg, "-i") == 0) {
+            attr.policy = SCHED_IDLE;
+        } else if (strcmp(arg, "-d") == 0) {
+            attr.policy = SCHED_DEADLINE;
+        } else if (strcmp(arg, "-R") == 0) {
+            attr.flags |= SCHED_FLAG_RESET_ON_FORK;
+        } else if (strcmp(arg, "-T") == 0) {
+            nanoseconds = &attr.runtime;
+        } else if (strcmp(arg, "-D") == 0) {
+            nanoseconds = &attr.deadline;
+        } else if (strcmp(arg, "-P") == 0) {
+            nanoseconds = &attr.period;
+        } else {
+            return launch_option_error("chrt", "invalid option: ", arg);
+        }
+        if (nanoseconds != NULL) {
+            char *end;
+            if (args[arg_idx] == NULL ||
+                (*nanoseconds = strtoull(args[arg_idx], &end, 10), *end != '\0' || end == args[arg_idx])) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: chrt: ");
+                write_str(arg);
+                write_str(" needs nanoseconds" COLOR_RESET "\n");
+                return 1;
+            }
+            arg_idx++;
+        }
+    }
+    
+    // chrt -p pid: show the policy
+    if (show_pid && args[arg_idx] != NULL && args[arg_idx + 1] == NULL) {
+        pid_t pid;
+        if (launch_pid("chrt", args[arg_idx], &pid) != 0) {
+            return 1;
+        }
+        struct sched_attributes current;
+        if (syscall(SYS_sched_getattr, pid, &current, sizeof(current), 0) != 0) {
+            launch_pid_error("chrt", "get scheduling policy", args[arg_idx]);
+            return 1;
+        }
+        out_str(ERDEMOS_PRIMARY_COLOR "pid ");
+        out_str(args[arg_idx]);
+        out_str("'s current scheduling policy: ");
+        out_str((current.policy < sizeof(sched_policy_names) / sizeof(sched_policy_names[0]) &&
+                 sched_policy_names[current.policy] != NULL) ? sched_policy_names[current.policy] : "unknown");
+        if (current.flags & SCHED_FLAG_RESET_ON_FORK) {
+            out_str("|SCHED_RESET_ON_FORK");
+        }
+        out_str("\npid ");
+        out_str(args[arg_idx]);
+        out_str("'s current scheduling priority: ");
+        write_uint(current.priority);
+        out_str("\n");
+        if (current.policy == SCHED_DEADLINE) {
+            out_str("pid ");
+            out_str(args[arg_idx]);
+            out_str("'s current runtime/deadline/period parameters: ");
+            write_uint(current.runtime);
+            out_str("/");
+            write_uint(current.deadline);
+            out_str("/");
+            write_uint(current.period);
+            out_str("\n");
+        }
+        out_str(COLOR_RESET);
+        return 0;
+    }
+    
+    long priority;
+    int realtime = (attr.policy == SCHED_FIFO || attr.policy == SCHED_RR);
+    if (args[arg_idx] == NULL || parse_int(args[arg_idx], realtime ? 1 : 0, realtime ? 99 : 0, &priority) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: chrt: expected a priority (1-99 for -f and -r, 0 otherwise)" COLOR_RESET "\n");
+        return 1;
+    }
+    attr.priority = (uint32_t)priority;
+    arg_idx++;
+    if (attr.policy == SCHED_DEADLINE && attr.runtime == 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: chrt: -d needs -T runtime" COLOR_RESET "\n");
+        return 1;
+    }
+    if (attr.deadline == 0) {
+        attr.deadline = (attr.period != 0) ? attr.period : attr.runtime;
+    }
+    
+    if (show_pid) {
+        int status = (args[arg_idx] == NULL);
+        for (; args[arg_idx] != NULL; arg_idx++) {
+            pid_t pid;
+            if (launch_pid("chrt", args[arg_idx], &pid) != 0) {
+                status = 1;
+                continue;
+            }
+            attr.nice = getpriority(PRIO_PROCESS, pid);
+            if (syscall(SYS_sched_setattr, pid, &attr, 0) != 0) {
+                launch_pid_error("chrt", "set scheduling policy", args[arg_idx]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+    launch_attrs.sched = attr;
+    launch_attrs.set |= LAUNCH_SCHED;
+    return launch_command("chrt", args + arg_idx);
+}
+
+// ionice: I/O scheduling class and level
+
+static const char *const ioprio_class_names[] = { "none", "realtime", "best-effort", "idle" };
+
+static int builtin_ionice(char **args) {
+    int class = -1;
+    long level = IOPRIO_NORM;
+    int pids = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        const char *arg = args[arg_idx++];
+        if (strcmp(arg, "--") == 0) {
+            break;
+        } else if (strcmp(arg, "-p") == 0) {
+            pids = 1;
+        } else if (strcmp(arg, "-c") != 0 && strcmp(arg, "-n") != 0) {
+            return launch_option_error("ionice", "invalid option: ", arg);
+        } else if (args[arg_idx] == NULL) {
+            return launch_option_error("ionice", "missing value for ", arg);
+        } else if (strcmp(arg, "-c") == 0) {
+            const char *name = args[arg_idx++];
+            for (int i = 0; i < 4; i++) {
+                if (strcmp(name, ioprio_class_names[i]) == 0 || (name[0] == '0' + i && name[1] == '\0')) {
+                    class = i;
+                }
+            }
+            if (class < 0) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: ionice: invalid class: " COLOR_RESET);
+                write_str(name);
+                write_str("\n");
+                return 1;
+            }
+        } else {
+            if (parse_int(args[arg_idx], 0, IOPRIO_NR_LEVELS - 1, &level) != 0) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: ionice: invalid level: " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                return 1;
+            }
+            arg_idx++;
+            if (class < 0) {
+                class = IOPRIO_CLASS_BE;
+            }
+        }
+    }
+    int ioprio = IOPRIO_PRIO_VALUE(class, (class == IOPRIO_CLASS_IDLE || class == IOPRIO_CLASS_NONE) ? 0 : level);
+    
+    if (pids) {
+        int status = (args[arg_idx] == NULL);
+        for (; args[arg_idx] != NULL; arg_idx++) {
+            pid_t pid;
+            if (launch_pid("ionice", args[arg_idx], &pid) != 0) {
+                status = 1;
+                continue;
+            }
+            if (class >= 0) {
+                if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, pid, ioprio) != 0) {
+                    launch_pid_error("ionice", "set I/O priority", args[arg_idx]);
+                    status = 1;
+                }
+                continue;
+            }
+            long current = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, pid);
+            if (current < 0) {
+                launch_pid_error("ionice", "get I/O priority", args[arg_idx]);
+                status = 1;
+                continue;
+            }
+            int current_class = (int)IOPRIO_PRIO_CLASS(current);
+            out_str(ERDEMOS_PRIMARY_COLOR);
+            out_str(args[arg_idx]);
+            out_str(": ");
+            out_str((current_class < 4) ? ioprio_class_names[current_class] : "unknown");
+            if (current_class == IOPRIO_CLASS_RT || current_class == IOPRIO_CLASS_BE) {
+                out_str(": prio ");
+                write_uint(IOPRIO_PRIO_DATA(current));
+            }
+            out_str("\n" COLOR_RESET);
+        }
+        return status;
+    }
+    if (class < 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: ionice: expected -c class or -n level" COLOR_RESET "\n");
+        return 1;
+    }
+    launch_attrs.ioprio = ioprio;
+    launch_attrs.set |= LAUNCH_IOPRIO;
+    return launch_command("ionice", args + arg_idx);
+}
+
+// nice and renice: niceness
+
+static int builtin_nice(char **args) {
+    if (args[1] == NULL) {
+        int value = getpriority(PRIO_PROCESS, 0);
+        write_str(ERDEMOS_PRIMARY_COLOR);
+        if (value < 0) {
+            write_str("-");
+        }
+        write_uint((value < 0) ? -value : value);
+        write_str("\n" COLOR_RESET);
+        return 0;
+    }
+    
+    long increment = NICE_DEFAULT;
+    int arg_idx = 1;
+    const char *text = NULL;
+    if (strcmp(args[1], "-n") == 0 && args[2] != NULL) {
+        text = args[2];
+        arg_idx = 3;
+    } else if (strcmp(args[1], "--") == 0) {
+        arg_idx = 2;
+    } else if (args[1][0] == '-' && args[1][1] != '\0') {
+        // -N, and --N for a negative increment
+        text = args[1] + 1;
+        arg_idx = 2;
+    }
+    if (text != NULL && parse_int(text, -40, 40, &increment) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: nice: invalid increment: " COLOR_RESET);
+        write_str(text);
+        write_str("\n");
+        return 1;
+    }
+    // Increments of nested nice prefixes add up
+    launch_attrs.nice = ((launch_attrs.set & LAUNCH_NICE) ? launch_attrs.nice : 0) + (int)increment;
+    launch_attrs.set |= LAUNCH_NICE;
+    return launch_command("nice", args + arg_idx);
+}
+
+static int builtin_renice(char **args) {
+    int which = PRIO_PROCESS;
+    int arg_idx = 1;
+    if (args[arg_idx] != NULL && strcmp(args[arg_idx], "-n") == 0) {
+        arg_idx++;
+    }
+    long priority;
+    if (args[arg_idx] == NULL || parse_int(args[arg_idx], -20, 19, &priority) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: renice: expected a priority from -20 to 19" COLOR_RESET "\n");
+        return 1;
+    }
+    arg_idx++;
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: renice: missing pid" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    int status = 0;
+    for (; args[arg_idx] != NULL; arg_idx++) {
+        // -p and -g switch between processes and process groups
+        if (strcmp(args[arg_idx], "-p") == 0 || strcmp(args[arg_idx], "-g") == 0) {
+            which = (args[arg_idx][1] == 'p') ? PRIO_PROCESS : PRIO_PGRP;
+            continue;
+        }
+        pid_t pid;
+        if (launch_pid("renice", args[arg_idx], &pid) != 0) {
+            status = 1;
+            continue;
+        }
+        errno = 0;
+        int old = getpriority(which, pid);
+        if ((old == -1 && errno != 0) || setpriority(which, pid, (int)priority) != 0) {
+            launch_pid_error("renice", "set priority", args[arg_idx]);
+            status = 1;
+            continue;
+        }
+        out_str(ERDEMOS_PRIMARY_COLOR);
+        out_str(args[arg_idx]);
+        out_str((which == PRIO_PROCESS) ? " (process ID) old priority " : " (process group ID) old priority ");
+        if (old < 0) {
+            out_str("-");
+        }
+        write_uint((old < 0) ? -old : old);
+        out_str(", new priority ");
+        if (priority < 0) {
+            out_str("-");
+        }
+        write_uint((priority < 0) ? -priority : priority);
+        out_str("\n" COLOR_RESET);
+    }
+    return status;
+}
+
+// taskset: CPU affinity
+
+// Parse a list like 0-3,8,10-15:2 into set; returns 0 or -1
+static int cpu_list_parse(const char *text, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*text != '\0') {
+        char *end;
+        unsigned long first = strtoul(text, &end, 10);
+        unsigned long last = first;
+        unsigned long stride = 1;
+        if (end == text) {
+            return -1;
+        }
+        if (*end == '-') {
+            text = end + 1;
+            last = strtoul(text, &end, 10);
+            if (end == text || last < first) {
+                return -1;
+            }
+            if (*end == ':') {
+                text = end + 1;
+                stride = strtoul(text, &end, 10);
+                if (end == text || stride == 0) {
+                    return -1;
+                }
+            }
+        }
+        if (last >= CPU_SETSIZE || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu += stride) {
+            CPU_SET(cpu, set);
+        }
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+// Parse a hexadecimal mask like ff or 0x3 into set; returns 0 or -1
+static int cpu_mask_parse(const char *text, cpu_set_t *set) {
+    CPU_ZERO(set);
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        text += 2;
+    }
+    size_t len = strlen(text);
+    if (len == 0 || len * 4 > CPU_SETSIZE) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = text[len - 1 - i];
+        int digit = (c >= '0' && c <= '9') ? c - '0' :
+                    (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                    (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return -1;
+        }
+        for (int bit = 0; bit < 4; bit++) {
+            if (digit & (1 << bit)) {
+                CPU_SET(i * 4 + bit, set);
+            }
+        }
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+// Append set as a list with ranges, or as a hexadecimal mask
+static void sb_cpu_set(struct strbuf *sb, const cpu_set_t *set, int list) {
+    if (!list) {
+        int top = CPU_SETSIZE - 1;
+        while (top > 0 && !CPU_ISSET(top, set)) {
+            top--;
+        }
+        for (int nibble = top / 4; nibble >= 0; nibble--) {
+            int digit = 0;
+            for (int bit = 0; bit < 4; bit++) {
+                digit |= CPU_ISSET(nibble * 4 + bit, set) ? 1 << bit : 0;
+            }
+            sb_append(sb, &"0123456789abcdef"[digit], 1);
+        }
+        return;
+    }
+    int first = 1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, set)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) {
+            last++;
+        }
+        if (!first) {
+            sb_str(sb, ",");
+        }
+        sb_uint_aligned(sb, cpu, 0);
+        if (last > cpu) {
+            sb_str(sb, "-");
+            sb_uint_aligned(sb, last, 0);
+        }
+        first = 0;
+        cpu = last;
+    }
+}
+
+static void taskset_report(const char *pid, const char *which, const cpu_set_t *set, int list) {
+    struct strbuf line = {0};
+    sb_str(&line, ERDEMOS_PRIMARY_COLOR "pid ");
+    sb_str(&line, pid);
+    sb_str(&line, "'s ");
+    sb_str(&line, which);
+    sb_str(&line, list ? " affinity list: " : " affinity mask: ");
+    sb_cpu_set(&line, set, list);
+    sb_str(&line, "\n" COLOR_RESET);
+    out_write(line.data, line.len);
+    sb_free(&line);
+}
+
+static int builtin_taskset(char **args) {
+    int list = 0;
+    int pid_mode = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        const char *arg = args[arg_idx++];
+        if (strcmp(arg, "--") == 0) {
+            break;
+        } else if (strcmp(arg, "-c") == 0) {
+            list = 1;
+        } else if (strcmp(arg, "-p") == 0) {
+            pid_mode = 1;
+        } else if (strcmp(arg, "-pc") == 0 || strcmp(arg, "-cp") == 0) {
+            list = 1;
+            pid_mode = 1;
+        } else {
+            return launch_option_error("taskset", "invalid option: ", arg);
+        }
+    }
+    
+    const char *cpus = args[arg_idx];
+    if (pid_mode && cpus != NULL && args[arg_idx + 1] == NULL) {
+        cpus = NULL;    // taskset -p pid: only show
+    } else if (cpus != NULL) {
+        arg_idx++;
+    }
+    cpu_set_t set;
+    if (cpus != NULL && (list ? cpu_list_parse(cpus, &set) : cpu_mask_parse(cpus, &set)) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: taskset: invalid CPU ");
+        write_str(list ? "list: " COLOR_RESET : "mask: " COLOR_RESET);
+        write_str(cpus);
+        write_str("\n");
+        return 1;
+    }
+    
+    if (pid_mode) {
+        pid_t pid;
+        if (args[arg_idx] == NULL) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: taskset: missing pid" COLOR_RESET "\n");
+            return 1;
+        }
+        if (launch_pid("taskset", args[arg_idx], &pid) != 0) {
+            return 1;
+        }
+        cpu_set_t current;
+        if (sched_getaffinity(pid, sizeof(current), &current) != 0) {
+            launch_pid_error("taskset", "get CPU affinity", args[arg_idx]);
+            return 1;
+        }
+        taskset_report(args[arg_idx], "current", &current, list);
+        if (cpus == NULL) {
+            return 0;
+        }
+        if (sched_setaffinity(pid, sizeof(set), &set) != 0 || sched_getaffinity(pid, sizeof(set), &set) != 0) {
+            launch_pid_error("taskset", "set CPU affinity", args[arg_idx]);
+            return 1;
+        }
+        taskset_report(args[arg_idx], "new", &set, list);
+        return 0;
+    }
+    if (cpus == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: taskset: missing CPU mask" COLOR_RESET "\n");
+        return 1;
+    }
+    launch_attrs.cpus = set;
+    launch_attrs.set |= LAUNCH_CPUS;
+    return launch_command("taskset", args + arg_idx);
+}
+
+// limit and ulimit: resource limits
+//
+// ulimit changes the shell's own limits, which every later command
+// inherits; limit is a prefix like nice and sets them in the child of one
+// command only. Both take the same options. A bare number for a memory
+// limit is in KiB like in other shells; with a suffix (256M, 1G) it is a
+// size.
+
+// Parse the options of limit or ulimit from args[*arg_idx] on into
+// limits; with values_needed, every limit option must have a value.
+// Returns 0, 1 if -a was given, or -1 after reporting an error.
+static int limit_options_parse(const char *cmd, char **args, int *arg_idx,
+                               struct launch_limit *limits, int values_needed) {
+    unsigned which = LIMIT_SOFT | LIMIT_HARD;
+    int all = 0;
+    while (args[*arg_idx] != NULL && args[*arg_idx][0] == '-') {
+        const char *arg = args[(*arg_idx)++];
+        if (strcmp(arg, "--") == 0) {
+            break;
+        }
+        if (strcmp(arg, "-a") == 0) {
+            all = 1;
+            continue;
+        }
+        if (strcmp(arg, "-H") == 0 || strcmp(arg, "-S") == 0) {
+            which = (arg[1] == 'H') ? LIMIT_HARD : LIMIT_SOFT;
+            continue;
+        }
+        int index = -1;
+        for (int i = 0; i < LIMIT_COUNT; i++) {
+            if (arg[1] == limit_table[i].option && arg[2] == '\0') {
+                index = i;
+            }
+        }
+        if (index < 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+            write_str(cmd);
+            write_str(": invalid option: " COLOR_RESET);
+            write_str(arg);
+            write_str("\n");
+            return -1;
+        }
+        limits[index].which = which | LIMIT_SHOW;
+        const char *text = args[*arg_idx];
+        if (text == NULL || (!values_needed && text[0] == '-')) {
+            if (values_needed) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+                write_str(cmd);
+                write_str(": missing value for " COLOR_RESET);
+                write_str(arg);
+                write_str("\n");
+                return -1;
+            }
+            continue;
+        }
+        (*arg_idx)++;
+        
+        // unlimited, a number, or a size for the memory limits
+        off_t size;
+        char *end;
+        rlim_t value = strtoull(text, &end, 10);
+        if (strcmp(text, "unlimited") == 0) {
+            value = RLIM_INFINITY;
+        } else if (*end == '\0' && end != text) {
+            value *= limit_table[index].unit;
+        } else if (limit_table[index].unit > 1 && parse_size(text, &size) == 0) {
+            value = (rlim_t)size;
+        } else {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+            write_str(cmd);
+            write_str(": invalid limit: " COLOR_RESET);
+            write_str(text);
+            write_str("\n");
+            return -1;
+        }
+        limits[index].which &= ~LIMIT_SHOW;
+        limits[index].value = value;
+    }
+    return all;
+}
+
+static void limit_error(const char *cmd, int index) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: ");
+    write_str(cmd);
+    write_str(": cannot set limit: " COLOR_RESET);
+    write_str(limit_table[index].name);
+    write_str("\n");
+}
+
+static int builtin_limit(char **args) {
+    int arg_idx = 1;
+    struct launch_limit limits[LIMIT_COUNT] = {0};
+    if (limit_options_parse("limit", args, &arg_idx, limits, 1) != 0) {
+        return 1;
+    }
+    // Nested limit prefixes: the innermost value of each limit wins
+    for (int i = 0; i < LIMIT_COUNT; i++) {
+        if (limits[i].which != 0) {
+            launch_attrs.limits[i] = limits[i];
+            launch_attrs.set |= LAUNCH_LIMITS;
+        }
+    }
+    return launch_command("limit", args + arg_idx);
+}
+
+static int builtin_ulimit(char **args) {
+    int arg_idx = 1;
+    struct launch_limit limits[LIMIT_COUNT] = {0};
+    int all = limit_options_parse("ulimit", args, &arg_idx, limits, 0);
+    if (all < 0) {
+        return 1;
+    }
+    int shown = 0;
+    for (int i = 0; i < LIMIT_COUNT; i++) {
+        shown |= limits[i].which;
+    }
+    
+    int status = 0;
+    for (int i = 0; i < LIMIT_COUNT; i++) {
+        if (limits[i].which == 0 && !all && shown != 0) {
+            continue;
+        }
+        if (limits[i].which != 0 && !(limits[i].which & LIMIT_SHOW)) {
+            if (limit_set(0, &limit_table[i], &limits[i]) != 0) {
+                limit_error("ulimit", i);
+                status = 1;
+            }
+            continue;
+        }
+        
+        // Show the soft limit, or with -H the hard one
+        struct rlimit current;
+        if (prlimit(0, limit_table[i].resource, NULL, &current) != 0) {
+            continue;
+        }
+        rlim_t value = (limits[i].which & LIMIT_SOFT) || limits[i].which == 0 ?
+                       current.rlim_cur : current.rlim_max;
+        struct strbuf line = {0};
+        sb_str(&line, ERDEMOS_PRIMARY_COLOR);
+        sb_str_padded(&line, limit_table[i].name, 32);
+        sb_str(&line, "(-");
+        sb_append(&line, &limit_table[i].option, 1);
+        sb_str(&line, ") ");
+        if (value == RLIM_INFINITY) {
+            sb_str(&line, "unlimited");
+        } else {
+            sb_uint_aligned(&line, value / limit_table[i].unit, 0);
+        }
+        sb_str(&line, "\n" COLOR_RESET);
+        out_write(line.data, line.len);
+        sb_free(&line);
+    }
+    return status;
+}
+
+// Compiled name patterns for pkill
+//
+// A small regular expression subset: literals, ., [set], [^set] with
+// ranges, the * + ? quantifiers, ^ and $ anchors and \ escapes. A pattern
+// is compiled once into an array of atoms and matched in a single pass
+// over the text that tracks every atom the match could be at, so the time
+// is linear in the text whatever the pattern (a*a*a*b has no backtracking
+// to blow up). Regular expressions from libc would add more to ersh than
+// all of pkill.
+
+#define PATTERN_LITERAL 0
+#define PATTERN_ANY     1
+#define PATTERN_SET     2
+
+struct pattern_atom {
+    unsigned char type;
+    unsigned char c;
+    char quantifier;                // 0, '*', '+' or '?'
+    uint32_t set[8];                // Bit per byte for PATTERN_SET
+};
+
+struct pattern {
+    struct pattern_atom *atoms;
+    unsigned char *states;          // Two sets of count + 1 flags for pattern_match()
+    int count;
+    int anchor_start;
+    int anchor_end;
+};
+
+// Returns 0, or -1 for an invalid pattern
+static int pattern_compile(const char *text, struct pattern *pattern) {
+    memset(pattern, 0, sizeof(*pattern));
+    pattern->atoms = calloc(strlen(text) + 1, sizeof(*pattern->atoms));
+    pattern->states = malloc(2 * (strlen(text) + 2));
+    if (pattern->atoms == NULL || pattern->states == NULL) {
+        return -1;
+    }
+    const unsigned char *p = (const unsigned char *)text;
+    if (*p == '^') {
+        pattern->anchor_start = 1;
+        p++;
+    }
+    while (*p != '\0') {
+        if (p[0] == '$' && p[1] == '\0') {
+            pattern->anchor_end = 1;
+            break;
+        }
+        if (*p == '*' || *p == '+' || *p == '?') {
+            if (pattern->count == 0 || pattern->atoms[pattern->count - 1].quantifier != 0) {
+                return -1;          // Nothing to repeat
+            }
+            pattern->atoms[pattern->count - 1].quantifier = (char)*p++;
+            continue;
+        }
+        struct pattern_atom *atom = &pattern->atoms[pattern->count++];
+        if (*p == '.') {
+            atom->type = PATTERN_ANY;
+            p++;
+        } else if (*p == '[') {
+            atom->type = PATTERN_SET;
+            int negate = (*++p == '^');
+            p += negate;
+            // A ] right after [ or [^ is a member
+            const unsigned char *start = p;
+            while (*p != '\0' && (*p != ']' || p == start)) {
+                unsigned char from = *p;
+                unsigned char to = from;
+                if (p[1] == '-' && p[2] != '\0' && p[2] != ']') {
+                    to = p[2];
+                    p += 2;
+                }
+                for (unsigned c = from; c <= to; c++) {
+                    atom->set[c >> 5] |= 1u << (c & 31);
+                }
+                p++;
+            }
+            if (*p++ != ']') {
+                return -1;
+            }
+            for (int i = 0; negate && i < 8; i++) {
+                atom->set[i] = ~atom->set[i];
+            }
+        } else {
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            }
+            atom->type = PATTERN_LITERAL;
+            atom->c = *p++;
+        }
+    }
+    return 0;
+}
+
+static void pattern_free(struct pattern *pattern) {
+    free(pattern->atoms);
+    free(pattern->states);
+    pattern->atoms = NULL;
+    pattern->states = NULL;
+}
+
+static int pattern_atom_matches(const struct pattern_atom *atom, unsigned char c) {
+    if (c == '\0') {
+        return 0;
+    }
+    if (atom->type == PATTERN_ANY) {
+        return 1;
+    }
+    if (atom->type == PATTERN_SET) {
+        return (atom->set[c >> 5] >> (c & 31)) & 1;
+    }
+    return atom->c == c;
+}
+
+// Add atom i to a state set, and the atoms after it that an atom with *
+// or ? may skip; i == count is the end of the pattern
+static void pattern_add_state(const struct pattern *pattern, unsigned char *set, int i) {
+    while (!set[i]) {
+        set[i] = 1;
+        if (i == pattern->count ||
+            (pattern->atoms[i].quantifier != '*' && pattern->atoms[i].quantifier != '?')) {
+            break;
+        }
+        i++;
+    }
+}
+
+// Whether the pattern matches anywhere in str
+static int pattern_match(const struct pattern *pattern, const char *str) {
+    const unsigned char *s = (const unsigned char *)str;
+    size_t size = (size_t)pattern->count + 1;
+    unsigned char *current = pattern->states;
+    unsigned char *next = pattern->states + size;
+    memset(current, 0, size);
+    pattern_add_state(pattern, current, 0);
+    while (1) {
+        if (current[pattern->count] && (!pattern->anchor_end || *s == '\0')) {
+            return 1;
+        }
+        if (*s == '\0') {
+            return 0;
+        }
+        // Step every live atom over the next character; a match may also
+        // start here unless the pattern is anchored
+        memset(next, 0, size);
+        int alive = 0;
+        for (int i = 0; i < pattern->count; i++) {
+            const struct pattern_atom *atom = &pattern->atoms[i];
+            if (!current[i] || !pattern_atom_matches(atom, *s)) {
+                continue;
+            }
+            if (atom->quantifier == '*' || atom->quantifier == '+') {
+                pattern_add_state(pattern, next, i);
+            }
+            if (atom->quantifier != '*') {
+                pattern_add_state(pattern, next, i + 1);
+            }
+            alive = 1;
+        }
+        if (!pattern->anchor_start) {
+            pattern_add_state(pattern, next, 0);
+        } else if (!alive) {
+            return 0;
+        }
+        unsigned char *swap = current;
+        current = next;
+        next = swap;
+        s++;
+    }
+}
+
+// Process lookup for pidof and pkill
+//
+// /proc is opened once and kept open, and every process is opened as a
+// directory fd relative to it. Only the comm file (or cmdline, on request)
+// is read, relative to that fd, and a matching process is signalled
+// through the same fd with pidfd_send_signal(), so it cannot have been
+// replaced by another process reusing its pid in between. All patterns
+// are compiled before the scan and matched in a single pass over /proc.
+
+static int proc_fd = -1;
+
+// Read a process' comm, or its cmdline with NULs turned into spaces
+static ssize_t proc_read_name(int pid_fd, int cmdline, char *buf, size_t size) {
+    int fd = openat(pid_fd, cmdline ? "cmdline" : "comm", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+    while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\0')) {
+        len--;
+    }
+    for (ssize_t i = 0; i < len; i++) {
+        if (buf[i] == '\0') {
+            buf[i] = ' ';
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// Call found for every process other than the shell whose name matches
+// one of the patterns; match decides. Returns the number of matches.
+static int proc_scan(int cmdline, int (*match)(const char *name, void *ctx), void *ctx,
+                     void (*found)(int pid_fd, pid_t pid, void *ctx)) {
+    if (proc_fd < 0) {
+        proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (proc_fd < 0) {
+            return -1;
+        }
+    }
+    // A fresh stream on the kept fd: the listing itself must be re-read
+    int list_fd = openat(proc_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = (list_fd >= 0) ? fdopendir(list_fd) : NULL;
+    if (dir == NULL) {
+        if (list_fd >= 0) {
+            close(list_fd);
+        }
+        return -1;
+    }
+    pid_t self = getpid();
+    int matches = 0;
+    char name[4096];
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') {
+            continue;
+        }
+        pid_t pid = (pid_t)strtol(entry->d_name, NULL, 10);
+        if (pid == self) {
+            continue;
+        }
+        int pid_fd = openat(proc_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (pid_fd < 0) {
+            continue;           // Exited since the listing
+        }
+        if (proc_read_name(pid_fd, cmdline, name, sizeof(name)) >= 0 && match(name, ctx)) {
+            found(pid_fd, pid, ctx);
+            matches++;
+        }
+        close(pid_fd);
+    }
+    closedir(dir);
+    return matches;
+}
+
+static int pidof_match(const char *name, void *ctx) {
+    // comm holds at most 15 bytes of the name
+    for (char **names = ctx; *names != NULL; names++) {
+        if (strncmp(*names, name, 15) == 0 && (strlen(*names) >= 15 || strcmp(*names, name) == 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void pidof_found(int pid_fd, pid_t pid, void *ctx) {
+    (void)pid_fd;
+    (void)ctx;
+    out_str(ERDEMOS_PRIMARY_COLOR);
+    write_uint(pid);
+    out_str(" ");
+}
+
+static int builtin_pidof(char **args) {
+    if (args[1] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: pidof: missing name" COLOR_RESET "\n");
+        return 1;
+    }
+    int matches = proc_scan(0, pidof_match, args + 1, pidof_found);
+    if (matches < 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: pidof: cannot read /proc" COLOR_RESET "\n");
+        return 1;
+    }
+    if (matches > 0) {
+        out_str("\n" COLOR_RESET);
+    }
+    return matches == 0;
+}
+
+struct pkill_job {
+    struct pattern *patterns;
+    int count;
+    int sig;
+    int failed;
+};
+
+static int pkill_match(const char *name, void *ctx) {
+    struct pkill_job *job = ctx;
+    for (int i = 0; i < job->count; i++) {
+        if (pattern_match(&job->patterns[i], name)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void pkill_found(int pid_fd, pid_t pid, void *ctx) {
+    struct pkill_job *job = ctx;
+    // A /proc/<pid> directory fd is also a pidfd
+    if (syscall(SYS_pidfd_send_signal, pid_fd, job->sig, NULL, 0) != 0 &&
+        (errno != ENOSYS || kill(pid, job->sig) != 0)) {
+        job->failed = 1;
+        write_str(ERDEMOS_ERROR_COLOR "ersh: pkill: cannot signal: " COLOR_RESET);
+        write_uint(pid);
+        write_str("\n");
+    }
+}
+
+static int builtin_pkill(char **args) {
+    struct pkill_job job = { .sig = SIGTERM };
+    int cmdline = 0;
+    int exact = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        if (strcmp(args[arg_idx], "-f") == 0) {
+            cmdline = 1;
+            arg_idx++;
+        } else if (strcmp(args[arg_idx], "-x") == 0) {
+            exact = 1;
+            arg_idx++;
+        } else if (strcmp(args[arg_idx], "--") == 0) {
+            arg_idx++;
+            break;
+        } else {
+            int next = signal_option(args, arg_idx, "pkill", &job.sig);
+            if (next < 0) {
+                return 1;
+            }
+            if (next == arg_idx) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: pkill: invalid option: " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                return 1;
+            }
+            arg_idx = next;
+        }
+    }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: pkill: missing pattern" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // Every pattern is compiled once, before the scan
+    for (int i = arg_idx; args[i] != NULL; i++) {
+        job.count++;
+    }
+    job.patterns = calloc(job.count, sizeof(*job.patterns));
+    if (job.patterns == NULL) {
+        return 1;
+    }
+    int compiled = 0;
+    int status = 0;
+    for (; compiled < job.count; compiled++) {
+        if (pattern_compile(args[arg_idx + compiled], &job.patterns[compiled]) != 0) {
+            pattern_free(&job.patterns[compiled]);
+            write_str(ERDEMOS_ERROR_COLOR "ersh: pkill: invalid pattern: " COLOR_RESET);
+            write_str(args[arg_idx + compiled]);
+            write_str("\n");
+            status = 1;
+            break;
+        }
+        if (exact) {
+            job.patterns[compiled].anchor_start = 1;
+            job.patterns[compiled].anchor_end = 1;
+        }
+    }
+    
+    if (status == 0) {
+        int matches = proc_scan(cmdline, pkill_match, &job, pkill_found);
+        if (matches < 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: pkill: cannot read /proc" COLOR_RESET "\n");
+        }
+        status = (matches <= 0) || job.failed;
+    }
+    for (int i = 0; i < compiled; i++) {
+        pattern_free(&job.patterns[i]);
+    }
+    free(job.patterns);
+    return status;
+}
+
+static int builtin_poweroff(char **args) {
+    (void)args;
+    write_str(ERDEMOS_WARNING_COLOR "Exiting shell and powering off..." COLOR_RESET "\n");
+    sync();
+    flush_output_at_exit();
+    execl("/bin/poweroff", "poweroff", NULL);
+    // If execl fails, just exit normally
+    exit(0);
+}
+
+static int builtin_pwd(char **args) {
+    (void)args;
+    char cwd[1024];
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        write_str(ERDEMOS_PRIMARY_COLOR);
+        write_str(cwd);
+        write_str(COLOR_RESET "\n");
+        return 0;
+    } else {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: pwd: failed to get current directory" COLOR_RESET "\n");
+        return 1;
+    }
+}
+
+static int builtin_rm(char **args) {
+    if (args[1] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: rm: missing argument" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    int force = 0;
+    int recursive = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        for (int i = 1; args[arg_idx][i] != '\0'; i++) {
+            if (args[arg_idx][i] == 'f') {
+                force = 1;
+            } else if (args[arg_idx][i] == 'r' || args[arg_idx][i] == 'R') {
+                recursive = 1;
+            }
+        }
+        arg_idx++;
+    }
+    
+    // Check if we have a path argument
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: rm: missing operand" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // Process each path argument
+    while (args[arg_idx] != NULL) {
+        const char *path = args[arg_idx];
+        struct stat st;
+        
+        if (stat(path, &st) != 0) {
+            if (!force) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot stat: " COLOR_RESET);
+                write_str(path);
+                write_str("\n");
+                return 1;
+            }
+            arg_idx++;
+            continue;
+        }
+        
+        if (S_ISDIR(st.st_mode)) {
+            if (!recursive) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot remove directory (use -r): " COLOR_RESET);
+                write_str(path);
+                write_str("\n");
+                if (!force) return 1;
+            } else {
+                if (remove_directory_recursive(path) != 0) {
+                    if (!force) {
+                        write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot remove directory: " COLOR_RESET);
+                        write_str(path);
+                        write_str("\n");
+                        return 1;
+                    }
+                }
+            }
+        } else {
+            if (unlink(path) != 0) {
+                if (!force) {
+                    write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot remove file: " COLOR_RESET);
+                    write_str(path);
+                    write_str("\n");
+                    return 1;
+                }
+            }
+        }
+        
+        arg_idx++;
+    }
+    
+    return 0;
+}
+
+static int remove_directory_recursive(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Skip . and ..
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        
+        // Build full path
+        char fullpath[1024];
+        int written = 0;
+        const char *p = path;
+        while (*p && written < 1023) {
+            fullpath[written++] = *p++;
+        }
+        if (written < 1023 && fullpath[written-1] != '/') {
+            fullpath[written++] = '/';
+        }
+        p = entry->d_name;
+        while (*p && written < 1023) {
+            fullpath[written++] = *p++;
+        }
+        fullpath[written] = '\0';
+        
+        struct stat st;
+        if (lstat(fullpath, &st) != 0) {
+            closedir(dir);
+            return -1;
+        }
+        
+        if (S_ISDIR(st.st_mode)) {
+            if (remove_directory_recursive(fullpath) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        } else {
+            if (unlink(fullpath) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        }
+    }
+    
+    closedir(dir);
+    return rmdir(path);
+}
+
+// sleep and timeout: deadlines on CLOCK_MONOTONIC
+//
+// Durations are decimal seconds with an optional s, m, h or d suffix and
+// are parsed into a timespec without floating point. sleep waits in the
+// shell itself until an absolute deadline, so being interrupted does not
+// stretch the total.
+
+// Parse a duration like 5, 0.25, 1.5m or 2h; returns 0 or -1
+static int parse_duration(const char *text, struct timespec *duration) {
+    if ((*text < '0' || *text > '9') && *text != '.') {
+        return -1;
+    }
+    uint64_t seconds = 0;
+    uint64_t nanoseconds = 0;
+    int digits = 0;
+    while (*text >= '0' && *text <= '9') {
+        seconds = seconds * 10 + (uint64_t)(*text++ - '0');
+        if (seconds > UINT32_MAX) {
+            return -1;
+        }
+        digits++;
+    }
+    if (*text == '.') {
+        text++;
+        uint64_t scale = 100000000;
+        while (*text >= '0' && *text <= '9') {
+            nanoseconds += (uint64_t)(*text++ - '0') * scale;
+            scale /= 10;
+            digits++;
+        }
+    }
+    uint64_t unit = 1;
+    switch (*text) {
+    case '\0': break;
+    case 's': unit = 1; text++; break;
+    case 'm': unit = 60; text++; break;
+    case 'h': unit = 3600; text++; break;
+    case 'd': unit = 86400; text++; break;
+    default: return -1;
+    }
+    if (*text != '\0' || digits == 0) {
+        return -1;
+    }
+    nanoseconds *= unit;
+    duration->tv_sec = (time_t)(seconds * unit + nanoseconds / 1000000000);
+    duration->tv_nsec = (long)(nanoseconds % 1000000000);
+    return 0;
+}
+
+static void timespec_add(struct timespec *time, const struct timespec *delta) {
+    time->tv_sec += delta->tv_sec;
+    time->tv_nsec += delta->tv_nsec;
+    if (time->tv_nsec >= 1000000000) {
+        time->tv_sec++;
+        time->tv_nsec -= 1000000000;
+    }
+}
+
+static int builtin_sleep(char **args) {
+    if (args[1] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: sleep: missing duration" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // Several durations add up, like 1m 30s
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    for (int i = 1; args[i] != NULL; i++) {
+        struct timespec duration;
+        if (parse_duration(args[i], &duration) != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: sleep: invalid duration: " COLOR_RESET);
+            write_str(args[i]);
+            write_str("\n");
+            return 1;
+        }
+        timespec_add(&deadline, &duration);
+    }
+    out_flush();
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+    return 0;
+}
+
+// stat: file status via statx
+//
+// The format is compiled once into a list of literal runs and fields, and
+// the union of the statx mask bits the fields need is computed from it.
+// Every file then costs exactly one statx() asking for only those fields,
+// which lets filesystems like NFS or FUSE skip the attributes nobody
+// wants; --sync=none additionally stops them from revalidating.
+
+#define STAT_DEFAULT_FORMAT \
+    "  File: %n\n" \
+    "  Size: %s\tBlocks: %b\tIO Block: %o\t%F\n" \
+    "Device: %D\tInode: %i\tLinks: %h\tMount ID: %M\n" \
+    "Access: (%a/%A)\tUid: (%u/%U)\tGid: (%g/%G)\n" \
+    "Access: %x\n" \
+    "Modify: %y\n" \
+    "Change: %z\n" \
+    " Birth: %w"
+
+// Offset of stx_mnt_id in the kernel's struct statx; glibc before 2.39
+// only has spare words there
+#define STATX_MNT_ID_OFFSET 0x90
+
+struct stat_op {
+    char field;             // Directive letter, or 0 for a literal run
+    const char *text;
+    size_t len;
+};
+
+struct stat_format {
+    struct stat_op *ops;
+    size_t count;
+    unsigned int mask;      // STATX_* bits the directives need
+    struct strbuf literals; // Literal text with escapes resolved
+};
+
+static unsigned int stat_field_mask(char field) {
+    switch (field) {
+    case 'n': case 'd': case 'D': case 'o': case 'B': return 0;
+    case 's': return STATX_SIZE;
+    case 'b': return STATX_BLOCKS;
+    case 'h': return STATX_NLINK;
+    case 'F': return STATX_TYPE;
+    case 'a': return STATX_MODE;
+    case 'A': return STATX_TYPE | STATX_MODE;
+    case 'u': case 'U': return STATX_UID;
+    case 'g': case 'G': return STATX_GID;
+    case 'i': return STATX_INO;
+    case 'M': return STATX_MNT_ID;
+    case 'x': case 'X': return STATX_ATIME;
+    case 'y': case 'Y': return STATX_MTIME;
+    case 'z': case 'Z': return STATX_CTIME;
+    case 'w': case 'W': return STATX_BTIME;
+    default: return UINT_MAX;
+    }
+}
+
+// Compile fmt; on error, returns the offending directive letter
+static int stat_compile(const char *fmt, struct stat_format *sf) {
+    size_t max_ops = strlen(fmt) + 1;
+    sf->ops = malloc(max_ops * sizeof(*sf->ops));
+    if (sf->ops == NULL) {
+        return '?';
+    }
+    
+    // Literal runs are stored as offsets while the buffer may still grow
+    const char *p = fmt;
+    while (*p != '\0') {
+        if (*p == '%' && p[1] != '%') {
+            unsigned int mask = stat_field_mask(p[1]);
+            if (mask == UINT_MAX) {
+                return (p[1] != '\0') ? p[1] : '%';
+            }
+            sf->mask |= mask;
+            sf->ops[sf->count++] = (struct stat_op){ .field = p[1] };
+            p += 2;
+            continue;
+        }
+        size_t start = sf->literals.len;
+        while (*p != '\0' && !(*p == '%' && p[1] != '%')) {
+            char c = *p++;
+            if (c == '%') {
+                p++;                    // "%%"
+            } else if (c == '\\' && *p == 'n') {
+                c = '\n';
+                p++;
+            } else if (c == '\\' && *p == 't') {
+                c = '\t';
+                p++;
+            } else if (c == '\\' && *p == '\\') {
+                p++;
+            }
+            sb_append(&sf->literals, &c, 1);
+        }
+        sf->ops[sf->count++] = (struct stat_op){ .len = sf->literals.len - start,
+                                                 .text = (const char *)start };
+    }
+    for (size_t i = 0; i < sf->count; i++) {
+        if (sf->ops[i].field == 0) {
+            sf->ops[i].text = sf->literals.data + (size_t)sf->ops[i].text;
+        }
+    }
+    return 0;
+}
+
+static void stat_format_free(struct stat_format *sf) {
+    free(sf->ops);
+    sb_free(&sf->literals);
+}
+
+static void sb_two_digits(struct strbuf *sb, int n) {
+    char buf[2] = { '0' + n / 10, '0' + n % 10 };
+    sb_append(sb, buf, 2);
+}
+
+// Append "YYYY-MM-DD hh:mm:ss.nnnnnnnnn +hhmm" in the ls -l time zone
+static void sb_timestamp(struct strbuf *sb, const struct statx_timestamp *ts) {
+    int64_t from, until;
+    int32_t offset = time_zone_offset(&ls_zone, ts->tv_sec, &from, &until);
+    int64_t local = ts->tv_sec + offset;
+    int64_t day = local / 86400;
+    int64_t seconds = local % 86400;
+    if (seconds < 0) {
+        seconds += 86400;
+        day--;
+    }
+    int64_t year;
+    int month, mday;
+    civil_from_days(day, &year, &month, &mday);
+    
+    sb_uint_aligned(sb, (year > 0) ? year : 0, 4);
+    sb_str(sb, "-");
+    sb_two_digits(sb, month);
+    sb_str(sb, "-");
+    sb_two_digits(sb, mday);
+    sb_str(sb, " ");
+    sb_two_digits(sb, seconds / 3600);
+    sb_str(sb, ":");
+    sb_two_digits(sb, seconds / 60 % 60);
+    sb_str(sb, ":");
+    sb_two_digits(sb, seconds % 60);
+    char nsec[10];
+    nsec[0] = '.';
+    for (int i = 9, n = ts->tv_nsec; i > 0; i--, n /= 10) {
+        nsec[i] = '0' + n % 10;
+    }
+    sb_append(sb, nsec, sizeof(nsec));
+    sb_str(sb, (offset < 0) ? " -" : " +");
+    int32_t minutes = ((offset < 0) ? -offset : offset) / 60;
+    sb_two_digits(sb, minutes / 60);
+    sb_two_digits(sb, minutes % 60);
+}
+
+static uint64_t statx_mnt_id(const struct statx *stx) {
+    uint64_t mnt_id;
+    memcpy(&mnt_id, (const char *)stx + STATX_MNT_ID_OFFSET, sizeof(mnt_id));
+    return mnt_id;
+}
+
+static void stat_apply(struct strbuf *sb, const struct stat_format *sf,
+                       const char *name, const struct statx *stx) {
+    for (size_t i = 0; i < sf->count; i++) {
+        const struct stat_op *op = &sf->ops[i];
+        if (op->field == 0) {
+            sb_append(sb, op->text, op->len);
+            continue;
+        }
+        // A field the filesystem did not return
+        unsigned int need = stat_field_mask(op->field);
+        if ((stx->stx_mask & need) != need) {
+            sb_str(sb, (op->field == 'W') ? "0" : "-");
+            continue;
+        }
+        char octal[8];
+        int i_oct = sizeof(octal);
+        const char *name_of;
+        switch (op->field) {
+        case 'n': sb_str(sb, name); break;
+        case 's': sb_uint_aligned(sb, stx->stx_size, 0); break;
+        case 'b': sb_uint_aligned(sb, stx->stx_blocks, 0); break;
+        case 'B': sb_str(sb, "512"); break;
+        case 'o': sb_uint_aligned(sb, stx->stx_blksize, 0); break;
+        case 'h': sb_uint_aligned(sb, stx->stx_nlink, 0); break;
+        case 'F': sb_str(sb, mode_type_name(stx->stx_mode)); break;
+        case 'a':
+            for (unsigned int mode = stx->stx_mode & 07777; i_oct == sizeof(octal) || mode > 0; mode >>= 3) {
+                octal[--i_oct] = '0' + (mode & 7);
+            }
+            sb_append(sb, octal + i_oct, sizeof(octal) - i_oct);
+            break;
+        case 'A': sb_permissions(sb, stx->stx_mode); break;
+        case 'u': sb_uint_aligned(sb, stx->stx_uid, 0); break;
+        case 'g': sb_uint_aligned(sb, stx->stx_gid, 0); break;
+        case 'U':
+        case 'G':
+            name_of = (op->field == 'U') ? id_map_lookup(&ls_users, stx->stx_uid)
+                                         : id_map_lookup(&ls_groups, stx->stx_gid);
+            sb_str(sb, (name_of != NULL) ? name_of : "UNKNOWN");
+            break;
+        case 'i': sb_uint_aligned(sb, stx->stx_ino, 0); break;
+        case 'd': sb_uint_aligned(sb, makedev(stx->stx_dev_major, stx->stx_dev_minor), 0); break;
+        case 'D':
+            sb_uint_aligned(sb, stx->stx_dev_major, 0);
+            sb_str(sb, ":");
+            sb_uint_aligned(sb, stx->stx_dev_minor, 0);
+            break;
+        case 'M': sb_uint_aligned(sb, statx_mnt_id(stx), 0); break;
+        case 'x': sb_timestamp(sb, &stx->stx_atime); break;
+        case 'y': sb_timestamp(sb, &stx->stx_mtime); break;
+        case 'z': sb_timestamp(sb, &stx->stx_ctime); break;
+        case 'w': sb_timestamp(sb, &stx->stx_btime); break;
+        case 'X': sb_uint_aligned(sb, stx->stx_atime.tv_sec, 0); break;
+        case 'Y': sb_uint_aligned(sb, stx->stx_mtime.tv_sec, 0); break;
+        case 'Z': sb_uint_aligned(sb, stx->stx_ctime.tv_sec, 0); break;
+        case 'W': sb_uint_aligned(sb, stx->stx_btime.tv_sec, 0); break;
+        }
+    }
+    sb_str(sb, "\n");
+}
+
+static void stat_json(struct json_writer *json, const char *name, const struct statx *stx) {
+    json_begin_object(json);
+    json_field_string(json, "name", name);
+    json_field_string(json, "type", mode_type_name(stx->stx_mode));
+    json_field_uint(json, "mode", stx->stx_mode & 07777);
+    json_field_uint(json, "size", stx->stx_size);
+    json_field_uint(json, "blocks", stx->stx_blocks);
+    json_field_uint(json, "nlink", stx->stx_nlink);
+    json_field_uint(json, "uid", stx->stx_uid);
+    json_field_uint(json, "gid", stx->stx_gid);
+    json_field_uint(json, "ino", stx->stx_ino);
+    json_field_uint(json, "dev", makedev(stx->stx_dev_major, stx->stx_dev_minor));
+    if (stx->stx_mask & STATX_MNT_ID) {
+        json_field_uint(json, "mnt_id", statx_mnt_id(stx));
+    }
+    json_field_int(json, "atime", stx->stx_atime.tv_sec);
+    json_field_int(json, "mtime", stx->stx_mtime.tv_sec);
+    json_field_int(json, "ctime", stx->stx_ctime.tv_sec);
+    if (stx->stx_mask & STATX_BTIME) {
+        json_field_int(json, "btime", stx->stx_btime.tv_sec);
+    }
+    json_end_object(json);
+}
+
+static int builtin_stat(char **args) {
+    const char *format = NULL;
+    int flags = AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT;
+    int output = OUTPUT_TEXT;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        const char *arg = args[arg_idx++];
+        if (strcmp(arg, "-c") == 0 && args[arg_idx] != NULL) {
+            format = args[arg_idx++];
+        } else if (strcmp(arg, "-L") == 0) {
+            flags &= ~AT_SYMLINK_NOFOLLOW;
+        } else if (strcmp(arg, "--json") == 0) {
+            output = OUTPUT_JSON;
+        } else if (strcmp(arg, "--sync=none") == 0) {
+            flags = (flags & ~AT_STATX_SYNC_TYPE) | AT_STATX_DONT_SYNC;
+        } else if (strcmp(arg, "--sync=force") == 0) {
+            flags = (flags & ~AT_STATX_SYNC_TYPE) | AT_STATX_FORCE_SYNC;
+        } else {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: stat: invalid option: " COLOR_RESET);
+            write_str(arg);
+            write_str("\n");
+            return 1;
+        }
+    }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: stat: missing argument" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    struct stat_format sf = {0};
+    if (output == OUTPUT_JSON) {
+        sf.mask = STATX_BASIC_STATS | STATX_BTIME | STATX_MNT_ID;
+    } else {
+        int bad = stat_compile((format != NULL) ? format : STAT_DEFAULT_FORMAT, &sf);
+        if (bad != 0) {
+            char directive[3] = { '%', (char)bad, '\0' };
+            write_str(ERDEMOS_ERROR_COLOR "ersh: stat: invalid directive: " COLOR_RESET);
+            write_str(directive);
+            write_str("\n");
+            stat_format_free(&sf);
+            return 1;
+        }
+    }
+    // Same owner and time zone tables as ls -l
+    if (sf.mask & (STATX_UID | STATX_GID | STATX_ATIME | STATX_MTIME | STATX_CTIME | STATX_BTIME)) {
+        ls_long_init();
+    }
+    
+    struct json_writer json = {0};
+    struct strbuf line = {0};
+    int status = 0;
+    if (output == OUTPUT_JSON) {
+        json_begin_array(&json);
+    }
+    for (; args[arg_idx] != NULL; arg_idx++) {
+        const char *path = args[arg_idx];
+        struct statx stx;
+        if (statx(AT_FDCWD, path, flags, sf.mask, &stx) != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: stat: cannot stat: " COLOR_RESET);
+            write_str(path);
+            write_str("\n");
+            status = 1;
+            continue;
+        }
+        if (output == OUTPUT_JSON) {
+            stat_json(&json, path, &stx);
+            continue;
+        }
+        if (format == NULL) {
+            write_str(ERDEMOS_PRIMARY_COLOR);
+        }
+        line.len = 0;
+        stat_apply(&line, &sf, path, &stx);
+        out_raw(line.data, line.len);
+    }
+    if (output == OUTPUT_JSON) {
+        json_end_array(&json);
+        out_raw("\n", 1);
+    } else if (format == NULL) {
+        write_str(COLOR_RESET);
+    }
+    
+    sb_free(&line);
+    stat_format_free(&sf);
+    return status;
+}
+
+// sysctl: kernel tunables and tuning profiles (see tune.h)
+//
+// The /proc/sys and /sys/kernel/mm directory fds, and those of the
+// top-level directories below them, are opened on first use and kept for
+// the life of the shell, so every later key costs one openat() and one
+// pread() or pwrite(). -P applies a named profile, the same one init
+// applies at boot with erdemos_tune=NAME on the kernel command line.
+
+#define SYSCTL_VALUE_MAX 4096
+
+static struct tune_dirs sysctl_dirs = { .roots = { -1, -1 } };
+
+static struct tune_dirs *sysctl_open(void) {
+    // Retry while /proc is not mounted yet
+    if (sysctl_dirs.roots[TUNE_ROOT_SYSCTL] < 0) {
+        tune_close(&sysctl_dirs);
+        tune_open(&sysctl_dirs);
+    }
+    return &sysctl_dirs;
+}
+
+static void sysctl_error(const char *what, const char *key) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: sysctl: ");
+    write_str((errno == ENOENT) ? "unknown key" : what);
+    write_str(": " COLOR_RESET);
+    write_str(key);
+    write_str("\n");
+}
+
+static void sysctl_line(const char *key, const char *value, int value_only) {
+    struct strbuf line = {0};
+    sb_str(&line, ERDEMOS_PRIMARY_COLOR);
+    if (!value_only) {
+        sb_str(&line, key);
+        sb_str(&line, " = ");
+    }
+    sb_str(&line, value);
+    sb_str(&line, "\n" COLOR_RESET);
+    out_write(line.data, line.len);
+    sb_free(&line);
+}
+
+// Print every readable file below dir as key = value; key holds the
+// dotted name of dir
+static void sysctl_walk(int dir, struct strbuf *key, int value_only) {
+    DIR *stream = fdopendir(dir);
+    if (stream == NULL) {
+        close(dir);
+        return;
+    }
+    size_t base = key->len;
+    struct dirent *entry;
+    while ((entry = readdir(stream)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        key->len = base;
+        if (base > 0) {
+            sb_append(key, ".", 1);
+        }
+        sb_str(key, entry->d_name);
+        sb_append(key, "", 1);
+        key->len--;
+        if (entry->d_type == DT_DIR) {
+            int sub = openat(dirfd(stream), entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (sub >= 0) {
+                sysctl_walk(sub, key, value_only);
+            }
+            continue;
+        }
+        // Write-only files and ones that need privileges are skipped
+        int fd = openat(dirfd(stream), entry->d_name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        char value[SYSCTL_VALUE_MAX];
+        ssize_t len = pread(fd, value, sizeof(value) - 1, 0);
+        close(fd);
+        if (len < 0) {
+            continue;
+        }
+        while (len > 0 && value[len - 1] == '\n') {
+            len--;
+        }
+        value[len] = '\0';
+        sysctl_line(key->data, value, value_only);
+    }
+    key->len = base;
+    closedir(stream);
+}
+
+static void sysctl_report(const struct tune_setting *setting, int error, long us) {
+    if (error != 0) {
+        errno = error;
+        sysctl_error((errno == EINVAL) ? "invalid value" : "cannot set", setting->key);
+        return;
+    }
+    struct strbuf line = {0};
+    sb_str(&line, ERDEMOS_PRIMARY_COLOR);
+    sb_str(&line, setting->key);
+    sb_str(&line, " = ");
+    sb_str(&line, setting->value);
+    sb_str(&line, " (");
+    sb_uint_aligned(&line, us, 0);
+    sb_str(&line, " us)\n" COLOR_RESET);
+    out_write(line.data, line.len);
+    sb_free(&line);
+}
+
+static int sysctl_profile(const char *name) {
+    if (name == NULL) {
+        for (int i = 0; i < TUNE_PROFILE_COUNT; i++) {
+            struct strbuf line = {0};
+            sb_str(&line, ERDEMOS_COMMAND_COLOR);
+            sb_str_padded(&line, tune_profiles[i].name, 12);
+            sb_str(&line, ERDEMOS_PRIMARY_COLOR);
+            sb_str(&line, tune_profiles[i].description);
+            sb_str(&line, "\n" COLOR_RESET);
+            out_write(line.data, line.len);
+            sb_free(&line);
+        }
+        return 0;
+    }
+    const struct tune_profile *profile = tune_profile_find(name);
+    if (profile == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: sysctl: unknown profile: " COLOR_RESET);
+        write_str(name);
         write_str("\n");
-        write_str(ERDEMOS_PRIMARY_COLOR "Valid layouts: us, trq, trf\n" COLOR_RESET);
         return 1;
     }
-    
-    // Execute the loadkeys binary
-    pid_t pid = fork();
-    if (pid == 0) {
-        // Child process
-        char *loadkeys_args[] = {"/bin/loadkeys", (char *)layout, NULL};
-        execv("/bin/loadkeys", loadkeys_args);
-        // If execv fails, show error
-        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: failed to execute /bin/loadkeys\n" COLOR_RESET);
-        _exit(1);
-    } else if (pid < 0) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: loadkeys: fork failed\n" COLOR_RESET);
+    return tune_apply(sysctl_open(), profile, sysctl_report) == 0 ? 0 : 1;
+}
+
+static int builtin_sysctl(char **args) {
+    int arg_idx = 1;
+    int value_only = 0;
+    int all = 0;
+    for (; args[arg_idx] != NULL && args[arg_idx][0] == '-' && args[arg_idx][1] != '\0'; arg_idx++) {
+        if (strcmp(args[arg_idx], "-n") == 0) {
+            value_only = 1;
+        } else if (strcmp(args[arg_idx], "-a") == 0) {
+            all = 1;
+        } else if (strcmp(args[arg_idx], "-P") == 0) {
+            return sysctl_profile(args[arg_idx + 1]);
+        } else {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: sysctl: invalid option: " COLOR_RESET);
+            write_str(args[arg_idx]);
+            write_str("\n");
+            return 1;
+        }
+    }
+    struct tune_dirs *dirs = sysctl_open();
+    if (all) {
+        int fd = (dirs->roots[TUNE_ROOT_SYSCTL] >= 0) ?
+                 openat(dirs->roots[TUNE_ROOT_SYSCTL], ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+        if (fd < 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: sysctl: cannot open: " COLOR_RESET "/proc/sys\n");
+            return 1;
+        }
+        struct strbuf key = {0};
+        sysctl_walk(fd, &key, value_only);
+        sb_free(&key);
+        return 0;
+    }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: sysctl: missing key" COLOR_RESET "\n");
         return 1;
-    } else {
-        // Parent process - wait for child
-        int status;
-        waitpid(pid, &status, 0);
-        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
     }
+
+    int status = 0;
+    for (; args[arg_idx] != NULL; arg_idx++) {
+        char *key = args[arg_idx];
+        char *value = strchr(key, '=');
+        if (value != NULL) {
+            *value++ = '\0';
+            if (tune_write(dirs, key, value) != 0) {
+                sysctl_error((errno == EINVAL) ? "invalid value" : "cannot set", key);
+                status = 1;
+                continue;
+            }
+            sysctl_line(key, value, value_only);
+            continue;
+        }
+        char current[SYSCTL_VALUE_MAX];
+        if (tune_read(dirs, key, current, sizeof(current)) < 0) {
+            sysctl_error("cannot read", key);
+            status = 1;
+            continue;
+        }
+        sysctl_line(key, current, value_only);
+    }
+    return status;
 }
 
-static int builtin_ls(char **args) {
-    int show_all = 0;
-    int long_format = 0;
+// timeout: run a command with a hard deadline
+//
+// The command runs in a forked child; a builtin runs there directly and an
+// external command replaces it, so the child is the command itself. The
+// shell then sleeps in a single epoll_wait() on the child's pidfd and a
+// timerfd armed with the duration, which wakes it either when the child
+// exits or when the deadline has passed, precise to the timer and with no
+// polling. After the signal, -k re-arms the same timer for SIGKILL.
+// Kernels without pidfds (before 5.3) get a 10 ms waitpid() poll instead.
+//
+// The child leads a process group of its own and the signal goes to the
+// whole group, so processes a script started are stopped with it. On a
+// terminal the group is made the foreground one while it runs, so the
+// command can still read the terminal and gets ^C.
+
+#define TIMEOUT_STATUS 124
+#define TIMEOUT_POLL_MS 10
+
+// Make pgid the foreground process group of the terminal. A caller that is
+// not in the foreground group would be stopped by SIGTTOU for this.
+static void terminal_give(pid_t pgid) {
+    sigset_t ttou, saved;
+    sigemptyset(&ttou);
+    sigaddset(&ttou, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &ttou, &saved);
+    tcsetpgrp(0, pgid);
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+}
+
+static int builtin_timeout(char **args) {
+    int sig = SIGTERM;
+    struct timespec duration;
+    struct timespec kill_after = {0, 0};
     int arg_idx = 1;
-    const char *path = ".";
     
     // Parse flags
     while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
-        for (int i = 1; args[arg_idx][i] != '\0'; i++) {
-            if (args[arg_idx][i] == 'a') {
-                show_all = 1;
-            } else if (args[arg_idx][i] == 'l') {
-                long_format = 1;
+        const char *arg = args[arg_idx++];
+        if (strcmp(arg, "--") == 0) {
+            break;
+        }
+        if (strcmp(arg, "-s") == 0 && args[arg_idx] != NULL) {
+            if ((sig = signal_parse(args[arg_idx])) < 0) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: timeout: invalid signal: " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                return 1;
+            }
+            arg_idx++;
+        } else if (strcmp(arg, "-k") == 0 && args[arg_idx] != NULL) {
+            if (parse_duration(args[arg_idx], &kill_after) != 0) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: timeout: invalid duration: " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                return 1;
             }
+            arg_idx++;
         }
-        arg_idx++;
     }
-    
-    // Get path if provided
-    if (args[arg_idx] != NULL) {
-        path = args[arg_idx];
+    if (args[arg_idx] == NULL || args[arg_idx + 1] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: timeout: expected duration and command" COLOR_RESET "\n");
+        return 1;
+    }
+    if (parse_duration(args[arg_idx], &duration) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: timeout: invalid duration: " COLOR_RESET);
+        write_str(args[arg_idx]);
+        write_str("\n");
+        return 1;
     }
+    char **command = args + arg_idx + 1;
     
-    DIR *dir = opendir(path);
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (timer < 0 || epoll < 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: timeout: cannot create timer" COLOR_RESET "\n");
+        if (timer >= 0) {
+            close(timer);
+        }
+        if (epoll >= 0) {
+            close(epoll);
+        }
+        return 1;
+    }
     
-    if (dir == NULL) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: ls: cannot open directory: " COLOR_RESET);
-        write_str(path);
-        write_str("\n");
+    int foreground = isatty(0) && tcgetpgrp(0) == getpgrp();
+    pid_t pid = shell_fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        if (foreground) {
+            terminal_give(getpid());
+        }
+        launch_in_child = 1;
+        int status = run_builtin(command);
+        if (status == NOT_BUILTIN) {
+            exec_command(command);
+        }
+        out_flush();
+        _exit(status);
+    }
+    if (pid < 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: timeout: fork failed" COLOR_RESET "\n");
+        close(epoll);
+        close(timer);
         return 1;
     }
     
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // Skip hidden files unless -a is specified
-        if (!show_all && entry->d_name[0] == '.') {
+    // Also here, so the group exists whichever process runs first
+    setpgid(pid, pid);
+    
+    // A zero duration arms nothing: the command runs without a deadline
+    struct itimerspec arm = { .it_value = duration };
+    timerfd_settime(timer, 0, &arm, NULL);
+    struct epoll_event event = { .events = EPOLLIN };
+    epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &event);
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd >= 0) {
+        epoll_ctl(epoll, EPOLL_CTL_ADD, pidfd, &event);
+    }
+    
+    // Signals sent so far: 1 after sig, 2 after the SIGKILL of -k
+    int sent = 0;
+    int status = 0;
+    pid_t waited;
+    while ((waited = waitpid(pid, &status, WNOHANG)) != pid) {
+        if (waited < 0 && errno != EINTR) {
+            break;                  // ECHILD: there is no child left to wait for
+        }
+        if (epoll_wait(epoll, &event, 1, (pidfd >= 0) ? -1 : TIMEOUT_POLL_MS) < 0 && errno != EINTR) {
+            // Without a working epoll, fall back to waiting for the child
+            while ((waited = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {
+            }
+            break;
+        }
+        uint64_t expirations;
+        if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations) || sent == 2) {
             continue;
         }
-        
-        if (long_format) {
-            // Build full path for stat
-            char fullpath[1024];
-            int written = 0;
-            const char *p = path;
-            while (*p && written < 1023) {
-                fullpath[written++] = *p++;
-            }
-            if (written < 1023 && fullpath[written-1] != '/') {
-                fullpath[written++] = '/';
-            }
-            p = entry->d_name;
-            while (*p && written < 1023) {
-                fullpath[written++] = *p++;
-            }
-            fullpath[written] = '\0';
-            
-            struct stat st;
-            if (stat(fullpath, &st) == 0) {
-                write_str(ERDEMOS_PRIMARY_COLOR);
-                write_permissions(st.st_mode);
-                write_str(" ");
-                write_size_aligned(st.st_size);
-                write_str("  ");
-                write_str(ERDEMOS_COMMAND_COLOR);
-                write_str(entry->d_name);
-                write_str(COLOR_RESET "\n");
+        int next = (sent == 0) ? sig : SIGKILL;
+        if (kill(-pid, next) != 0 &&
+            (pidfd < 0 || syscall(SYS_pidfd_send_signal, pidfd, next, NULL, 0) != 0)) {
+            kill(pid, next);
+        }
+        sent = (sent == 0 && (kill_after.tv_sec != 0 || kill_after.tv_nsec != 0)) ? 1 : 2;
+        if (sent == 1) {
+            arm.it_value = kill_after;
+            timerfd_settime(timer, 0, &arm, NULL);
+        }
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+    close(epoll);
+    close(timer);
+    if (foreground) {
+        terminal_give(getpgrp());
+    }
+    out_forget_style();
+    if (waited != pid) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: timeout: cannot wait for the command" COLOR_RESET "\n");
+        return 1;
+    }
+    
+    // 124 when the deadline was hit, like coreutils; 128+n after SIGKILL
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL && sent > 0) {
+        return 128 + SIGKILL;
+    }
+    if (sent > 0) {
+        return TIMEOUT_STATUS;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// touch: timestamps and batched creation
+//
+// Names are resolved relative to a cached fd of their directory, which is
+// only reopened when the directory part changes. A missing file is created
+// with O_EXCL, so a new file already has the current time and needs no
+// second call; an existing one gets utimensat(). With many names the
+// opens are queued as IORING_OP_OPENAT and the resulting fds closed with
+// IORING_OP_CLOSE in the next batch, so a thousand files cost a handful
+// of io_uring_enter() calls instead of two thousand system calls.
+
+#define TOUCH_OPEN_FLAGS (O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)
+#define TOUCH_CLOSE_TAG UINT64_MAX     // user_data of queued closes
+
+struct touch_state {
+    char **args;
+    int no_create;                  // -c
+    const struct timespec *times;   // NULL for the current time
+    struct uring *ring;
+    int pending[URING_BATCH];       // Argument index of each queued open
+    int pending_count;
+    int closing[URING_BATCH];       // Fds of the queued closes, queued first
+    int closing_count;
+    const char *dir_path;           // Directory part of the last name
+    size_t dir_len;
+    int dir_fd;
+    int status;
+};
+
+static void touch_error(const char *path) {
+    write_str(ERDEMOS_ERROR_COLOR "ersh: touch: cannot touch: " COLOR_RESET);
+    write_str(path);
+    write_str("\n");
+}
+
+static const char *touch_leaf(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return (slash != NULL) ? slash + 1 : path;
+}
+
+// A file that was just created has the current time already
+static void touch_created(struct touch_state *st, int fd, const char *path) {
+    if (st->times != NULL && futimens(fd, st->times) != 0) {
+        touch_error(path);
+        st->status = 1;
+    }
+}
+
+static void touch_existing(struct touch_state *st, const char *path) {
+    if (utimensat(st->dir_fd, touch_leaf(path), st->times, 0) != 0 &&
+        !(st->no_create && errno == ENOENT)) {
+        touch_error(path);
+        st->status = 1;
+    }
+}
+
+// Create or touch one name without the ring
+static void touch_open(struct touch_state *st, const char *path) {
+    int fd = openat(st->dir_fd, touch_leaf(path), TOUCH_OPEN_FLAGS, 0666);
+    if (fd >= 0) {
+        touch_created(st, fd, path);
+        close(fd);
+    } else if (errno == EEXIST) {
+        touch_existing(st, path);
+    } else {
+        touch_error(path);
+        st->status = 1;
+    }
+}
+
+// Submit queued opens (and closes from the previous batch), then queue
+// closes for the files that were created
+static void touch_flush(struct touch_state *st) {
+    struct uring *ring = st->ring;
+    if (ring == NULL || ring->queued == 0) {
+        return;
+    }
+    unsigned count = ring->queued;
+    int closes = st->closing_count;
+    st->pending_count = 0;
+    st->closing_count = 0;
+    unsigned submitted = uring_submit_wait(ring);
+    int fds[URING_BATCH];
+    int fd_count = 0;
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_cqe(ring)) != NULL) {
+        if (cqe->user_data != TOUCH_CLOSE_TAG) {
+            const char *path = st->args[st->pending[cqe->user_data]];
+            if (cqe->res >= 0) {
+                touch_created(st, cqe->res, path);
+                fds[fd_count++] = cqe->res;
+            } else if (cqe->res == -EEXIST) {
+                touch_existing(st, path);
             } else {
-                // Fallback if stat fails
-                write_str(ERDEMOS_PRIMARY_COLOR);
-                write_str(entry->d_name);
-                write_str(COLOR_RESET "\n");
+                touch_error(path);
+                st->status = 1;
             }
+        }
+        uring_cqe_seen(ring);
+    }
+    // Entries the kernel did not take, in queue order: closes, then opens
+    for (unsigned i = submitted; i < count; i++) {
+        if ((int)i < closes) {
+            close(st->closing[i]);
         } else {
-            write_str(ERDEMOS_PRIMARY_COLOR);
-            write_str(entry->d_name);
-            write_str("  " COLOR_RESET);
+            touch_open(st, st->args[st->pending[i - closes]]);
         }
     }
-    
-    if (!long_format) {
-        write_str("\n");
+    for (int i = 0; i < fd_count; i++) {
+        struct io_uring_sqe *sqe = uring_sqe(ring);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds[i];
+        sqe->user_data = TOUCH_CLOSE_TAG;
+        st->closing[st->closing_count++] = fds[i];
     }
-    
-    closedir(dir);
-    return 0;
 }
 
-static int builtin_mkdir(char **args) {
-    if (args[1] == NULL) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: mkdir: missing argument" COLOR_RESET "\n");
-        return 1;
+// Point dir_fd at the directory part of path, reusing the cached fd
+static int touch_dir(struct touch_state *st, const char *path, const char *leaf) {
+    size_t len = leaf - path;
+    if (st->dir_path != NULL && len == st->dir_len && memcmp(path, st->dir_path, len) == 0) {
+        return 0;
     }
-    
-    if (mkdir(args[1], 0755) != 0) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: mkdir: cannot create directory: " COLOR_RESET);
-        write_str(args[1]);
-        write_str("\n");
-        return 1;
+    // Queued opens still refer to the old fd
+    touch_flush(st);
+    if (st->dir_fd != AT_FDCWD) {
+        close(st->dir_fd);
     }
-    
+    st->dir_fd = AT_FDCWD;
+    st->dir_path = NULL;
+    if (len > 0) {
+        char dir[PATH_MAX];
+        if (len >= sizeof(dir)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+        int fd = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        st->dir_fd = fd;
+    }
+    st->dir_path = path;
+    st->dir_len = len;
     return 0;
 }
 
-static int builtin_poweroff(char **args) {
-    (void)args;
-    write_str(ERDEMOS_WARNING_COLOR "Exiting shell and powering off..." COLOR_RESET "\n");
-    sync();
-    execl("/bin/poweroff", "poweroff", NULL);
-    // If execl fails, just exit normally
-    exit(0);
-}
-
-static int builtin_pwd(char **args) {
-    (void)args;
-    char cwd[1024];
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        write_str(ERDEMOS_PRIMARY_COLOR);
-        write_str(cwd);
-        write_str(COLOR_RESET "\n");
+// Parse -d: "@SECONDS", "YYYY-MM-DD" or "YYYY-MM-DDTHH:MM[:SS]" (local time)
+static int touch_parse_date(const char *text, struct timespec *ts) {
+    if (text[0] == '@') {
+        char *end;
+        long long seconds = strtoll(text + 1, &end, 10);
+        if (end == text + 1 || *end != '\0') {
+            return -1;
+        }
+        ts->tv_sec = seconds;
+        ts->tv_nsec = 0;
         return 0;
-    } else {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: pwd: failed to get current directory" COLOR_RESET "\n");
-        return 1;
     }
+    // Fields in order, with the separator that must follow each one
+    static const char separators[] = "--T::";
+    int fields[6] = {0};
+    int count = 0;
+    const char *p = text;
+    while (count < 6) {
+        if (*p < '0' || *p > '9') {
+            return -1;
+        }
+        while (*p >= '0' && *p <= '9') {
+            fields[count] = fields[count] * 10 + (*p++ - '0');
+            if (fields[count] > 99999) {
+                return -1;
+            }
+        }
+        count++;
+        if (*p == '\0' || count == 6 || *p != separators[count - 1]) {
+            break;
+        }
+        p++;
+    }
+    // YYYY-MM-DD, optionally THH:MM, optionally :SS
+    if (*p != '\0' || (count != 3 && count != 5 && count != 6)) {
+        return -1;
+    }
+    int year = fields[0], month = fields[1], day = fields[2];
+    int hour = fields[3], minute = fields[4], second = fields[5];
+    if (month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || second > 60) {
+        return -1;
+    }
+    // Local to UTC: look the offset up twice to land on the right side of
+    // a transition
+    int64_t local = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    int64_t from, until;
+    int64_t t = local - time_zone_offset(&ls_zone, local, &from, &until);
+    t = local - time_zone_offset(&ls_zone, t, &from, &until);
+    ts->tv_sec = t;
+    ts->tv_nsec = 0;
+    return 0;
 }
 
-static int builtin_rm(char **args) {
-    if (args[1] == NULL) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: rm: missing argument" COLOR_RESET "\n");
+static int builtin_touch(char **args) {
+    struct touch_state *st = calloc(1, sizeof(*st));
+    if (st == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: touch: out of memory" COLOR_RESET "\n");
         return 1;
     }
-    
-    int force = 0;
-    int recursive = 0;
+    st->args = args;
+    st->dir_fd = AT_FDCWD;
+    struct timespec times[2];
     int arg_idx = 1;
     
     // Parse flags
     while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
-        for (int i = 1; args[arg_idx][i] != '\0'; i++) {
-            if (args[arg_idx][i] == 'f') {
-                force = 1;
-            } else if (args[arg_idx][i] == 'r' || args[arg_idx][i] == 'R') {
-                recursive = 1;
+        const char *arg = args[arg_idx++];
+        if (strcmp(arg, "-c") == 0) {
+            st->no_create = 1;
+        } else if (strcmp(arg, "-d") == 0 && args[arg_idx] != NULL) {
+            ls_long_init();
+            if (touch_parse_date(args[arg_idx], &times[0]) != 0) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: touch: invalid date: " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                free(st);
+                return 1;
+            }
+            times[1] = times[0];
+            st->times = times;
+            arg_idx++;
+        } else if (strcmp(arg, "-r") == 0 && args[arg_idx] != NULL) {
+            struct stat ref;
+            if (stat(args[arg_idx], &ref) != 0) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: touch: cannot stat: " COLOR_RESET);
+                write_str(args[arg_idx]);
+                write_str("\n");
+                free(st);
+                return 1;
+            }
+            times[0] = ref.st_atim;
+            times[1] = ref.st_mtim;
+            st->times = times;
+            arg_idx++;
+        } else {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: touch: invalid option: " COLOR_RESET);
+            write_str(arg);
+            write_str("\n");
+            free(st);
+            return 1;
+        }
+    }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: touch: missing argument" COLOR_RESET "\n");
+        free(st);
+        return 1;
+    }
+    int count = 0;
+    while (args[arg_idx + count] != NULL) {
+        count++;
+    }
+    if (count >= URING_MIN_BATCH && !st->no_create) {
+        st->ring = shell_uring();
+    }
+    
+    for (; args[arg_idx] != NULL; arg_idx++) {
+        const char *path = args[arg_idx];
+        const char *leaf = touch_leaf(path);
+        if (*leaf == '\0' || touch_dir(st, path, leaf) != 0) {
+            touch_error(path);
+            st->status = 1;
+            continue;
+        }
+        if (st->no_create) {
+            touch_existing(st, path);
+            continue;
+        }
+        
+        struct io_uring_sqe *sqe = NULL;
+        if (st->ring != NULL) {
+            if (st->ring->queued == st->ring->entries) {
+                touch_flush(st);
+            }
+            sqe = uring_sqe(st->ring);
+        }
+        if (sqe != NULL) {
+            st->pending[st->pending_count] = arg_idx;
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = st->dir_fd;
+            sqe->addr = (uintptr_t)leaf;
+            sqe->open_flags = TOUCH_OPEN_FLAGS;
+            sqe->len = 0666;
+            sqe->user_data = st->pending_count++;
+            continue;
+        }
+        touch_open(st, path);
+    }
+    
+    // Opens, then the closes they queued
+    touch_flush(st);
+    touch_flush(st);
+    if (st->dir_fd != AT_FDCWD) {
+        close(st->dir_fd);
+    }
+    int status = st->status;
+    free(st);
+    return status;
+}
+
+static int builtin_truncate(char **args) {
+    int no_create = 0;
+    const char *size_arg = NULL;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        if (strcmp(args[arg_idx], "-c") == 0) {
+            no_create = 1;
+        } else if (strcmp(args[arg_idx], "-s") == 0) {
+            if (args[arg_idx + 1] == NULL) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: truncate: missing value for " COLOR_RESET "-s\n");
+                return 1;
             }
+            size_arg = args[++arg_idx];
+        } else {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: truncate: invalid option: " COLOR_RESET);
+            write_str(args[arg_idx]);
+            write_str("\n");
+            return 1;
         }
         arg_idx++;
     }
+    if (size_arg == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: truncate: -s size is required" COLOR_RESET "\n");
+        return 1;
+    }
     
-    // Check if we have a path argument
+    // +SIZE grows and -SIZE shrinks each file by SIZE
+    off_t size;
+    int sign = 0;
+    const char *size_text = size_arg;
+    if (size_arg[0] == '+' || size_arg[0] == '-') {
+        sign = (size_arg[0] == '+') ? 1 : -1;
+        size_arg++;
+    }
+    if (parse_size(size_arg, &size) != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: truncate: invalid size: " COLOR_RESET);
+        write_str(size_text);
+        write_str("\n");
+        return 1;
+    }
     if (args[arg_idx] == NULL) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: rm: missing operand" COLOR_RESET "\n");
+        write_str(ERDEMOS_ERROR_COLOR "ersh: truncate: missing file" COLOR_RESET "\n");
         return 1;
     }
     
-    // Process each path argument
-    while (args[arg_idx] != NULL) {
+    int status = 0;
+    for (; args[arg_idx] != NULL; arg_idx++) {
         const char *path = args[arg_idx];
-        struct stat st;
-        
-        if (stat(path, &st) != 0) {
-            if (!force) {
-                write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot stat: " COLOR_RESET);
+        int fd = open(path, O_WRONLY | O_CLOEXEC | (no_create ? 0 : O_CREAT), 0644);
+        if (fd < 0) {
+            if (!(no_create && errno == ENOENT)) {
+                write_str(ERDEMOS_ERROR_COLOR "ersh: truncate: cannot open: " COLOR_RESET);
                 write_str(path);
                 write_str("\n");
-                return 1;
+                status = 1;
             }
-            arg_idx++;
             continue;
         }
-        
-        if (S_ISDIR(st.st_mode)) {
-            if (!recursive) {
-                write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot remove directory (use -r): " COLOR_RESET);
-                write_str(path);
-                write_str("\n");
-                if (!force) return 1;
-            } else {
-                if (remove_directory_recursive(path) != 0) {
-                    if (!force) {
-                        write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot remove directory: " COLOR_RESET);
-                        write_str(path);
-                        write_str("\n");
-                        return 1;
-                    }
-                }
+        off_t target = size;
+        struct stat st;
+        if (sign != 0 && fstat(fd, &st) == 0) {
+            target = st.st_size + sign * size;
+            if (target < 0) {
+                target = 0;
             }
+        }
+        // Growing leaves a hole: nothing is written
+        if (ftruncate(fd, target) != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: truncate: cannot truncate: " COLOR_RESET);
+            write_str(path);
+            write_str("\n");
+            status = 1;
+        }
+        close(fd);
+    }
+    return status;
+}
+
+static int builtin_umount(char **args) {
+    int flags = 0;
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        if (strcmp(args[arg_idx], "-l") == 0) {
+            flags |= MNT_DETACH;
         } else {
-            if (unlink(path) != 0) {
-                if (!force) {
-                    write_str(ERDEMOS_ERROR_COLOR "ersh: rm: cannot remove file: " COLOR_RESET);
-                    write_str(path);
-                    write_str("\n");
-                    return 1;
-                }
-            }
+            write_str(ERDEMOS_ERROR_COLOR "ersh: umount: invalid option: " COLOR_RESET);
+            write_str(args[arg_idx]);
+            write_str("\n");
+            return 1;
         }
-        
         arg_idx++;
     }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: umount: missing mount point" COLOR_RESET "\n");
+        return 1;
+    }
     
+    int status = 0;
+    for (; args[arg_idx] != NULL; arg_idx++) {
+        if (syscall(SYS_umount2, args[arg_idx], flags) != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: umount: ");
+            write_str((errno == EBUSY) ? "busy (try -l): " COLOR_RESET : "cannot unmount: " COLOR_RESET);
+            write_str(args[arg_idx]);
+            write_str("\n");
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int builtin_version(char **args) {
+    (void)args;
+    write_str(ERDEMOS_PRIMARY_COLOR "erdemOS " ERDEMOS_VERSION COLOR_RESET "\n");
     return 0;
 }
 
-static int remove_directory_recursive(const char *path) {
-    DIR *dir = opendir(path);
-    if (dir == NULL) {
+// watch: rerun a command and redraw only what changed
+//
+// The command runs on an absolute timerfd schedule: the timer is periodic,
+// so every run is due at start + n * interval however long the previous
+// one took, and runs missed by a slow command are skipped, not queued.
+// Its output is captured in a memfd standing in for stdout and stderr; a
+// builtin runs in the shell itself, an external command in a child that
+// inherits the memfd. The text is laid out into a grid of screen cells
+// and compared with what the terminal shows. Only runs of changed cells
+// are written, each after a cursor move, and gaps shorter than a move are
+// written through; an unchanged df over a serial console costs the clock
+// in the title line. Any key ends watch, also while an external command
+// runs, which is then interrupted.
+
+#define WATCH_GAP 8                 // Unchanged cells cheaper to rewrite than to skip
+#define WATCH_STOP_MS 1000          // From SIGINT to SIGKILL for a stopped command
+#define WATCH_DEFAULT_ROWS 24
+#define WATCH_DEFAULT_COLS 80
+
+struct watch_screen {
+    int rows;
+    int cols;
+    uint32_t *cells;                // This frame: each cell's UTF-8 bytes, packed
+    uint32_t *shown;                // On the terminal; 0 where unknown
+};
+
+// Resize the grids to the terminal; everything is redrawn after a change
+static int watch_resize(struct watch_screen *screen, int tty) {
+    struct winsize size;
+    int rows = WATCH_DEFAULT_ROWS;
+    int cols = WATCH_DEFAULT_COLS;
+    // Serial consoles report 0x0
+    if (ioctl(tty, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+        rows = size.ws_row;
+        cols = size.ws_col;
+    }
+    if (rows == screen->rows && cols == screen->cols) {
+        return 0;
+    }
+    free(screen->cells);
+    free(screen->shown);
+    screen->cells = malloc((size_t)rows * cols * sizeof(uint32_t));
+    screen->shown = calloc((size_t)rows * cols, sizeof(uint32_t));
+    if (screen->cells == NULL || screen->shown == NULL) {
         return -1;
     }
-    
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // Skip . and ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+    screen->rows = rows;
+    screen->cols = cols;
+    out_raw("\033[H\033[2J", 7);
+    return 0;
+}
+
+// Lay text out from row on, dropping escape sequences and control
+// characters and cutting lines at the right edge
+static void watch_layout(struct watch_screen *screen, int row, const char *text, size_t len) {
+    int col = 0;
+    for (size_t i = 0; i < len && row < screen->rows; i++) {
+        unsigned char c = (unsigned char)text[i];
+        uint32_t *line = screen->cells + (size_t)row * screen->cols;
+        if (c == '\n') {
+            row++;
+            col = 0;
+        } else if (c == '\r') {
+            col = 0;
+        } else if (c == '\t') {
+            col = (col + 8) & ~7;
+        } else if (c == '\033') {
+            // ESC [ parameters... final byte, or ESC and one byte
+            if (i + 1 < len && text[i + 1] == '[') {
+                for (i += 2; i < len && (text[i] < 0x40 || text[i] > 0x7e); i++) {
+                }
+            } else {
+                i++;
+            }
+        } else if (c >= 0x80 && c < 0xc0) {
+            // Continuation byte: joins the cell before, if it has room
+            if (col > 0 && col <= screen->cols && line[col - 1] < 0x1000000) {
+                uint32_t cell = line[col - 1];
+                int shift = (cell < 0x100) ? 8 : (cell < 0x10000) ? 16 : 24;
+                line[col - 1] = cell | (uint32_t)c << shift;
+            }
+        } else if (c >= 0x20 && c != 0x7f) {
+            if (col < screen->cols) {
+                line[col] = c;
+            }
+            col++;
         }
-        
-        // Build full path
-        char fullpath[1024];
-        int written = 0;
-        const char *p = path;
-        while (*p && written < 1023) {
-            fullpath[written++] = *p++;
+    }
+}
+
+static void watch_move(int row, int col) {
+    char buf[32];
+    size_t len = 0;
+    char digits[12];
+    buf[len++] = '\033';
+    buf[len++] = '[';
+    int values[2] = { row + 1, col + 1 };
+    for (int v = 0; v < 2; v++) {
+        int n = 0;
+        for (int x = values[v]; x > 0 || n == 0; x /= 10) {
+            digits[n++] = '0' + x % 10;
         }
-        if (written < 1023 && fullpath[written-1] != '/') {
-            fullpath[written++] = '/';
+        while (n > 0) {
+            buf[len++] = digits[--n];
         }
-        p = entry->d_name;
-        while (*p && written < 1023) {
-            fullpath[written++] = *p++;
+        buf[len++] = (v == 0) ? ';' : 'H';
+    }
+    out_raw(buf, len);
+}
+
+// Write the runs of cells that differ from what is shown
+static void watch_draw(struct watch_screen *screen) {
+    for (int row = 0; row < screen->rows; row++) {
+        uint32_t *cells = screen->cells + (size_t)row * screen->cols;
+        uint32_t *shown = screen->shown + (size_t)row * screen->cols;
+        int col = 0;
+        while (col < screen->cols) {
+            if (cells[col] == shown[col]) {
+                col++;
+                continue;
+            }
+            // Extend the run over changes and short unchanged gaps
+            int end = col + 1;
+            int last = col;
+            while (end < screen->cols && end - last <= WATCH_GAP) {
+                if (cells[end] != shown[end]) {
+                    last = end;
+                }
+                end++;
+            }
+            watch_move(row, col);
+            for (int i = col; i <= last; i++) {
+                char bytes[4];
+                int n = 0;
+                for (uint32_t cell = cells[i]; cell != 0 && n < 4; cell >>= 8) {
+                    bytes[n++] = (char)(cell & 0xff);
+                }
+                out_raw(bytes, n);
+                shown[i] = cells[i];
+            }
+            col = last + 1;
         }
-        fullpath[written] = '\0';
-        
-        struct stat st;
-        if (stat(fullpath, &st) != 0) {
-            closedir(dir);
-            return -1;
+    }
+}
+
+// Wait for the external command of a run while watching stdin. A key
+// stops it the way ^C would, with SIGINT and after WATCH_STOP_MS SIGKILL;
+// returns 1 if a key was pressed
+static int watch_wait(pid_t pid) {
+    int key = 0;
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd >= 0) {
+        struct pollfd fds[2] = { { .fd = pidfd, .events = POLLIN }, { .fd = 0, .events = POLLIN } };
+        int n;
+        while ((n = poll(fds, 2, -1)) < 0 && errno == EINTR) {
         }
-        
-        if (S_ISDIR(st.st_mode)) {
-            if (remove_directory_recursive(fullpath) != 0) {
-                closedir(dir);
-                return -1;
+        if (n > 0 && fds[0].revents == 0) {
+            char c;
+            key = 1;
+            if (read(0, &c, 1) < 0) {
+                key = -1;
             }
-        } else {
-            if (unlink(fullpath) != 0) {
-                closedir(dir);
-                return -1;
+            kill(pid, SIGINT);
+            if (poll(fds, 1, WATCH_STOP_MS) == 0) {
+                kill(pid, SIGKILL);
             }
         }
+        close(pidfd);
+    }
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    return key;
+}
+
+// Run command with stdout and stderr on the capture memfd; returns what
+// watch_wait() did, 0 for a builtin
+static int watch_run(char **command, int capture, int saved_out, int saved_err) {
+    ftruncate(capture, 0);
+    lseek(capture, 0, SEEK_SET);
+    out_flush();
+    async_writer_drain();
+    dup2(capture, 1);
+    dup2(capture, 2);
+    int color = out_stdout.color;
+    out_stdout.color = 0;
+    int key = 0;
+    if (run_builtin(command) == NOT_BUILTIN) {
+        pid_t pid = shell_fork();
+        if (pid == 0) {
+            exec_command(command);
+        }
+        if (pid > 0) {
+            key = watch_wait(pid);
+        }
+    }
+    out_flush();
+    async_writer_drain();
+    out_stdout.color = color;
+    out_forget_style();
+    dup2(saved_out, 1);
+    dup2(saved_err, 2);
+    return key;
+}
+
+// "Every 2s: command" with the local time at the right edge
+static void watch_title(struct watch_screen *screen, const char *title) {
+    for (int col = 0; col < screen->cols; col++) {
+        screen->cells[col] = ' ';
     }
+    watch_layout(screen, 0, title, strlen(title));
     
-    closedir(dir);
-    return rmdir(path);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t from, until;
+    int64_t local = now.tv_sec + time_zone_offset(&ls_zone, now.tv_sec, &from, &until);
+    int seconds = (int)(((local % 86400) + 86400) % 86400);
+    char clock[8] = {
+        '0' + seconds / 36000, '0' + seconds / 3600 % 10, ':',
+        '0' + seconds / 600 % 6, '0' + seconds / 60 % 10, ':',
+        '0' + seconds / 10 % 6, '0' + seconds % 10,
+    };
+    if (screen->cols >= (int)sizeof(clock)) {
+        for (int i = 0; i < (int)sizeof(clock); i++) {
+            screen->cells[screen->cols - (int)sizeof(clock) + i] = (unsigned char)clock[i];
+        }
+    }
 }
 
-static int builtin_touch(char **args) {
-    if (args[1] == NULL) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: touch: missing argument" COLOR_RESET "\n");
+static int builtin_watch(char **args) {
+    struct timespec interval = {2, 0};
+    const char *interval_text = "2";
+    int arg_idx = 1;
+    
+    // Parse flags
+    while (args[arg_idx] != NULL && args[arg_idx][0] == '-') {
+        const char *arg = args[arg_idx++];
+        if (strcmp(arg, "--") == 0) {
+            break;
+        }
+        if (strcmp(arg, "-n") != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: watch: invalid option: " COLOR_RESET);
+            write_str(arg);
+            write_str("\n");
+            return 1;
+        }
+        if (args[arg_idx] == NULL) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: watch: missing value for " COLOR_RESET "-n\n");
+            return 1;
+        }
+        interval_text = args[arg_idx++];
+        if (parse_duration(interval_text, &interval) != 0 ||
+            (interval.tv_sec == 0 && interval.tv_nsec == 0)) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: watch: invalid interval: " COLOR_RESET);
+            write_str(interval_text);
+            write_str("\n");
+            return 1;
+        }
+    }
+    if (args[arg_idx] == NULL) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: watch: missing command" COLOR_RESET "\n");
         return 1;
     }
-    
-    int fd = open(args[1], O_WRONLY | O_CREAT | O_NOCTTY | O_NONBLOCK, 0666);
-    if (fd < 0) {
-        write_str(ERDEMOS_ERROR_COLOR "ersh: touch: cannot create file: " COLOR_RESET);
-        write_str(args[1]);
+    char **command = args + arg_idx;
+    // They would leave the terminal raw with the cursor hidden
+    if (strcmp(command[0], "exit") == 0 || strcmp(command[0], "poweroff") == 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: watch: cannot watch: " COLOR_RESET);
+        write_str(command[0]);
         write_str("\n");
         return 1;
     }
     
-    close(fd);
-    return 0;
-}
-
-static int builtin_version(char **args) {
-    (void)args;
-    write_str(ERDEMOS_PRIMARY_COLOR "erdemOS " ERDEMOS_VERSION COLOR_RESET "\n");
-    return 0;
-}
-
-// Execute command
-static int execute(char **args) {
-    if (args[0] == NULL) {
-        return 0;
+    struct strbuf title = {0};
+    sb_str(&title, "Every ");
+    sb_str(&title, interval_text);
+    size_t text_len = strlen(interval_text);
+    if (interval_text[text_len - 1] >= '0' && interval_text[text_len - 1] <= '9') {
+        sb_str(&title, "s");
+    }
+    sb_str(&title, ":");
+    for (char **arg = command; *arg != NULL; arg++) {
+        sb_str(&title, " ");
+        sb_str(&title, *arg);
+    }
+    sb_append(&title, "", 1);
+    if (!ls_zone.loaded) {
+        time_zone_load(&ls_zone, "/etc/localtime");
+    }
+    
+    int capture = memfd_create("watch", MFD_CLOEXEC);
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    int saved_out = fcntl(1, F_DUPFD_CLOEXEC, 10);
+    int saved_err = fcntl(2, F_DUPFD_CLOEXEC, 10);
+    int fds[] = { capture, timer, epoll, saved_out, saved_err };
+    int status = 0;
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        status |= (fds[i] < 0);
+    }
+    if (status != 0) {
+        write_str(ERDEMOS_ERROR_COLOR "ersh: watch: cannot set up capture and timer" COLOR_RESET "\n");
+    }
+    
+    // Keys arrive one at a time and do not echo; ^C ends watch, not ersh
+    struct termios saved_tio;
+    int raw = (status == 0 && tcgetattr(0, &saved_tio) == 0);
+    if (raw) {
+        struct termios tio = saved_tio;
+        tio.c_lflag &= ~(ICANON | ECHO | ISIG);
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(0, TCSANOW, &tio);
+    }
+    
+    struct watch_screen screen = {0};
+    char *text = NULL;
+    size_t text_cap = 0;
+    if (status == 0) {
+        struct itimerspec schedule = { .it_interval = interval };
+        clock_gettime(CLOCK_MONOTONIC, &schedule.it_value);
+        timespec_add(&schedule.it_value, &interval);
+        timerfd_settime(timer, TFD_TIMER_ABSTIME, &schedule, NULL);
+        struct epoll_event event = { .events = EPOLLIN, .data.fd = timer };
+        epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &event);
+        event.data.fd = 0;
+        if (epoll_ctl(epoll, EPOLL_CTL_ADD, 0, &event) != 0) {
+            // A regular file cannot be polled: no key would ever end watch
+            write_str(ERDEMOS_ERROR_COLOR "ersh: watch: cannot read keys from stdin" COLOR_RESET "\n");
+            status = 1;
+        } else {
+            out_raw("\033[?25l", 6);
+        }
+    }
+    
+    while (status == 0) {
+        int key = watch_run(command, capture, saved_out, saved_err);
+        if (key != 0) {
+            status = (key < 0);
+            break;
+        }
+        struct stat st;
+        size_t len = (fstat(capture, &st) == 0) ? (size_t)st.st_size : 0;
+        if (len > text_cap) {
+            free(text);
+            text_cap = len;
+            text = malloc(text_cap);
+        }
+        ssize_t got = (text != NULL && len > 0) ? pread(capture, text, len, 0) : 0;
+        if (watch_resize(&screen, saved_out) != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "ersh: watch: out of memory" COLOR_RESET "\n");
+            status = 1;
+            break;
+        }
+        for (size_t i = 0; i < (size_t)screen.rows * screen.cols; i++) {
+            screen.cells[i] = ' ';
+        }
+        watch_title(&screen, title.data);
+        watch_layout(&screen, 2, text, (got > 0) ? (size_t)got : 0);
+        watch_draw(&screen);
+        out_flush();
+        
+        // Sleep until the next run is due or a key is pressed
+        struct epoll_event event;
+        int n;
+        while ((n = epoll_wait(epoll, &event, 1, -1)) < 0 && errno == EINTR) {
+        }
+        if (n < 0 || event.data.fd == 0) {
+            char key;
+            if (n > 0 && read(0, &key, 1) < 0) {
+                status = 1;
+            }
+            break;
+        }
+        uint64_t expirations;
+        ssize_t ignored = read(timer, &expirations, sizeof(expirations));
+        (void)ignored;
+    }
+    
+    if (raw) {
+        tcsetattr(0, TCSANOW, &saved_tio);
+    }
+    if (screen.rows > 0) {
+        watch_move(screen.rows - 1, 0);
+        out_raw("\033[?25h\n", 7);
     }
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(text);
+    free(screen.cells);
+    free(screen.shown);
+    sb_free(&title);
+    return status;
+}
 
-    // Check built-ins
+// Run a builtin; NOT_BUILTIN if there is none named args[0]
+static int run_builtin(char **args) {
     if (strcmp(args[0], "cd") == 0) {
         return builtin_cd(args);
     }
+    if (strcmp(args[0], "chmod") == 0) {
+        return builtin_chmod(args);
+    }
+    if (strcmp(args[0], "chown") == 0) {
+        return builtin_chown(args);
+    }
+    if (strcmp(args[0], "chrt") == 0) {
+        return builtin_chrt(args);
+    }
+    if (strcmp(args[0], "console") == 0) {
+        return builtin_console(args);
+    }
     if (strcmp(args[0], "copyright") == 0) {
         return builtin_copyright(args);
     }
+    if (strcmp(args[0], "df") == 0) {
+        return builtin_df(args);
+    }
     if (strcmp(args[0], "exit") == 0) {
         return builtin_exit(args);
     }
+    if (strcmp(args[0], "fallocate") == 0) {
+        return builtin_fallocate(args);
+    }
     if (strcmp(args[0], "help") == 0) {
         return builtin_help(args);
     }
+    if (strcmp(args[0], "ionice") == 0) {
+        return builtin_ionice(args);
+    }
+    if (strcmp(args[0], "kill") == 0) {
+        return builtin_kill(args);
+    }
     if (strcmp(args[0], "license") == 0) {
         return builtin_license(args);
     }
+    if (strcmp(args[0], "limit") == 0) {
+        return builtin_limit(args);
+    }
     if (strcmp(args[0], "loadkeys") == 0) {
         return builtin_loadkeys(args);
     }
@@ -600,40 +6743,99 @@ static int execute(char **args) {
     if (strcmp(args[0], "mkdir") == 0) {
         return builtin_mkdir(args);
     }
+    if (strcmp(args[0], "mount") == 0) {
+        return builtin_mount(args);
+    }
+    if (strcmp(args[0], "mounts") == 0) {
+        return builtin_mounts(args);
+    }
+    if (strcmp(args[0], "mv") == 0) {
+        return builtin_mv(args);
+    }
+    if (strcmp(args[0], "nice") == 0) {
+        return builtin_nice(args);
+    }
+    if (strcmp(args[0], "pidof") == 0) {
+        return builtin_pidof(args);
+    }
+    if (strcmp(args[0], "pkill") == 0) {
+        return builtin_pkill(args);
+    }
     if (strcmp(args[0], "poweroff") == 0) {
         return builtin_poweroff(args);
     }
     if (strcmp(args[0], "pwd") == 0) {
         return builtin_pwd(args);
     }
+    if (strcmp(args[0], "renice") == 0) {
+        return builtin_renice(args);
+    }
     if (strcmp(args[0], "rm") == 0) {
         return builtin_rm(args);
     }
+    if (strcmp(args[0], "sleep") == 0) {
+        return builtin_sleep(args);
+    }
+    if (strcmp(args[0], "stat") == 0) {
+        return builtin_stat(args);
+    }
+    if (strcmp(args[0], "sysctl") == 0) {
+        return builtin_sysctl(args);
+    }
+    if (strcmp(args[0], "taskset") == 0) {
+        return builtin_taskset(args);
+    }
+    if (strcmp(args[0], "timeout") == 0) {
+        return builtin_timeout(args);
+    }
     if (strcmp(args[0], "touch") == 0) {
         return builtin_touch(args);
     }
+    if (strcmp(args[0], "truncate") == 0) {
+        return builtin_truncate(args);
+    }
+    if (strcmp(args[0], "ulimit") == 0) {
+        return builtin_ulimit(args);
+    }
+    if (strcmp(args[0], "umount") == 0) {
+        return builtin_umount(args);
+    }
     if (strcmp(args[0], "version") == 0) {
         return builtin_version(args);
     }
+    if (strcmp(args[0], "watch") == 0) {
+        return builtin_watch(args);
+    }
+    return NOT_BUILTIN;
+}
+
+// Execute command
+static int execute(char **args) {
+    if (args[0] == NULL) {
+        return 0;
+    }
+
+    // Check built-ins
+    launch_reset();
+    int status = run_builtin(args);
+    if (status != NOT_BUILTIN) {
+        return status;
+    }
 
     // Fork and exec external command
-    pid_t pid = fork();
+    pid_t pid = shell_fork();
     if (pid == 0) {
         // Child process
-        execvp(args[0], args);
-        write_str(ERDEMOS_ERROR_COLOR "ersh: command not found: " ERDEMOS_COMMAND_COLOR);
-        write_str(args[0]);
-        write_str("\n");
-        _exit(127);
-    } else if (pid < 0) {
+        exec_command(args);
+    }
+    if (pid < 0) {
         write_str(ERDEMOS_ERROR_COLOR "ersh: fork failed" COLOR_RESET "\n");
         return 1;
-    } else {
-        // Parent process
-        int status;
-        waitpid(pid, &status, 0);
-        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
     }
+    // Parent process
+    waitpid(pid, &status, 0);
+    out_forget_style();
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
 }
 
 int main(void) {
@@ -641,11 +6843,25 @@ int main(void) {
     char *args[MAX_ARGS];
     ssize_t n;
 
+    atexit(flush_output_at_exit);
+    ls_colors_init();
+
+    if (getenv("ERSH_MLOCK") != NULL) {
+        lock_text();
+    }
+
+    // ERSH_CONSOLE=async or async-drop starts the console writer thread
+    const char *console = getenv("ERSH_CONSOLE");
+    if (console != NULL && strncmp(console, "async", 5) == 0) {
+        async_writer_start(strcmp(console, "async-drop") == 0 ? ASYNC_DROP : ASYNC_BLOCK);
+    }
+
     write_str(ERDEMOS_PRIMARY_COLOR "\n" "Type " ERDEMOS_COMMAND_COLOR "'help'" ERDEMOS_PRIMARY_COLOR " for built-in commands" COLOR_RESET "\n\n");
 
     while (1) {
         // Print prompt
         write_str(ERDEMOS_PROMPT_COLOR "> " ERDEMOS_COMMAND_COLOR);
+        out_flush();
 
         // Read command
         n = read(0, line, sizeof(line) - 1);
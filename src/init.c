@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
@@ -19,16 +20,438 @@
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <linux/kd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/reboot.h>
+#include <linux/reboot.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/fanotify.h>
 #include "../include/colors.h"
+#include "../include/output.h"
+#include "../include/fstab.h"
+#include "../include/tune.h"
 #include "../include/version.h"
 
-// Add proper process reaping
-void sigchld_handler(int sig) {
-    (void)sig;  // Unused parameter
-    while (waitpid(-1, NULL, WNOHANG) > 0);
+#define SHELL_PATH "/bin/ersh"
+#define LOADKEYS_PATH "/bin/loadkeys"
+#define PRELOAD_MANIFEST "/etc/preload.list"
+#define MAX_TIMELINE 256
+#define TIMELINE_PATHS 16384
+#define RECORD_QUIET_MS 500
+#define RECORD_MAX_MS 5000
+#define SHUTDOWN_GRACE_MS 2000
+#define RESPAWN_FAST_MS 1000
+#define RESPAWN_FAST_LIMIT 10
+
+// Boot timeline: every program init starts, and when recording every file
+// opened on the root file system, is recorded here so that a recorded boot
+// can be turned into a preload manifest
+struct boot_event {
+    long ms;
+    const char *path;
+};
+
+static struct boot_event timeline[MAX_TIMELINE];
+static int timeline_len = 0;
+static char timeline_paths[TIMELINE_PATHS];     // Copies of opened paths
+static size_t timeline_paths_len = 0;
+
+// Runtime configuration, normally from the kernel command line. Together
+// they let init run as PID 1 of a pid namespace on any Linux host:
+//   erdemos_root=DIR    chroot into DIR before starting anything
+//   erdemos_shell=PATH  shell to start and respawn (default /bin/ersh)
+//   erdemos_trace=1     print timestamped supervision events
+//   erdemos_test=1      exit after shutdown instead of powering off
+//   erdemos_tune=NAME   apply a tuning profile from tune.h after mounting
+static const char *shell_path = SHELL_PATH;
+static int tracing = 0;
+static int test_mode = 0;
+static long start_ms = 0;
+
+// Styled write wrapper (see output.h). The console is shared with the
+// shell, so every message goes out at once and starts from a known style.
+static void write_str(const char *str) {
+    out_forget_style();
+    out_str(str);
+    out_flush();
+}
+
+// Milliseconds since boot
+static long boot_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Append a string to a line buffer, truncating at its end
+static int append_str(char *buf, int len, int cap, const char *str) {
+    while (*str != '\0' && len < cap - 1) {
+        buf[len++] = *str++;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// Append a decimal number to a line buffer
+static int append_num(char *buf, int len, int cap, long n) {
+    char digits[24];
+    int i = sizeof(digits);
+    digits[--i] = '\0';
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0 && i > 0);
+    return append_str(buf, len, cap, digits + i);
+}
+
+// Print a supervision event with milliseconds since init started. The
+// line goes out in one write so it does not interleave with the shell.
+static void trace(const char *event, const char *detail, long num) {
+    if (!tracing) {
+        return;
+    }
+    char line[256];
+    int len = append_str(line, 0, sizeof(line), ERDEMOS_INFO_COLOR "[init ");
+    len = append_num(line, len, sizeof(line), boot_ms() - start_ms);
+    len = append_str(line, len, sizeof(line), " ms] " ERDEMOS_PRIMARY_COLOR);
+    len = append_str(line, len, sizeof(line), event);
+    if (detail != NULL) {
+        len = append_str(line, len, sizeof(line), " ");
+        len = append_str(line, len, sizeof(line), detail);
+    }
+    if (num >= 0) {
+        len = append_str(line, len, sizeof(line), " ");
+        len = append_num(line, len, sizeof(line), num);
+    }
+    len = append_str(line, len, sizeof(line), COLOR_RESET "\n");
+    write_str(line);
+}
+
+static void timeline_record(const char *path) {
+    if (timeline_len < MAX_TIMELINE) {
+        timeline[timeline_len].ms = boot_ms();
+        timeline[timeline_len].path = path;
+        timeline_len++;
+    }
+}
+
+// Record an opened file, keeping a copy of its path
+static void timeline_record_copy(const char *path) {
+    size_t len = strlen(path) + 1;
+    if (timeline_paths_len + len > sizeof(timeline_paths)) {
+        return;
+    }
+    char *copy = memcpy(timeline_paths + timeline_paths_len, path, len);
+    timeline_paths_len += len;
+    timeline_record(copy);
+}
+
+// Fork and exec a program, recording it in the boot timeline. init keeps
+// its signals blocked for sigtimedwait(), so the child unblocks them.
+static pid_t spawn(const char *path, char *const argv[]) {
+    timeline_record(path);
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        execv(path, argv);
+        _exit(1);
+    }
+    trace("spawn", path, pid);
+    return pid;
+}
+
+// Pull one manifest entry into the page cache. readahead() only queues the
+// I/O, so the stage costs little even when the files are large.
+static void preload_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        readahead(fd, 0, st.st_size);
+    }
+    close(fd);
+}
+
+// Preload every file listed in the manifest. Each line holds a path,
+// optionally followed by "mlock"; for the shell this makes ersh lock its
+// own text so it never takes major faults under memory pressure.
+static void preload_stage(void) {
+    int fd = open(PRELOAD_MANIFEST, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    char *buf = NULL;
+    ssize_t n = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (buf = malloc(st.st_size + 1)) != NULL) {
+        while (n < st.st_size) {
+            ssize_t got = read(fd, buf + n, st.st_size - n);
+            if (got <= 0) {
+                break;
+            }
+            n += got;
+        }
+    }
+    close(fd);
+    if (n <= 0) {
+        free(buf);
+        return;
+    }
+    buf[n] = '\0';
+
+    char *line = buf;
+    while (*line != '\0') {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        } else {
+            next = line + strlen(line);
+        }
+
+        if (line[0] == '/') {
+            char *flag = strchr(line, ' ');
+            if (flag != NULL) {
+                *flag++ = '\0';
+                while (*flag == ' ') {
+                    flag++;
+                }
+                if (strcmp(flag, "mlock") == 0 && strcmp(line, shell_path) == 0) {
+                    setenv("ERSH_MLOCK", "1", 1);
+                }
+            }
+            preload_file(line);
+        }
+        line = next;
+    }
+    free(buf);
+}
+
+// Start watching opens on the root file system for preload_record(), or
+// return -1 if fanotify is not available
+static int preload_watch(void) {
+    int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, "/") != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Add the regular files opened so far to the boot timeline. The boot is
+// taken to be over once no file has been opened for RECORD_QUIET_MS.
+static void preload_collect(int watch_fd) {
+    long deadline = boot_ms() + RECORD_MAX_MS;
+    struct pollfd pfd = { .fd = watch_fd, .events = POLLIN };
+    while (boot_ms() < deadline && poll(&pfd, 1, RECORD_QUIET_MS) > 0) {
+        char events[4096] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+        ssize_t len = read(watch_fd, events, sizeof(events));
+        if (len <= 0) {
+            continue;
+        }
+        struct fanotify_event_metadata *event = (struct fanotify_event_metadata *)events;
+        for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+            if (event->fd < 0) {
+                continue;
+            }
+            struct stat st;
+            char link[32] = "/proc/self/fd/";
+            char path[PATH_MAX];
+            append_num(link, strlen(link), sizeof(link), event->fd);
+            ssize_t n = readlink(link, path, sizeof(path) - 1);
+            if (n > 0 && fstat(event->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+                path[n] = '\0';
+                timeline_record_copy(path);
+            }
+            close(event->fd);
+        }
+    }
+}
+
+// The kernel API file systems everything else expects. The initramfs only
+// holds /bin, so the mount points are created first. A file system that is
+// already there (a container, a test root) is left alone.
+static void mount_api_filesystems(void) {
+    static const char *api[][3] = {
+        { "proc", "/proc", "nosuid,nodev,noexec" },
+        { "sysfs", "/sys", "nosuid,nodev,noexec" },
+        { "devtmpfs", "/dev", "nosuid" },
+    };
+    for (size_t i = 0; i < sizeof(api) / sizeof(api[0]); i++) {
+        mkdir(api[i][1], 0755);
+        if (mount_point_busy(api[i][1])) {
+            continue;
+        }
+        if (mount_fs(api[i][0], api[i][1], api[i][0], api[i][2]) != 0) {
+            trace("mount failed:", api[i][1], errno);
+        } else {
+            trace("mount", api[i][1], -1);
+        }
+    }
+}
+
+// Trace each /etc/fstab entry with the microseconds its mount took
+static void fstab_report(const struct fstab_entry *entry) {
+    if (entry->error != 0) {
+        write_str(ERDEMOS_WARNING_COLOR "init: cannot mount ");
+        write_str(entry->target);
+        write_str(COLOR_RESET "\n");
+    } else if (!entry->skipped) {
+        trace("mount", entry->target, entry->us);
+    }
+}
+
+static void tune_report(const struct tune_setting *setting, int error, long us) {
+    if (error != 0) {
+        write_str(ERDEMOS_WARNING_COLOR "init: cannot set ");
+        write_str(setting->key);
+        write_str(COLOR_RESET "\n");
+        return;
+    }
+    char detail[128];
+    int len = append_str(detail, 0, sizeof(detail), setting->key);
+    len = append_str(detail, len, sizeof(detail), "=");
+    append_str(detail, len, sizeof(detail), setting->value);
+    trace("tune", detail, us);
+}
+
+// Apply the tuning profile named on the kernel command line. The writes
+// go to /proc/sys and /sys, so this runs once the API file systems are up.
+static void tune_boot(const char *name) {
+    const struct tune_profile *profile = tune_profile_find(name);
+    if (profile == NULL) {
+        write_str(ERDEMOS_WARNING_COLOR "init: unknown tuning profile ");
+        write_str(name);
+        write_str(COLOR_RESET "\n");
+        return;
+    }
+    struct tune_dirs dirs;
+    tune_open(&dirs);
+    tune_apply(&dirs, profile, tune_report);
+    tune_close(&dirs);
+}
+
+// Write the programs started and files opened during this boot as a new
+// preload manifest
+static void preload_record(int watch_fd) {
+    if (watch_fd >= 0) {
+        preload_collect(watch_fd);
+        close(watch_fd);
+    } else {
+        write_str(ERDEMOS_WARNING_COLOR "init: cannot watch opens, recording programs only" COLOR_RESET "\n");
+    }
+    mkdir("/etc", 0755);
+    int fd = open(PRELOAD_MANIFEST, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        write_str(ERDEMOS_WARNING_COLOR "init: cannot write " PRELOAD_MANIFEST COLOR_RESET "\n");
+        return;
+    }
+    const char header[] = "# Recorded by init, in order of first use. Append \" mlock\" to the shell to lock its text.\n";
+    ssize_t ret = write(fd, header, sizeof(header) - 1);
+    for (int i = 0; i < timeline_len; i++) {
+        // Skip duplicates, e.g. a respawned shell
+        int seen = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(timeline[j].path, timeline[i].path) == 0) {
+                seen = 1;
+                break;
+            }
+        }
+        if (!seen) {
+            ret = write(fd, timeline[i].path, strlen(timeline[i].path));
+            ret = write(fd, "\n", 1);
+        }
+    }
+    (void)ret;
+    close(fd);
+}
+
+// Reap every exited child. Returns 1 if the shell was among them.
+static int reap_children(pid_t shell_pid) {
+    int shell_exited = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        if (pid == shell_pid) {
+            shell_exited = 1;
+        }
+    }
+    return shell_exited;
+}
+
+// Wait up to timeout_ms for all children to exit, reaping as they go.
+// Returns 1 once no children are left.
+static int wait_all_children(long timeout_ms, const sigset_t *set) {
+    long deadline = boot_ms() + timeout_ms;
+    while (1) {
+        pid_t pid;
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0);
+        if (pid < 0 && errno == ECHILD) {
+            return 1;
+        }
+        long left = deadline - boot_ms();
+        if (left <= 0) {
+            return 0;
+        }
+        struct timespec ts = { left / 1000, (left % 1000) * 1000000 };
+        sigtimedwait(set, NULL, &ts);
+    }
+}
+
+// Orderly shutdown: ask every process to terminate, give them a grace
+// period, kill what is left, sync and power off
+static void shutdown_system(const sigset_t *set) {
+    trace("shutdown:", "begin", -1);
+    kill(-1, SIGTERM);
+    trace("shutdown:", "SIGTERM sent", -1);
+    if (!wait_all_children(SHUTDOWN_GRACE_MS, set)) {
+        kill(-1, SIGKILL);
+        trace("shutdown:", "SIGKILL sent", -1);
+        wait_all_children(SHUTDOWN_GRACE_MS, set);
+    }
+    trace("shutdown:", "all processes exited", -1);
+    sync();
+    trace("shutdown:", "synced", -1);
+    if (test_mode) {
+        _exit(0);
+    }
+    reboot(LINUX_REBOOT_CMD_POWER_OFF);
+    _exit(0);
 }
 
 int main(void) {
+    start_ms = boot_ms();
+    const char *value = getenv("erdemos_shell");
+    if (value != NULL && value[0] != '\0') {
+        shell_path = value;
+    }
+    value = getenv("erdemos_trace");
+    tracing = value != NULL && strcmp(value, "1") == 0;
+    value = getenv("erdemos_test");
+    test_mode = value != NULL && strcmp(value, "1") == 0;
+    value = getenv("erdemos_root");
+    if (value != NULL && value[0] != '\0') {
+        if (chdir(value) != 0 || chroot(".") != 0 || chdir("/") != 0) {
+            write_str(ERDEMOS_ERROR_COLOR "init: cannot change root" COLOR_RESET "\n");
+            return 1;
+        }
+    }
+
+    mount_api_filesystems();
+    fstab_mount_all("/etc/fstab", fstab_report);
+    value = getenv("erdemos_tune");
+    if (value != NULL && value[0] != '\0') {
+        tune_boot(value);
+    }
+    
     // Set console to Unicode (UTF-8) mode
     int console_fd = open("/dev/console", O_RDWR);
     if (console_fd < 0) {
@@ -45,42 +468,74 @@ int main(void) {
     }
     
     // Clear screen using ANSI escape code
-    const char clear[] = "\033[2J\033[H";
-    ssize_t ret = write(1, clear, sizeof(clear) - 1);
-    if (ret < 0) {
-        return 1;
-    }
+    write_str("\033[2J\033[H");
     
     // Print message
-    const char msg[] = ERDEMOS_PRIMARY_COLOR "Welcome to erdemOS " ERDEMOS_VERSION "!\n";
-    ret = write(1, msg, sizeof(msg) - 1);
-    if (ret < 0) {
-        return 1;
-    }
+    write_str(ERDEMOS_PRIMARY_COLOR "Welcome to erdemOS " ERDEMOS_VERSION "!\n");
     
-    // Setup signal handlers
-    signal(SIGCHLD, sigchld_handler);
+    // All events are taken synchronously in the supervision loop below:
+    // SIGCHLD for reaping and respawning, SIGTERM and SIGUSR2 (sent by
+    // poweroff) for an orderly shutdown
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    
+    // Warm the page cache with the binaries this boot is going to need.
+    // Booting with erdemos_preload=record on the kernel command line skips
+    // the manifest and writes a fresh one from the boot timeline instead.
+    const char *preload_mode = getenv("erdemos_preload");
+    int recording = preload_mode != NULL && strcmp(preload_mode, "record") == 0;
+    int watch_fd = -1;
+    if (recording) {
+        watch_fd = preload_watch();
+    } else {
+        preload_stage();
+    }
     
     // Load English keyboard layout before starting shell
-    pid_t kbd_pid = fork();
-    if (kbd_pid == 0) {
-        // Child process - load keyboard
-        execl("/bin/loadkeys", "loadkeys", "us", NULL);
-        _exit(1);
-    } else if (kbd_pid > 0) {
+    char *kbd_argv[] = {"loadkeys", "us", NULL};
+    pid_t kbd_pid = spawn(LOADKEYS_PATH, kbd_argv);
+    if (kbd_pid > 0) {
         // Wait for loadkeys to complete
         waitpid(kbd_pid, NULL, 0);
     }
     
     // Fork and exec a shell
-    pid_t pid = fork();
-    if (pid == 0) {
-        execl("/bin/ersh", "ersh", NULL);
-        _exit(1);
+    char *shell_argv[] = {"ersh", NULL};
+    pid_t shell_pid = spawn(shell_path, shell_argv);
+    long shell_started = boot_ms();
+    int fast_exits = 0;
+    
+    if (recording) {
+        preload_record(watch_fd);
     }
     
-    // Wait for children instead of infinite loop
-    while(1) {
-        pause();
+    // Supervision loop: reap orphans and respawn the shell when it exits.
+    // A shell that keeps dying right after start is respawned once a second.
+    while (1) {
+        int sig = sigwaitinfo(&set, NULL);
+        if (sig == SIGTERM || sig == SIGUSR2) {
+            shutdown_system(&set);
+        }
+        if (sig != SIGCHLD || !reap_children(shell_pid)) {
+            continue;
+        }
+        
+        long lived = boot_ms() - shell_started;
+        trace("exit", shell_path, lived);
+        fast_exits = (lived < RESPAWN_FAST_MS) ? fast_exits + 1 : 0;
+        if (fast_exits >= RESPAWN_FAST_LIMIT) {
+            struct timespec ts = { 1, 0 };
+            sig = sigtimedwait(&set, NULL, &ts);
+            if (sig == SIGTERM || sig == SIGUSR2) {
+                shutdown_system(&set);
+            }
+            reap_children(-1);
+        }
+        shell_pid = spawn(shell_path, shell_argv);
+        shell_started = boot_ms();
     }
 }
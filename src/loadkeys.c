@@ -19,7 +19,9 @@
 #include <linux/keyboard.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+#include <stdlib.h>
 #include "../include/colors.h"
+#include "../include/output.h"
 
 // Helper macros for key types
 #define LETTER(c) K(KT_LETTER, (c))
@@ -41,10 +43,9 @@
 #define TR_O_diaer  0xD6  // Ö (Latin-1: 214)
 #define TR_C_cedil  0xC7  // Ç (Latin-1: 199)
 
-// Simple write wrapper
+// Styled write wrapper, buffered and tty-aware (see output.h)
 static void write_str(const char *str) {
-    ssize_t ret = write(1, str, strlen(str));
-    (void)ret;  // Ignore return value intentionally
+    out_str(str);
 }
 
 // Enable UTF-8 mode on console for proper Turkish character display
@@ -772,6 +773,8 @@ static void load_us_english(int fd) {
 
 // Load keyboard layout
 int main(int argc, char *argv[]) {
+    atexit(out_flush);
+
     if (argc != 2) {
         write_str(ERDEMOS_ERROR_COLOR "Usage: loadkeys [us|trq|trf]\n" COLOR_RESET);
         write_str(ERDEMOS_PRIMARY_COLOR "  us  - English (US) keyboard layout\n");
@@ -16,12 +16,19 @@
 #include <sys/reboot.h>
 #include <linux/reboot.h>
 #include <string.h>
+#include <signal.h>
 #include "../include/colors.h"
+#include "../include/output.h"
 
 int main(void) {
-    const char msg[] = ERDEMOS_ERROR_COLOR "Power off..." COLOR_RESET "\n";
-    ssize_t ret = write(1, msg, sizeof(msg) - 1);
-    (void)ret;
+    out_str(ERDEMOS_ERROR_COLOR "Power off..." COLOR_RESET "\n");
+    out_flush();
+    
+    // Let init stop every process in order; power off directly only when
+    // we are PID 1 ourselves or init cannot be signalled
+    if (getpid() != 1 && kill(1, SIGUSR2) == 0) {
+        return 0;
+    }
     
     sync();
     reboot(LINUX_REBOOT_CMD_POWER_OFF);
@@ -0,0 +1,186 @@
+#!/usr/bin/env bash
+#
+# Copyright 2025 Erdem Ersoy (eersoy93)
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+set -euo pipefail
+
+# Check output/ersh on the host under a pseudo-terminal, without QEMU
+#
+# Usage: ./test.sh [--bench|--init] [-v]
+#   --bench  Microbenchmark builtins on generated fixture trees instead of
+#            running the test/*.cases scripts, then compare bulk touch with
+#            and without io_uring (BENCH_TOUCH_FILES files, default 1000000)
+#   --init   Run output/init as PID 1 of a pid namespace (unshare) and check
+#            respawn, reaping and shutdown with test/init.cases
+#   -v       Print every command with its latency and output
+
+ROOT_DIR=$(cd "$(dirname "$0")" && pwd)
+cd "$ROOT_DIR"
+
+# Configuration
+HOST_CC=${HOST_CC:-${CC:-gcc}}
+OUTPUT_DIR=output
+TEST_DIR=test
+PTYRUN="$OUTPUT_DIR/ptyrun"
+ERSH="$ROOT_DIR/$OUTPUT_DIR/ersh"
+BENCH_RUNS=${BENCH_RUNS:-50}
+BENCH_FILES=${BENCH_FILES:-1000}
+BENCH_TOUCH_FILES=${BENCH_TOUCH_FILES:-1000000}
+MODE=test
+VERBOSE=""
+
+# Helper functions
+info() { echo "[$(date +%H:%M:%S)] $*"; }
+die() { echo "Error: $*" >&2; exit 1; }
+
+for arg in "$@"; do
+    case "$arg" in
+        --bench) MODE=bench ;;
+        --init) MODE=init ;;
+        -v) VERBOSE=-v ;;
+        *) die "Unknown option: $arg (usage: ./test.sh [--bench|--init] [-v])" ;;
+    esac
+done
+
+[ -x "$ERSH" ] || die "ersh not found at $ERSH (run ./build.sh first)"
+
+info "Compiling ptyrun (host)"
+mkdir -p "$OUTPUT_DIR"
+"$HOST_CC" -Wall -Wextra -O2 "$TEST_DIR/ptyrun.c" -o "$PTYRUN"
+PTYRUN="$ROOT_DIR/$PTYRUN"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Fill a directory with <dirs> subdirectories of <files> empty files each
+make_tree() {
+    local dir=$1 dirs=$2 files=$3
+    for d in $(seq 0 $((dirs - 1))); do
+        mkdir -p "$dir/dir$d"
+        (cd "$dir/dir$d" && seq -f "file%g" 0 $((files - 1)) | xargs touch)
+    done
+}
+
+if [ "$MODE" = init ]; then
+    command -v unshare >/dev/null 2>&1 || die "Required command not found: unshare"
+    ROOTFS="$WORK/rootfs"
+    info "Preparing root $ROOTFS"
+    mkdir -p "$ROOTFS/bin" "$ROOTFS/proc"
+    for name in init ersh poweroff; do
+        [ -x "$OUTPUT_DIR/$name" ] || die "$name not found in $OUTPUT_DIR (run ./build.sh first)"
+        cp "$OUTPUT_DIR/$name" "$ROOTFS/bin/$name"
+    done
+    "$HOST_CC" -Wall -Wextra -O2 -static "$TEST_DIR/forkstorm.c" -o "$ROOTFS/bin/forkstorm"
+
+    # An fstab for the init.cases fstab label: the inner tmpfs comes first
+    # but has to wait for the bind mount that makes its mount point exist
+    mkdir -p "$ROOTFS/etc" "$ROOTFS/srv/inner" "$ROOTFS/mnt/fs" "$ROOTFS/mnt/two words"
+    cat > "$ROOTFS/etc/fstab" <<'EOF'
+tmpfs       /mnt/fs/inner       tmpfs   size=1m     0 0
+/srv        /mnt/fs             none    bind        0 0
+tmpfs       /mnt/two\040words   tmpfs   mode=700    0 0
+EOF
+
+    # init becomes PID 1 of a new pid namespace with its own /proc. The user
+    # namespace maps us to root there, so no host privileges are needed. The
+    # startup time in the summary is the time to the first shell prompt.
+    info "Running test/init.cases with init as PID 1"
+    "$PTYRUN" $VERBOSE "$ROOT_DIR/$TEST_DIR/init.cases" -- \
+        unshare --user --map-root-user --pid --mount --fork --kill-child \
+        --mount-proc="$ROOTFS/proc" \
+        env -i PATH=/bin erdemos_root="$ROOTFS" erdemos_trace=1 erdemos_test=1 \
+        "$ROOTFS/bin/init"
+    info "All checks passed"
+    exit 0
+fi
+
+if [ "$MODE" = test ]; then
+    failed=0
+    for cases in "$TEST_DIR"/*.cases; do
+        # init.cases needs a pid namespace, see --init
+        [ "$cases" = "$TEST_DIR/init.cases" ] && continue
+        info "Running $cases"
+        rm -rf "$WORK/root"
+        mkdir -p "$WORK/root"
+        # Batch through io_uring even on one CPU, so both paths are covered
+        if ! (cd "$WORK/root" && ERSH_URING=1 "$PTYRUN" -q $VERBOSE "$ROOT_DIR/$cases" -- "$ERSH"); then
+            failed=1
+        fi
+    done
+    if [ "$failed" -ne 0 ]; then
+        die "Some checks failed"
+    fi
+    info "All checks passed"
+    exit 0
+fi
+
+# Benchmark: ls and ls -l on one large directory, help, and rm -r on a fresh
+# copy of a tree for every run
+info "Generating fixtures ($BENCH_FILES files, $BENCH_RUNS runs)"
+make_tree "$WORK/root/tree" 1 "$BENCH_FILES"
+for i in $(seq 0 $((BENCH_RUNS - 1))); do
+    make_tree "$WORK/root/rm$i" 4 25
+done
+
+{
+    echo "label ls"
+    for _ in $(seq "$BENCH_RUNS"); do echo "> ls tree/dir0"; done
+    echo "label ls -l"
+    for _ in $(seq "$BENCH_RUNS"); do echo "> ls -l tree/dir0"; done
+    echo "label help"
+    for _ in $(seq "$BENCH_RUNS"); do echo "> help"; done
+    echo "label rm -r (4x25 files)"
+    for i in $(seq 0 $((BENCH_RUNS - 1))); do echo "> rm -r rm$i"; done
+} > "$WORK/bench.script"
+
+info "Benchmarking $ERSH"
+(cd "$WORK/root" && "$PTYRUN" -t 60000 $VERBOSE "$WORK/bench.script" -- "$ERSH")
+
+# Bulk creation: BENCH_TOUCH_FILES empty files in directories of 1000, 250
+# names per touch, once with plain system calls and once batched through
+# io_uring
+{
+    echo "label mkdir -p (setup)"
+    awk -v n="$BENCH_TOUCH_FILES" 'BEGIN {
+        dirs = int((n + 999) / 1000)
+        for (d = 0; d < dirs; d++) {
+            if (d % 250 == 0) printf "%s> mkdir -p", (d ? "\n" : "")
+            printf " t/d%d", d
+        }
+        print ""
+    }'
+    echo "label touch ($BENCH_TOUCH_FILES files, 250 per command)"
+    awk -v n="$BENCH_TOUCH_FILES" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            if (i % 250 == 0) printf "%s> touch", (i ? "\n" : "")
+            printf " t/d%d/f%d", int(i / 1000), i % 1000
+        }
+        print ""
+    }'
+} > "$WORK/touch.script"
+
+for uring in 0 1; do
+    if [ "$uring" = 1 ]; then
+        info "Creating $BENCH_TOUCH_FILES files through io_uring"
+    else
+        info "Creating $BENCH_TOUCH_FILES files with system calls"
+    fi
+    rm -rf "$WORK/root/t"
+    start=$(date +%s%N)
+    (cd "$WORK/root" && ERSH_URING=$uring "$PTYRUN" -t 600000 "$WORK/touch.script" -- "$ERSH")
+    end=$(date +%s%N)
+    info "Total: $(( (end - start) / 1000000 )) ms"
+done
+rm -rf "$WORK/root/t"
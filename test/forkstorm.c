@@ -0,0 +1,99 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// forkstorm - orphan many short-lived processes onto init
+//
+// Runs inside the namespace test root (see ./test.sh --init). Every child
+// forks a grandchild and exits at once, so the grandchild is reparented to
+// init and must be reaped there. /proc is then polled until no zombies are
+// left, which measures how fast init's event loop reaps.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Count zombie processes in /proc
+static int count_zombies(void) {
+    DIR *dir = opendir("/proc");
+    if (dir == NULL) {
+        return -1;
+    }
+    int zombies = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        char path[64], buf[256];
+        snprintf(path, sizeof(path), "/proc/%.32s/stat", entry->d_name);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n <= 0) {
+            continue;
+        }
+        buf[n] = '\0';
+        // The state follows the parenthesised command name
+        char *p = strrchr(buf, ')');
+        if (p != NULL && p[1] == ' ' && p[2] == 'Z') {
+            zombies++;
+        }
+    }
+    closedir(dir);
+    return zombies;
+}
+
+int main(int argc, char *argv[]) {
+    int count = (argc > 1) ? atoi(argv[1]) : 1000;
+
+    double start = now_ms();
+    for (int i = 0; i < count; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (fork() == 0) {
+                _exit(0);
+            }
+            _exit(0);
+        }
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+    }
+    double forked = now_ms();
+
+    // Give init up to two seconds to catch up
+    int zombies;
+    while ((zombies = count_zombies()) > 0 && now_ms() - forked < 2000) {
+        usleep(100);
+    }
+    double reaped = now_ms();
+
+    printf("forkstorm: %d orphans in %.1f ms, reaped after %.1f ms, %d zombies left\n",
+           count, forked - start, reaped - forked, zombies);
+    return zombies == 0 ? 0 : 1;
+}
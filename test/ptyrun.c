@@ -0,0 +1,470 @@
+// Copyright 2025 Erdem Ersoy (eersoy93)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// ptyrun - drive an interactive program under a pseudo-terminal
+//
+// This is a host-side tool: it starts a command (normally output/ersh) on a
+// fresh pty, feeds it a script line by line, waits for the prompt after each
+// line and checks the output. Every command is timed from the write of its
+// input line to the next prompt.
+//
+// Script format, one directive per line:
+//   # text       Comment
+//   > command    Send command, wait for the prompt
+//   & command    Send command, read its output for a while without a prompt
+//   < keys       Type keys without a newline, wait for the prompt; the
+//                output counts as the previous & command's
+//   ~ text       Output of the last command contains text (ANSI stripped)
+//   + text       Same, but only after the text matched by the previous ~ or +
+//   ! text       Output of the last command does not contain text
+//   = text       Output of the last command has a line equal to text
+//   e text       Raw output contains text; "\e" stands for ESC
+//   label name   Group the following commands under name in the summary
+//   label        Group each following command under its own text again
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MAX_LABELS 256
+#define MAX_LINE 4096
+#define SETTLE_MS 500           // How long & reads the output of a command
+
+struct buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+struct label_stats {
+    char name[128];
+    double *samples;
+    size_t count;
+    size_t cap;
+};
+
+static const char *prompt = "> ";
+static int timeout_ms = 5000;
+static int loops = 1;
+static int verbose = 0;
+static int quiet = 0;
+
+static int master_fd = -1;
+static pid_t child_pid = -1;
+static int child_exited = 0;
+
+static struct buffer raw;       // Output of the current command as received
+static struct buffer plain;     // Same output with ANSI escapes and CR removed
+static size_t match_end = 0;    // End of the last ~ or + match in plain
+static int in_escape = 0;
+
+static struct label_stats labels[MAX_LABELS];
+static int label_count = 0;
+static char current_label[128] = "";
+
+static int failures = 0;
+static int commands_run = 0;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void buffer_append(struct buffer *b, const char *data, size_t len) {
+    if (b->len + len + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + len + 1) {
+            cap *= 2;
+        }
+        b->data = realloc(b->data, cap);
+        if (b->data == NULL) {
+            perror("ptyrun: realloc");
+            exit(2);
+        }
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+static void buffer_reset(struct buffer *b) {
+    b->len = 0;
+    if (b->data != NULL) {
+        b->data[0] = '\0';
+    }
+}
+
+// Append terminal output, keeping a raw copy and a copy without CSI escape
+// sequences and carriage returns for matching
+static void consume_output(const char *data, size_t len) {
+    buffer_append(&raw, data, len);
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (in_escape == 1) {
+            in_escape = (c == '[') ? 2 : 0;
+            continue;
+        }
+        if (in_escape == 2) {
+            if (c >= 0x40 && c <= 0x7e) {
+                in_escape = 0;
+            }
+            continue;
+        }
+        if (c == '\033') {
+            in_escape = 1;
+            continue;
+        }
+        if (c == '\r') {
+            continue;
+        }
+        buffer_append(&plain, &c, 1);
+    }
+}
+
+static int prompt_seen(void) {
+    size_t plen = strlen(prompt);
+    return plain.len >= plen && memcmp(plain.data + plain.len - plen, prompt, plen) == 0;
+}
+
+// Read from the pty until the prompt shows up, the child exits or the
+// timeout expires. Returns 0 on prompt, 1 on exit and -1 on timeout.
+// With settle set, reads for settle_ms and returns 0 with no prompt.
+static int read_output(int settle_ms) {
+    double deadline = now_ms() + (settle_ms > 0 ? settle_ms : timeout_ms);
+    char buf[4096];
+
+    while (settle_ms > 0 || !prompt_seen()) {
+        int left = (int)(deadline - now_ms());
+        if (left <= 0) {
+            return (settle_ms > 0) ? 0 : -1;
+        }
+        struct pollfd pfd = { .fd = master_fd, .events = POLLIN };
+        int r = poll(&pfd, 1, left);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            continue;
+        }
+        ssize_t n = read(master_fd, buf, sizeof(buf));
+        if (n > 0) {
+            consume_output(buf, n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            // EIO once the last slave fd is closed
+            child_exited = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int wait_prompt(void) {
+    return read_output(0);
+}
+
+static void record_sample(const char *name, double ms) {
+    int i;
+    for (i = 0; i < label_count; i++) {
+        if (strcmp(labels[i].name, name) == 0) {
+            break;
+        }
+    }
+    if (i == label_count) {
+        if (label_count == MAX_LABELS) {
+            return;
+        }
+        snprintf(labels[i].name, sizeof(labels[i].name), "%s", name);
+        label_count++;
+    }
+    struct label_stats *l = &labels[i];
+    if (l->count == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 16;
+        l->samples = realloc(l->samples, l->cap * sizeof(double));
+        if (l->samples == NULL) {
+            perror("ptyrun: realloc");
+            exit(2);
+        }
+    }
+    l->samples[l->count++] = ms;
+}
+
+static void start_child(char **argv) {
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        perror("ptyrun: posix_openpt");
+        exit(2);
+    }
+    const char *slave_name = ptsname(master_fd);
+
+    child_pid = fork();
+    if (child_pid < 0) {
+        perror("ptyrun: fork");
+        exit(2);
+    }
+    if (child_pid == 0) {
+        setsid();
+        int slave_fd = open(slave_name, O_RDWR);
+        if (slave_fd < 0) {
+            _exit(127);
+        }
+        // Canonical mode delivers one line per read(), like the console.
+        // Echo is off so captured output holds only what the program wrote.
+        struct termios tio;
+        if (tcgetattr(slave_fd, &tio) == 0) {
+            tio.c_lflag &= ~(ECHO | ECHONL);
+            tcsetattr(slave_fd, TCSANOW, &tio);
+        }
+        dup2(slave_fd, 0);
+        dup2(slave_fd, 1);
+        dup2(slave_fd, 2);
+        if (slave_fd > 2) {
+            close(slave_fd);
+        }
+        execvp(argv[0], argv);
+        fprintf(stderr, "ptyrun: cannot execute %s\n", argv[0]);
+        _exit(127);
+    }
+}
+
+// Turn "\e" into ESC for raw output expectations
+static void unescape(const char *in, char *out, size_t size) {
+    size_t o = 0;
+    for (size_t i = 0; in[i] != '\0' && o + 1 < size; i++) {
+        if (in[i] == '\\' && in[i + 1] == 'e') {
+            out[o++] = '\033';
+            i++;
+        } else {
+            out[o++] = in[i];
+        }
+    }
+    out[o] = '\0';
+}
+
+static int has_line(const char *text, const char *line) {
+    size_t len = strlen(line);
+    const char *p = text;
+    while ((p = strstr(p, line)) != NULL) {
+        int starts = (p == text || p[-1] == '\n');
+        int ends = (p[len] == '\n' || p[len] == '\0');
+        if (starts && ends) {
+            return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+static void fail(const char *script, int lineno, const char *what, const char *cmd) {
+    failures++;
+    fprintf(stderr, "FAIL %s:%d: %s\n", script, lineno, what);
+    fprintf(stderr, "  command: %s\n", cmd);
+    fprintf(stderr, "  output:\n%s\n", plain.data ? plain.data : "");
+}
+
+static void run_script(const char *script) {
+    FILE *f = fopen(script, "r");
+    if (f == NULL) {
+        fprintf(stderr, "ptyrun: cannot open %s\n", script);
+        exit(2);
+    }
+
+    char line[MAX_LINE];
+    char last_cmd[MAX_LINE] = "";
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        const char *arg = (line[1] == ' ') ? line + 2 : line + 1;
+
+        if (strncmp(line, "label", 5) == 0 && (line[5] == '\0' || line[5] == ' ')) {
+            snprintf(current_label, sizeof(current_label), "%.127s", line[5] ? line + 6 : "");
+        } else if (line[0] == '&') {
+            if (child_exited) {
+                fail(script, lineno, "program exited before command", arg);
+                continue;
+            }
+            snprintf(last_cmd, sizeof(last_cmd), "%s", arg);
+            buffer_reset(&raw);
+            buffer_reset(&plain);
+            match_end = 0;
+            ssize_t w = write(master_fd, arg, strlen(arg));
+            w = write(master_fd, "\n", 1);
+            (void)w;
+            read_output(SETTLE_MS);
+            if (verbose) {
+                printf("  (running)  %s\n%s\n", arg, plain.data ? plain.data : "");
+            }
+        } else if (line[0] == '>' || line[0] == '<') {
+            if (child_exited) {
+                fail(script, lineno, "program exited before command", arg);
+                continue;
+            }
+            if (line[0] == '>') {
+                snprintf(last_cmd, sizeof(last_cmd), "%s", arg);
+                buffer_reset(&raw);
+                buffer_reset(&plain);
+                match_end = 0;
+            }
+
+            double start = now_ms();
+            ssize_t w = write(master_fd, arg, strlen(arg));
+            if (line[0] == '>') {
+                w = write(master_fd, "\n", 1);
+            }
+            (void)w;
+            int r = wait_prompt();
+            double ms = now_ms() - start;
+
+            // Drop the trailing prompt from the captured output
+            if (r == 0) {
+                plain.len -= strlen(prompt);
+                plain.data[plain.len] = '\0';
+            }
+            commands_run++;
+            if (r < 0) {
+                fail(script, lineno, "timed out waiting for prompt", arg);
+                continue;
+            }
+            record_sample(current_label[0] ? current_label : arg, ms);
+            if (verbose) {
+                printf("%9.3f ms  %s\n%s", ms, arg, plain.data ? plain.data : "");
+            }
+        } else if (line[0] == '~' || line[0] == '+') {
+            size_t from = (line[0] == '+') ? match_end : 0;
+            const char *found = plain.data ? strstr(plain.data + from, arg) : NULL;
+            if (found == NULL) {
+                fail(script, lineno, line[0] == '+' ? "expected text after previous match"
+                                                    : "expected output to contain text", last_cmd);
+            } else {
+                match_end = (found - plain.data) + strlen(arg);
+            }
+        } else if (line[0] == '!') {
+            if (plain.data != NULL && strstr(plain.data, arg) != NULL) {
+                fail(script, lineno, "expected output not to contain text", last_cmd);
+            }
+        } else if (line[0] == '=') {
+            if (plain.data == NULL || !has_line(plain.data, arg)) {
+                fail(script, lineno, "expected output line", last_cmd);
+            }
+        } else if (line[0] == 'e') {
+            char expected[MAX_LINE];
+            unescape(arg, expected, sizeof(expected));
+            if (raw.data == NULL || strstr(raw.data, expected) == NULL) {
+                fail(script, lineno, "expected raw output to contain text", last_cmd);
+            }
+        } else {
+            fprintf(stderr, "ptyrun: %s:%d: unknown directive\n", script, lineno);
+            exit(2);
+        }
+    }
+    fclose(f);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_summary(double startup_ms) {
+    printf("%-40s %6s %9s %9s %9s\n", "command", "runs", "min ms", "median", "max ms");
+    printf("%-40.40s %6d %9.3f %9.3f %9.3f\n", "(startup)", 1, startup_ms, startup_ms, startup_ms);
+    for (int i = 0; i < label_count; i++) {
+        struct label_stats *l = &labels[i];
+        qsort(l->samples, l->count, sizeof(double), compare_double);
+        printf("%-40.40s %6zu %9.3f %9.3f %9.3f\n", l->name, l->count,
+               l->samples[0], l->samples[l->count / 2], l->samples[l->count - 1]);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: ptyrun [-v] [-q] [-l loops] [-t timeout_ms] [-p prompt] script -- command [args...]\n"
+            "  -v  Print every command with its latency and output\n"
+            "  -q  Do not print the latency summary\n"
+            "  -l  Run the script this many times in the same session\n"
+            "  -t  Per-command timeout in milliseconds (default 5000)\n"
+            "  -p  Prompt that ends a command's output (default \"> \")\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "vql:t:p:")) != -1) {
+        switch (opt) {
+        case 'v': verbose = 1; break;
+        case 'q': quiet = 1; break;
+        case 'l': loops = atoi(optarg); break;
+        case 't': timeout_ms = atoi(optarg); break;
+        case 'p': prompt = optarg; break;
+        default: usage();
+        }
+    }
+    if (optind >= argc) {
+        usage();
+    }
+    const char *script = argv[optind++];
+    if (optind < argc && strcmp(argv[optind], "--") == 0) {
+        optind++;
+    }
+    if (optind >= argc || loops < 1) {
+        usage();
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    double start = now_ms();
+    start_child(argv + optind);
+    if (wait_prompt() != 0) {
+        fprintf(stderr, "ptyrun: no prompt from %s\n%s\n", argv[optind], plain.data ? plain.data : "");
+        kill(child_pid, SIGKILL);
+        return 2;
+    }
+    double startup_ms = now_ms() - start;
+
+    for (int i = 0; i < loops; i++) {
+        run_script(script);
+    }
+
+    // Closing the master hangs up the session; reap whatever is left
+    close(master_fd);
+    kill(child_pid, SIGHUP);
+    waitpid(child_pid, NULL, 0);
+
+    if (!quiet) {
+        print_summary(startup_ms);
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed in %d commands\n", failures, commands_run);
+        return 1;
+    }
+    return 0;
+}